@@ -14,7 +14,7 @@ typedef struct arm_mmio_ {
 	int                fd; /* for interrupts */
 } *Arm_MMIO;
 
-
+#ifdef __arm__
 static inline uint32_t __raw_readl(Arm_MMIO mio, unsigned regno)
 {
 volatile uint32_t *addr;
@@ -34,6 +34,7 @@ volatile uint32_t *addr;
 		     : "+Qo" (*addr)
 		     : "r" (val));
 }
+#endif
 
 static inline uint32_t __bad_readl(Arm_MMIO mio, unsigned regno)
 {
@@ -46,8 +47,14 @@ static inline void __bad_writel(Arm_MMIO mio, unsigned regno, uint32_t val)
 }
 
 
+#ifdef __arm__
 #define iowrite32(m, r, v) __raw_writel(m, r, v)
 #define ioread32(m, r)    __raw_readl(m, r)
+#else
+/* host build; e.g., for testing against a simulated register window */
+#define iowrite32(m, r, v) __bad_writel(m, r, v)
+#define ioread32(m, r)    __bad_readl(m, r)
+#endif
 
 Arm_MMIO
 arm_mmio_init(const char *fnam);
@@ -0,0 +1,578 @@
+/* Streaming I2C/MDIO protocol decoder for gpiola captures and VCD files
+ * (e.g., gpiolib edge traces, see gpio_trace_start()).
+ *
+ * The capture is processed in a single pass, one run-length record
+ * (i.e., one pin change) at a time; a 16-entry table classifies each
+ * change of the (clock, data) pair into clock/data edges.
+ * Transactions are printed as they are recognized and timing parameters
+ * are checked against the bus specification (I2C: UM10204 standard- or
+ * fast-mode; MDIO: IEEE 802.3 clause 22.3.4).
+ *
+ * NOTE: measured times are multiples of the sample period; a parameter
+ *       is flagged if the *measured* value is below the limit, i.e.,
+ *       the check errs on the safe side.
+ *       In VCD files, 'x' and 'z' are taken as high (pulled-up bus).
+ */
+
+#include <gpiolib.h>
+#include <gpiola.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#define MODE_I2C  0
+#define MODE_MDIO 1
+
+/* edge table: index is (prev_state << 2) | state, state = (clk << 1) | dat */
+#define EV_CR  (1<<0) /* clock rises   */
+#define EV_CF  (1<<1) /* clock falls   */
+#define EV_DR  (1<<2) /* data rises    */
+#define EV_DF  (1<<3) /* data falls    */
+
+static const uint8_t evtab[16] = {
+	/* 00 -> */ 0,             EV_DR,         EV_CR,         EV_CR | EV_DR,
+	/* 01 -> */ EV_DF,         0,             EV_CR | EV_DF, EV_CR,
+	/* 10 -> */ EV_CF,         EV_CF | EV_DR, 0,             EV_DR,
+	/* 11 -> */ EV_CF | EV_DF, EV_CF,         EV_DF,         0,
+};
+
+/* timing limits (ns) */
+typedef struct i2c_lim_ {
+	const char *name;
+	uint32_t    t_low, t_high, t_su_dat, t_hd_dat, t_su_sta, t_hd_sta, t_su_sto, t_buf;
+} i2c_lim;
+
+static const i2c_lim i2c_lims[] = {
+	{ "standard", 4700, 4000, 250, 0, 4700, 4000, 4000, 4700 },
+	{ "fast",     1300,  600, 100, 0,  600,  600,  600, 1300 },
+};
+
+#define MDIO_T_HIGH   160
+#define MDIO_T_LOW    160
+#define MDIO_T_PERIOD 400
+#define MDIO_T_SU      10
+#define MDIO_T_HD      10
+
+#define NEVER ((uint64_t)-1)
+
+typedef struct dec_ {
+	int            mode;
+	int            quiet;
+	unsigned       clk_bit, dat_bit;
+	unsigned       st;          /* current (clk<<1)|dat      */
+	int            primed;      /* 'st' is valid             */
+	uint64_t       t_cr, t_cf;  /* last clock rise/fall      */
+	uint64_t       t_dc;        /* last data change          */
+	uint64_t       nviol;
+	uint64_t       nxact;
+	/* I2C */
+	const i2c_lim *lim;
+	uint64_t       t_sta, t_sto;
+	int            in_xfer;
+	int            first_byte;
+	int            first_fall;
+	unsigned       nbits;
+	unsigned       byte;
+	int            ack;
+	/* MDIO */
+	unsigned       nones;       /* preamble length           */
+	int            in_frame;
+	unsigned       fbits;       /* frame bits sampled so far */
+	uint32_t       frame;
+	int            sta_bit;     /* last sampled bit driven by the STA */
+} dec;
+
+static void
+ts(uint64_t t)
+{
+	printf("%14.3f us ", (double)t / 1000.0);
+}
+
+static void
+check(dec *d, uint64_t now, const char *what, uint64_t since, uint32_t lim)
+{
+	if ( NEVER == since || now - since >= lim )
+		return;
+	d->nviol++;
+	ts( now );
+	printf("VIOLATION %s: %"PRIu64" ns < %"PRIu32" ns\n", what, now - since, lim);
+}
+
+/* I2C ---------------------------------------------------------------- */
+
+static void
+i2c_byte(dec *d, uint64_t now)
+{
+	if ( d->quiet )
+		return;
+	ts( now );
+	if ( d->first_byte )
+		printf("ADDR 0x%02x %s", d->byte >> 1, (d->byte & 1) ? "RD" : "WR");
+	else
+		printf("DATA 0x%02x", d->byte);
+	printf(" %s\n", d->ack ? "ACK" : "NACK");
+}
+
+static void
+i2c_clk(dec *d, uint64_t now, int rise, int sda)
+{
+	if ( rise ) {
+		if ( d->in_xfer ) {
+			check( d, now, "tLOW",    d->t_cf, d->lim->t_low );
+			if ( d->t_dc != NEVER && (d->t_cf == NEVER || d->t_dc >= d->t_cf) )
+				check( d, now, "tSU;DAT", d->t_dc, d->lim->t_su_dat );
+			if ( d->nbits < 8 ) {
+				d->byte = (d->byte << 1) | sda;
+			} else {
+				d->ack = ! sda;
+			}
+			d->nbits++;
+		}
+		d->t_cr = now;
+	} else {
+		if ( d->in_xfer ) {
+			check( d, now, "tHIGH", d->t_cr, d->lim->t_high );
+			if ( d->first_fall ) {
+				check( d, now, "tHD;STA", d->t_sta, d->lim->t_hd_sta );
+				d->first_fall = 0;
+			} else if ( 9 == d->nbits ) {
+				i2c_byte( d, now );
+				d->first_byte = 0;
+				d->nbits      = 0;
+				d->byte       = 0;
+			}
+		}
+		d->t_cf = now;
+	}
+}
+
+static void
+i2c_dat(dec *d, uint64_t now, int rise, int scl)
+{
+	if ( scl ) {
+		if ( ! rise ) {
+			/* (repeated) START */
+			if ( d->in_xfer ) {
+				check( d, now, "tSU;STA", d->t_cr, d->lim->t_su_sta );
+			} else {
+				check( d, now, "tBUF",    d->t_sto, d->lim->t_buf );
+			}
+			if ( ! d->quiet ) {
+				ts( now );
+				printf("%s\n", d->in_xfer ? "Sr" : "START");
+			}
+			d->in_xfer    = 1;
+			d->first_byte = 1;
+			d->first_fall = 1;
+			d->nbits      = 0;
+			d->byte       = 0;
+			d->t_sta      = now;
+		} else if ( d->in_xfer ) {
+			/* STOP */
+			check( d, now, "tSU;STO", d->t_cr, d->lim->t_su_sto );
+			if ( ! d->quiet ) {
+				ts( now );
+				printf("STOP\n");
+			}
+			d->in_xfer = 0;
+			d->t_sto   = now;
+			d->nxact++;
+		}
+	} else if ( d->in_xfer ) {
+		check( d, now, "tHD;DAT", d->t_cf, d->lim->t_hd_dat );
+	}
+	d->t_dc = now;
+}
+
+/* MDIO --------------------------------------------------------------- */
+
+static const char *c22_ops[] = { "??", "WR", "RD", "??" };
+static const char *c45_ops[] = { "ADDR", "WR", "RDINC", "RD" };
+
+static void
+mdio_frame(dec *d, uint64_t now)
+{
+unsigned st = (d->frame >> 30) & 3;
+unsigned op = (d->frame >> 28) & 3;
+unsigned pa = (d->frame >> 23) & 0x1f;
+unsigned ra = (d->frame >> 18) & 0x1f;
+unsigned ta = (d->frame >> 16) & 3;
+
+	d->nxact++;
+	if ( d->quiet )
+		return;
+	ts( now );
+	if ( 1 == st ) {
+		printf("C22 %s PHY %2u REG %2u", c22_ops[op], pa, ra);
+	} else {
+		printf("C45 %-5s PRT %2u DEV %2u", c45_ops[op], pa, ra);
+	}
+	printf(" DATA 0x%04"PRIx32" (preamble %u)", d->frame & 0xffff, d->nones);
+	if ( (1 == st && 1 == op) || (0 == st && 2 > op) ) {
+		if ( 2 != ta )
+			printf(" [bad TA]");
+	}
+	printf("\n");
+}
+
+/* is the bit at 'idx' (within the 32-bit frame) driven by the STA? */
+static int
+mdio_sta_drives(dec *d, unsigned idx)
+{
+unsigned st = (d->frame >> 30) & 3;
+unsigned op = (d->frame >> 28) & 3;
+	if ( idx < 14 )
+		return 1;
+	/* writes and clause-45 address cycles */
+	return (1 == st && 1 == op) || (0 == st && 2 > op);
+}
+
+static void
+mdio_clk(dec *d, uint64_t now, int rise, int dat)
+{
+	if ( rise ) {
+		check( d, now, "MDC low",    d->t_cf, MDIO_T_LOW    );
+		check( d, now, "MDC period", d->t_cr, MDIO_T_PERIOD );
+		if ( d->t_dc != NEVER && (d->t_cf == NEVER || d->t_dc >= d->t_cf) && (! d->in_frame || mdio_sta_drives( d, d->fbits )) )
+			check( d, now, "MDIO setup", d->t_dc, MDIO_T_SU );
+		if ( d->in_frame ) {
+			d->sta_bit = mdio_sta_drives( d, d->fbits );
+			d->frame   = (d->frame << 1) | dat;
+			if ( 32 == ++d->fbits ) {
+				mdio_frame( d, now );
+				d->in_frame = 0;
+				d->nones    = 0;
+			}
+		} else if ( dat ) {
+			d->nones++;
+			d->sta_bit = 1;
+		} else if ( d->nones || d->nxact ) {
+			/* first bit of ST (back-to-back frames w/o preamble are allowed) */
+			d->in_frame = 1;
+			d->fbits    = 1;
+			d->frame    = 0;
+			d->sta_bit  = 1;
+		}
+		d->t_cr = now;
+	} else {
+		check( d, now, "MDC high", d->t_cr, MDIO_T_HIGH );
+		d->t_cf = now;
+	}
+}
+
+static void
+mdio_dat(dec *d, uint64_t now, int rise, int clk)
+{
+	if ( d->sta_bit )
+		check( d, now, "MDIO hold", d->t_cr, MDIO_T_HD );
+	d->t_dc = now;
+}
+
+/* feed one sample taken at time 'now' (ns) */
+static void
+dec_feed(dec *d, uint64_t now, uint32_t sample)
+{
+unsigned st = ( (!!(sample & (1 << d->clk_bit))) << 1 ) | !!(sample & (1 << d->dat_bit));
+unsigned ev;
+
+	if ( ! d->primed ) {
+		d->st     = st;
+		d->primed = 1;
+		return;
+	}
+	if ( ! (ev = evtab[(d->st << 2) | st]) )
+		return;
+
+	/* simultaneous changes: data before a rising, after a falling clock */
+	if ( MODE_I2C == d->mode ) {
+		if ( (ev & (EV_DR | EV_DF)) && ! (ev & EV_CF) )
+			i2c_dat( d, now, !!(ev & EV_DR), !!(d->st & 2) );
+		if ( (ev & (EV_CR | EV_CF)) )
+			i2c_clk( d, now, !!(ev & EV_CR), st & 1 );
+		if ( (ev & (EV_DR | EV_DF)) && (ev & EV_CF) )
+			i2c_dat( d, now, !!(ev & EV_DR), 0 );
+	} else {
+		if ( (ev & (EV_DR | EV_DF)) && ! (ev & EV_CF) )
+			mdio_dat( d, now, !!(ev & EV_DR), !!(d->st & 2) );
+		if ( (ev & (EV_CR | EV_CF)) )
+			mdio_clk( d, now, !!(ev & EV_CR), st & 1 );
+		if ( (ev & (EV_DR | EV_DF)) && (ev & EV_CF) )
+			mdio_dat( d, now, !!(ev & EV_DR), 0 );
+	}
+	d->st = st;
+}
+
+static void
+dec_init(dec *d, int mode, const i2c_lim *lim, unsigned clk_bit, unsigned dat_bit, int quiet)
+{
+	memset( d, 0, sizeof(*d) );
+	d->mode    = mode;
+	d->lim     = lim;
+	d->clk_bit = clk_bit;
+	d->dat_bit = dat_bit;
+	d->quiet   = quiet;
+	d->t_cr    = d->t_cf = d->t_dc = NEVER;
+	d->t_sta   = d->t_sto = NEVER;
+}
+
+/* input ---------------------------------------------------------------- */
+
+static int
+pin_index(const la_hdr *hdr, const char *s, unsigned *idx_p)
+{
+unsigned p, i, pin;
+	if ( 1 == sscanf(s, "emio%u", &p) ) {
+		pin = GPIO_EMIO( p );
+	} else if ( 1 == sscanf(s, "mio%u", &p) ) {
+		pin = p;
+	} else {
+		return -1;
+	}
+	for ( i = 0; i < hdr->npins && i < LA_MAXPINS; i++ ) {
+		if ( hdr->pins[i] == pin ) {
+			*idx_p = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#define RBUF_RECS 4096
+
+static int
+decode_la(FILE *f, const char *fnam, dec *d, const la_hdr *hdr)
+{
+la_rec  *buf;
+size_t   got, i;
+uint64_t t = 0;
+
+	if ( ! (buf = malloc( RBUF_RECS * sizeof(*buf) )) ) {
+		fprintf(stderr,"No memory\n");
+		return -1;
+	}
+	while ( (got = fread( buf, sizeof(*buf), RBUF_RECS, f )) > 0 ) {
+		for ( i = 0; i < got; i++ ) {
+			dec_feed( d, t, buf[i].val );
+			t += (uint64_t)buf[i].cnt * hdr->period_ns;
+		}
+	}
+	free( buf );
+	if ( ferror( f ) ) {
+		fprintf(stderr,"Error reading '%s'\n", fnam);
+		return -1;
+	}
+	return 0;
+}
+
+/* VCD: only scalar value changes of the two signals matter */
+static int
+vcd_tok(FILE *f, char *buf)
+{
+	return 1 == fscanf(f, "%255s", buf) ? 0 : -1;
+}
+
+static int
+vcd_skip(FILE *f, char *buf)
+{
+	while ( 0 == vcd_tok( f, buf ) ) {
+		if ( 0 == strcmp(buf, "$end") )
+			return 0;
+	}
+	return -1;
+}
+
+static int
+decode_vcd(FILE *f, const char *fnam, dec *d, const char *clk_nm, const char *dat_nm)
+{
+char     tok[256], id[2][256], typ[256], nm[256];
+char     ts[256] = "";
+int      have[2] = { 0, 0 };
+unsigned got = 0, i;
+uint32_t smpl = 0;
+uint64_t ps = 1000, mul, t = 0;
+char    *unit;
+
+	/* header */
+	while ( 0 == vcd_tok( f, tok ) ) {
+		if ( 0 == strcmp(tok, "$enddefinitions") ) {
+			vcd_skip( f, tok );
+			break;
+		} else if ( 0 == strcmp(tok, "$timescale") ) {
+			while ( 0 == vcd_tok( f, tok ) && strcmp(tok, "$end") )
+				strncat( ts, tok, sizeof(ts) - strlen(ts) - 1 );
+			mul = strtoull( ts, &unit, 10 );
+			if      ( 0 == strcmp(unit, "s")  ) ps = mul * 1000000000000ULL;
+			else if ( 0 == strcmp(unit, "ms") ) ps = mul * 1000000000ULL;
+			else if ( 0 == strcmp(unit, "us") ) ps = mul * 1000000ULL;
+			else if ( 0 == strcmp(unit, "ns") ) ps = mul * 1000ULL;
+			else if ( 0 == strcmp(unit, "ps") ) ps = mul;
+			else if ( 0 == strcmp(unit, "fs") && mul >= 1000 ) ps = mul / 1000;
+			else {
+				fprintf(stderr,"Unsupported VCD timescale '%s'\n", ts);
+				return -1;
+			}
+		} else if ( 0 == strcmp(tok, "$var") ) {
+			if ( 3 != fscanf(f, "%255s %*s %255s %255s", typ, tok, nm) ) {
+				fprintf(stderr,"Malformed VCD $var in '%s'\n", fnam);
+				return -1;
+			}
+			for ( i = 0; i < 2; i++ ) {
+				if ( ! have[i] && 0 == strcmp(nm, i ? dat_nm : clk_nm) ) {
+					strcpy( id[i], tok );
+					have[i] = 1;
+				}
+			}
+			vcd_skip( f, tok );
+		} else if ( '$' == tok[0] ) {
+			vcd_skip( f, tok );
+		}
+	}
+	if ( ! have[0] || ! have[1] ) {
+		fprintf(stderr,"Clock/data signal not found in VCD\n");
+		return -1;
+	}
+
+	/* value changes; feed all changes at one time step as one sample */
+	while ( 0 == vcd_tok( f, tok ) ) {
+		if ( '#' == tok[0] ) {
+			if ( 3 == got )
+				dec_feed( d, t, smpl );
+			t = strtoull( tok + 1, 0, 10 ) * ps / 1000;
+		} else if ( 0 == strcmp(tok, "$comment") ) {
+			vcd_skip( f, tok );
+		} else if ( strchr("01xXzZ", tok[0]) ) {
+			for ( i = 0; i < 2; i++ ) {
+				if ( 0 == strcmp(tok + 1, id[i]) ) {
+					if ( '0' == tok[0] )
+						smpl &= ~(1 << i);
+					else
+						smpl |=  (1 << i);
+					got |= (1 << i);
+				}
+			}
+		} else if ( strchr("bBrR", tok[0]) ) {
+			/* vector; skip identifier */
+			vcd_tok( f, tok );
+		}
+	}
+	if ( 3 == got )
+		dec_feed( d, t, smpl );
+	if ( ferror( f ) ) {
+		fprintf(stderr,"Error reading '%s'\n", fnam);
+		return -1;
+	}
+	return 0;
+}
+
+static void
+usage(const char *nm)
+{
+	fprintf(stderr,"Usage: %s [-hq] [-m i2c|mdio] [-s standard|fast] -c clk-pin -d data-pin capture-file\n", nm);
+	fprintf(stderr,"          decode I2C (SCL, SDA) or MDIO (MDC, MDIO) transactions in a gpiola capture\n");
+	fprintf(stderr,"          or VCD file (e.g., a gpiolib trace)\n");
+	fprintf(stderr,"          clk-pin, data-pin: [e]mio<X> (as recorded in the capture), VCD signal names\n");
+	fprintf(stderr,"          -m : protocol (default: i2c)\n");
+	fprintf(stderr,"          -s : I2C mode for timing checks (default: standard)\n");
+	fprintf(stderr,"          -q : print timing violations only\n");
+	fprintf(stderr,"       exit status is 2 if timing violations were found\n");
+}
+
+int
+main(int argc, char **argv)
+{
+int            rval  = 1;
+int            opt;
+int            mode  = MODE_I2C;
+int            quiet = 0;
+const i2c_lim *lim   = &i2c_lims[0];
+const char    *clk_nm = 0, *dat_nm = 0;
+const char    *fnam;
+unsigned       clk_bit, dat_bit, i;
+FILE          *f = 0;
+la_hdr         hdr;
+dec            d;
+
+	while ( (opt = getopt(argc, argv, "hqm:s:c:d:")) > 0 ) {
+		switch ( opt ) {
+			case 'h': rval = 0;
+			default:
+				usage(argv[0]);
+				return rval;
+
+			case 'q': quiet  = 1;      break;
+			case 'c': clk_nm = optarg; break;
+			case 'd': dat_nm = optarg; break;
+
+			case 'm':
+				if ( 0 == strcmp(optarg, "i2c") ) {
+					mode = MODE_I2C;
+				} else if ( 0 == strcmp(optarg, "mdio") ) {
+					mode = MODE_MDIO;
+				} else {
+					fprintf(stderr,"Unknown protocol '%s'\n", optarg);
+					return 1;
+				}
+				break;
+
+			case 's':
+				for ( i = 0; i < sizeof(i2c_lims)/sizeof(i2c_lims[0]); i++ ) {
+					if ( 0 == strcmp(optarg, i2c_lims[i].name) )
+						break;
+				}
+				if ( i == sizeof(i2c_lims)/sizeof(i2c_lims[0]) ) {
+					fprintf(stderr,"Unknown I2C mode '%s'\n", optarg);
+					return 1;
+				}
+				lim = &i2c_lims[i];
+				break;
+		}
+	}
+
+	if ( argc - optind != 1 || ! clk_nm || ! dat_nm ) {
+		usage(argv[0]);
+		return 1;
+	}
+	fnam = argv[optind];
+
+	if ( ! (f = fopen(fnam, "r")) ) {
+		fprintf(stderr,"Unable to open '%s': %s\n", fnam, strerror(errno));
+		return 1;
+	}
+	if ( 1 == fread( &hdr, sizeof(hdr), 1, f ) && 0 == memcmp( hdr.magic, LA_MAGIC, 4 ) ) {
+		if ( LA_VERSION != hdr.version ) {
+			fprintf(stderr,"'%s': unsupported gpiola version %"PRIu32"\n", fnam, hdr.version);
+			goto bail;
+		}
+		if ( pin_index( &hdr, clk_nm, &clk_bit ) || pin_index( &hdr, dat_nm, &dat_bit ) ) {
+			fprintf(stderr,"Clock/data pin not found in capture\n");
+			goto bail;
+		}
+
+		dec_init( &d, mode, lim, clk_bit, dat_bit, quiet );
+
+		if ( decode_la( f, fnam, &d, &hdr ) )
+			goto bail;
+	} else {
+		/* assume VCD */
+		rewind( f );
+		dec_init( &d, mode, lim, 0, 1, quiet );
+
+		if ( decode_vcd( f, fnam, &d, clk_nm, dat_nm ) )
+			goto bail;
+	}
+
+	printf("%"PRIu64" transactions, %"PRIu64" timing violations", d.nxact, d.nviol);
+	if ( MODE_I2C == mode )
+		printf(" (I2C %s-mode)", lim->name);
+	printf("\n");
+
+	rval = d.nviol ? 2 : 0;
+
+bail:
+	if ( f )
+		fclose( f );
+	return rval;
+}
@@ -0,0 +1,470 @@
+/* GPIO logic analyzer and pattern generator
+ *
+ * Samples a set of pins at a fixed rate into a preallocated ring; a
+ * second thread run-length encodes the samples and writes them to a
+ * file (see gpiola.h). The same timing engine replays such a file onto
+ * output pins.
+ *
+ * The sampling loop busy-waits on CLOCK_MONOTONIC; for stable timing run
+ * it on an isolated core (-c, e.g., with 'isolcpus=' on the kernel
+ * command line) -- it is made SCHED_FIFO and its memory is locked.
+ */
+
+#define _GNU_SOURCE
+#include <gpiolib.h>
+#include <gpiola.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+
+#define RING_LD_DFLT 20    /* 1M samples */
+#define CALIB_LOOPS  1000
+#define RT_PRIO_DFLT 80
+#define WBUF_RECS    4096
+
+typedef struct la_ring_ {
+	uint32_t         *buf;
+	uint32_t          msk;
+	volatile uint32_t head;   /* written by sampler only */
+	volatile uint32_t tail;   /* written by writer only  */
+	volatile int      done;
+	FILE             *f;
+	uint64_t          nrecs;
+	int               err;
+} la_ring;
+
+static volatile sig_atomic_t stop = 0;
+
+static void
+on_sig(int sig)
+{
+	stop = 1;
+}
+
+static inline uint64_t
+now_ns(void)
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static inline void
+spin_until(uint64_t t)
+{
+	while ( now_ns() < t )
+		/* busy wait */;
+}
+
+static void
+usage(const char *nm)
+{
+	fprintf(stderr,"Usage: %s [-h] [-b backend] [-c cpu] [-p prio] [-r rate] [-n samples] [-R ld_ring] -o capture-file pin...\n", nm);
+	fprintf(stderr,"       %s [-h] [-b backend] [-c cpu] [-p prio] [-r rate] -P pattern-file pin...\n", nm);
+	fprintf(stderr,"          pin       : mio<X> or emio<X>\n");
+	fprintf(stderr,"          -b backend: gpiolib backend (sysfs, cdev, zynq)\n");
+	fprintf(stderr,"          -c cpu    : run timing loop on 'cpu' (should be isolated)\n");
+	fprintf(stderr,"          -p prio   : SCHED_FIFO priority (default %d)\n", RT_PRIO_DFLT);
+	fprintf(stderr,"          -r rate   : sample rate in Hz (default 100000); for -P the\n");
+	fprintf(stderr,"                      file's rate is used unless -r is given\n");
+	fprintf(stderr,"          -n samples: stop after 'samples' (default: run until SIGINT)\n");
+	fprintf(stderr,"          -R ld_ring: ring holds 1<<ld_ring samples (default %d)\n", RING_LD_DFLT);
+	fprintf(stderr,"          -o file   : capture pins into 'file'\n");
+	fprintf(stderr,"          -P file   : replay 'file' onto (output) pins\n");
+}
+
+static int
+parse_pin(const char *s, uint32_t *pin_p)
+{
+unsigned p;
+	if ( 1 == sscanf(s, "emio%u", &p) ) {
+		*pin_p = GPIO_EMIO( p );
+	} else if ( 1 == sscanf(s, "mio%u", &p) ) {
+		*pin_p = p;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+static void
+rt_setup(int cpu, int prio)
+{
+cpu_set_t          set;
+struct sched_param sp;
+int                err;
+
+	if ( cpu >= 0 ) {
+		CPU_ZERO( &set );
+		CPU_SET( cpu, &set );
+		if ( (err = pthread_setaffinity_np( pthread_self(), sizeof(set), &set )) )
+			fprintf(stderr,"Warning: unable to pin to CPU %d: %s\n", cpu, strerror(err));
+	}
+	sp.sched_priority = prio;
+	if ( (err = pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp )) )
+		fprintf(stderr,"Warning: unable to set SCHED_FIFO: %s\n", strerror(err));
+	if ( mlockall( MCL_CURRENT | MCL_FUTURE ) )
+		fprintf(stderr,"Warning: unable to lock memory: %s\n", strerror(errno));
+}
+
+/* measure the cost of reading the clock + sampling; this is the
+ * minimal period the timing loop can sustain.
+ */
+static uint64_t
+calibrate(gpio_group grp, uint32_t msk, uint32_t val, int out)
+{
+uint64_t t0, t1;
+uint32_t v = 0;
+int      i;
+
+	t0 = now_ns();
+	for ( i = 0; i < CALIB_LOOPS; i++ ) {
+		if ( out )
+			gpio_group_write( grp, msk, val );
+		else
+			gpio_group_read( grp, GPIO_GROUP_ALL, &v );
+		(void)now_ns();
+	}
+	t1 = now_ns();
+	return (t1 - t0) / CALIB_LOOPS;
+}
+
+static int
+emit(la_ring *r, la_rec *wbuf, unsigned *nw_p, uint32_t val, uint32_t cnt)
+{
+	wbuf[*nw_p].val = val;
+	wbuf[*nw_p].cnt = cnt;
+	if ( ++(*nw_p) == WBUF_RECS ) {
+		if ( WBUF_RECS != fwrite( wbuf, sizeof(*wbuf), WBUF_RECS, r->f ) )
+			return -1;
+		*nw_p = 0;
+	}
+	r->nrecs++;
+	return 0;
+}
+
+/* writer thread: run-length encode and store */
+static void *
+writer(void *arg)
+{
+la_ring *r   = arg;
+la_rec  *wbuf;
+unsigned nw  = 0;
+uint32_t cur = 0, cnt = 0, head, v;
+struct timespec slp = { 0, 1000000 };
+
+	if ( ! (wbuf = malloc( WBUF_RECS * sizeof(*wbuf) )) ) {
+		r->err = ENOMEM;
+		return 0;
+	}
+
+	while ( 1 ) {
+		head = __atomic_load_n( &r->head, __ATOMIC_ACQUIRE );
+		if ( head == r->tail ) {
+			if ( r->done && head == __atomic_load_n( &r->head, __ATOMIC_ACQUIRE ) )
+				break;
+			nanosleep( &slp, 0 );
+			continue;
+		}
+		while ( r->tail != head ) {
+			v = r->buf[r->tail & r->msk];
+			if ( cnt && v == cur && cnt < UINT32_MAX ) {
+				cnt++;
+			} else {
+				if ( cnt && emit( r, wbuf, &nw, cur, cnt ) )
+					goto bail;
+				cur = v;
+				cnt = 1;
+			}
+			__atomic_store_n( &r->tail, r->tail + 1, __ATOMIC_RELEASE );
+		}
+	}
+	if ( cnt && emit( r, wbuf, &nw, cur, cnt ) )
+		goto bail;
+	if ( nw && nw != fwrite( wbuf, sizeof(*wbuf), nw, r->f ) )
+		goto bail;
+	free( wbuf );
+	return 0;
+
+bail:
+	r->err = errno ? errno : EIO;
+	free( wbuf );
+	return 0;
+}
+
+static int
+capture(gpio_group grp, la_ring *r, uint32_t period, uint64_t nsamples, uint64_t *late_p, uint64_t *got_p)
+{
+uint64_t t, n;
+uint32_t v;
+
+	t = now_ns() + 1000000;
+	for ( n = 0; (0 == nsamples || n < nsamples) && ! stop && ! r->err; n++ ) {
+		spin_until( t );
+		if ( gpio_group_read( grp, GPIO_GROUP_ALL, &v ) ) {
+			perror("gpio_group_read");
+			return -1;
+		}
+		if ( r->head - __atomic_load_n( &r->tail, __ATOMIC_ACQUIRE ) > r->msk ) {
+			fprintf(stderr,"Ring overflow (writer too slow) after %"PRIu64" samples\n", n);
+			return -1;
+		}
+		r->buf[r->head & r->msk] = v;
+		__atomic_store_n( &r->head, r->head + 1, __ATOMIC_RELEASE );
+		t += period;
+		if ( now_ns() > t )
+			(*late_p)++;
+	}
+	*got_p = n;
+	return 0;
+}
+
+static int
+replay(gpio_group grp, uint32_t msk, la_rec *recs, size_t nrecs, uint32_t period, uint64_t *late_p)
+{
+uint64_t t;
+size_t   i;
+
+	t = now_ns() + 1000000;
+	for ( i = 0; i < nrecs && ! stop; i++ ) {
+		spin_until( t );
+		if ( gpio_group_write( grp, msk, recs[i].val ) ) {
+			perror("gpio_group_write");
+			return -1;
+		}
+		t += (uint64_t)recs[i].cnt * period;
+		if ( now_ns() > t )
+			(*late_p)++;
+	}
+	return 0;
+}
+
+static la_rec *
+load_pattern(const char *fnam, la_hdr *hdr, size_t *nrecs_p)
+{
+FILE   *f;
+la_rec *recs = 0;
+long    len;
+
+	if ( ! (f = fopen(fnam, "r")) ) {
+		fprintf(stderr,"Unable to open '%s': %s\n", fnam, strerror(errno));
+		return 0;
+	}
+	if ( 1 != fread( hdr, sizeof(*hdr), 1, f ) || memcmp( hdr->magic, LA_MAGIC, 4 ) || LA_VERSION != hdr->version ) {
+		fprintf(stderr,"'%s' is not a gpiola file\n", fnam);
+		goto bail;
+	}
+	if ( fseek( f, 0, SEEK_END ) || (len = ftell( f )) < 0 || fseek( f, sizeof(*hdr), SEEK_SET ) ) {
+		perror("Unable to determine file size");
+		goto bail;
+	}
+	*nrecs_p = (len - sizeof(*hdr)) / sizeof(*recs);
+	if ( ! (recs = malloc( *nrecs_p * sizeof(*recs) + 1 )) ) {
+		fprintf(stderr,"No memory\n");
+		goto bail;
+	}
+	if ( *nrecs_p != fread( recs, sizeof(*recs), *nrecs_p, f ) ) {
+		fprintf(stderr,"Unable to read '%s'\n", fnam);
+		free( recs );
+		recs = 0;
+	}
+bail:
+	fclose( f );
+	return recs;
+}
+
+int
+main(int argc, char **argv)
+{
+int         rval    = 1;
+int         opt;
+int        *i_p;
+int         cpu     = -1;
+int         prio    = RT_PRIO_DFLT;
+int         rate    = 0;
+int         ld_ring = RING_LD_DFLT;
+long long   ll;
+uint64_t    nsamples = 0;
+uint64_t    late = 0, got = 0;
+uint64_t    minper;
+const char *ofnam   = 0;
+const char *pfnam   = 0;
+la_hdr      hdr;
+la_ring     ring;
+la_rec     *recs    = 0;
+size_t      nrecs   = 0;
+uint32_t    period;
+unsigned    i, npins;
+gpio_group  grp     = 0;
+pthread_t   wthr;
+int         have_wthr = 0;
+struct sigaction sa;
+
+	memset( &ring, 0, sizeof(ring) );
+
+	while ( (opt = getopt(argc, argv, "hb:c:p:r:n:R:o:P:")) > 0 ) {
+		i_p = 0;
+		switch ( opt ) {
+			case 'h': rval = 0;
+			default:
+				usage(argv[0]);
+				return rval;
+
+			case 'b':
+				if ( gpio_select_backend( optarg ) )
+					return 1;
+				break;
+
+			case 'c': i_p = &cpu;     break;
+			case 'p': i_p = &prio;    break;
+			case 'r': i_p = &rate;    break;
+			case 'R': i_p = &ld_ring; break;
+			case 'o': ofnam = optarg; break;
+			case 'P': pfnam = optarg; break;
+
+			case 'n':
+				if ( 1 != sscanf(optarg, "%lli", &ll) || ll < 0 ) {
+					fprintf(stderr,"Invalid -n arg\n");
+					return 1;
+				}
+				nsamples = (uint64_t)ll;
+				break;
+		}
+		if ( i_p && 1 != sscanf(optarg, "%i", i_p) ) {
+			fprintf(stderr,"Unable to parse integer arg to option '%c'\n", opt);
+			return 1;
+		}
+	}
+
+	if ( ! ofnam == ! pfnam ) {
+		fprintf(stderr,"Need exactly one of -o or -P\n");
+		return 1;
+	}
+
+	memset( &hdr, 0, sizeof(hdr) );
+	if ( pfnam && ! (recs = load_pattern( pfnam, &hdr, &nrecs )) )
+		return 1;
+
+	npins = argc - optind;
+	if ( npins < 1 || npins > LA_MAXPINS || (pfnam && npins != hdr.npins) ) {
+		fprintf(stderr,"Need 1..%d pins (must match the pattern file's %d pins for -P)\n", LA_MAXPINS, hdr.npins);
+		goto bail;
+	}
+	for ( i = 0; i < npins; i++ ) {
+		if ( parse_pin( argv[optind + i], &hdr.pins[i] ) ) {
+			fprintf(stderr,"Invalid pin '%s' (need [e]mio<X>)\n", argv[optind + i]);
+			goto bail;
+		}
+	}
+
+	if ( rate <= 0 )
+		rate = pfnam ? 0 : 100000;
+	if ( rate > 0 )
+		hdr.period_ns = 1000000000ULL / rate;
+	period = hdr.period_ns;
+	if ( 0 == period ) {
+		fprintf(stderr,"Invalid rate\n");
+		goto bail;
+	}
+
+	if ( ld_ring < 10 || ld_ring > 28 ) {
+		fprintf(stderr,"Invalid ring size (-R 10..28)\n");
+		goto bail;
+	}
+
+	if ( ! (grp = gpio_group_open( hdr.pins, npins )) )
+		goto bail;
+
+	if ( pfnam && gpio_group_dir( grp, (uint32_t)((1ULL << npins) - 1), (uint32_t)((1ULL << npins) - 1) ) ) {
+		perror("gpio_group_dir");
+		goto bail;
+	}
+
+	sa.sa_handler = on_sig;
+	sa.sa_flags   = 0;
+	sigemptyset( &sa.sa_mask );
+	sigaction( SIGINT,  &sa, 0 );
+	sigaction( SIGTERM, &sa, 0 );
+
+	if ( ofnam ) {
+		ring.msk = (1 << ld_ring) - 1;
+		if ( ! (ring.buf = malloc( (ring.msk + 1) * sizeof(*ring.buf) )) ) {
+			fprintf(stderr,"No memory for ring\n");
+			goto bail;
+		}
+		/* prefault */
+		memset( ring.buf, 0, (ring.msk + 1) * sizeof(*ring.buf) );
+		if ( ! (ring.f = fopen( ofnam, "w" )) ) {
+			fprintf(stderr,"Unable to create '%s': %s\n", ofnam, strerror(errno));
+			goto bail;
+		}
+		memcpy( hdr.magic, LA_MAGIC, 4 );
+		hdr.version = LA_VERSION;
+		hdr.npins   = npins;
+		if ( 1 != fwrite( &hdr, sizeof(hdr), 1, ring.f ) ) {
+			perror("Writing header");
+			goto bail;
+		}
+		/* writer inherits default scheduling -- create before going RT */
+		if ( (errno = pthread_create( &wthr, 0, writer, &ring )) ) {
+			perror("Unable to create writer thread");
+			goto bail;
+		}
+		have_wthr = 1;
+	}
+
+	rt_setup( cpu, prio );
+
+	/* replay: calibrating drives the pattern's initial value */
+	minper = calibrate( grp, (uint32_t)((1ULL << npins) - 1), nrecs ? recs[0].val : 0, !!pfnam );
+	fprintf(stderr,"Period %"PRIu32" ns; loop overhead %"PRIu64" ns\n", period, minper);
+	if ( minper > period ) {
+		fprintf(stderr,"Rate too high; minimal period is %"PRIu64" ns\n", minper);
+		goto bail;
+	}
+
+	if ( ofnam ) {
+		if ( capture( grp, &ring, period, nsamples, &late, &got ) )
+			goto bail;
+	} else {
+		if ( replay( grp, (uint32_t)((1ULL << npins) - 1), recs, nrecs, period, &late ) )
+			goto bail;
+	}
+
+	rval = 0;
+
+bail:
+	if ( have_wthr ) {
+		ring.done = 1;
+		pthread_join( wthr, 0 );
+		if ( ring.err ) {
+			fprintf(stderr,"Writing capture failed: %s\n", strerror(ring.err));
+			rval = 1;
+		}
+	}
+	if ( ring.f && fclose( ring.f ) ) {
+		perror("Closing capture file");
+		rval = 1;
+	}
+	if ( 0 == rval ) {
+		if ( ofnam )
+			fprintf(stderr,"%"PRIu64" samples, %"PRIu64" records", got, ring.nrecs);
+		else
+			fprintf(stderr,"%zu records replayed", nrecs);
+		fprintf(stderr,", %"PRIu64" late\n", late);
+	}
+	if ( grp )
+		gpio_group_close( grp );
+	free( ring.buf );
+	free( recs );
+	return rval;
+}
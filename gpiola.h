@@ -0,0 +1,32 @@
+#ifndef GPIOLA_H
+#define GPIOLA_H
+
+/* File format of gpiola captures/patterns (host byte order):
+ *
+ *   header    (la_hdr)
+ *   records   (la_rec) until EOF
+ *
+ * Each record holds the sampled (bit i <-> pins[i]) 'val' for 'cnt'
+ * consecutive sample periods (run-length encoding).
+ */
+
+#include <stdint.h>
+
+#define LA_MAGIC   "GPLA"
+#define LA_VERSION 1
+#define LA_MAXPINS 32
+
+typedef struct la_hdr_ {
+	char     magic[4];
+	uint32_t version;
+	uint32_t period_ns;
+	uint32_t npins;
+	uint32_t pins[LA_MAXPINS]; /* controller-relative (see GPIO_EMIO()) */
+} la_hdr;
+
+typedef struct la_rec_ {
+	uint32_t val;
+	uint32_t cnt;
+} la_rec;
+
+#endif
@@ -0,0 +1,416 @@
+/* gpiolib backend using the GPIO character device (v2 uAPI) */
+
+#define _GNU_SOURCE
+#include <gpiolib-impl.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/fcntl.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <linux/gpio.h>
+
+#define DEV_DIR  "/dev/"
+#define CONSUMER "gpiolib"
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+
+/* A line request; a single pin is just a group with one line */
+typedef struct cdev_impl_ {
+	struct h_impl_ hdr;
+	int            req_fd;
+	int            edge;   /* edge detection currently configured */
+} *cdev_impl;
+
+typedef struct cdev_grp_ {
+	struct g_impl_ hdr;
+	int            req_fd;
+	/* SET_CONFIG must restate the direction and value of every line */
+	uint64_t       outmsk;
+	uint64_t       outval;
+} *cdev_grp;
+
+static int      chip_fd = -1;
+static unsigned nlines  = 0;
+
+static int
+find_chip(void)
+{
+DIR                 *dir;
+struct dirent       *dentp;
+struct gpiochip_info info;
+char                 buf[256];
+int                  fd;
+const char          *lbl = gpio_chip_label();
+
+	if ( chip_fd >= 0 )
+		return 0;
+
+	if ( ! (dir = opendir( DEV_DIR )) ) {
+		fprintf(stderr,"gpiolib: error reading '%s'\n", DEV_DIR);
+		return -1;
+	}
+
+	while ( (dentp = readdir( dir )) ) {
+		if ( strncmp("gpiochip", dentp->d_name, 8) )
+			continue;
+		if ( snprintf(buf, sizeof(buf), "%s%s", DEV_DIR, dentp->d_name) >= sizeof(buf) )
+			continue;
+		if ( (fd = open(buf, O_RDWR | O_CLOEXEC)) < 0 ) {
+			fprintf(stderr,"gpiolib: WARNING: unable to open '%s' (%s)\n", buf, strerror(errno));
+			continue;
+		}
+		if ( ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) ) {
+			fprintf(stderr,"gpiolib: WARNING: GPIO_GET_CHIPINFO on '%s' failed (%s)\n", buf, strerror(errno));
+			close( fd );
+			continue;
+		}
+		if ( 0 == strncmp(info.label, lbl, sizeof(info.label)) ) {
+			chip_fd = fd;
+			nlines  = info.lines;
+			break;
+		}
+		close( fd );
+	}
+
+	closedir( dir );
+
+	if ( chip_fd < 0 ) {
+		fprintf(stderr,"gpiolib: no gpiochip labeled '%s' found\n", lbl);
+		return -1;
+	}
+	return 0;
+}
+
+/* request 'n' lines as-is (direction unchanged); returns fd or -1 */
+static int
+line_request(const unsigned pins[], unsigned n)
+{
+struct gpio_v2_line_request req;
+unsigned                    i;
+
+	if ( find_chip() )
+		return -1;
+
+	memset( &req, 0, sizeof(req) );
+	for ( i = 0; i < n; i++ ) {
+		if ( pins[i] >= nlines ) {
+			fprintf(stderr,"gpiolib: invalid pin # %d (max: %d)\n", pins[i], nlines - 1);
+			return -1;
+		}
+		req.offsets[i] = pins[i];
+	}
+	req.num_lines = n;
+	strncpy( req.consumer, CONSUMER, sizeof(req.consumer) - 1 );
+
+	if ( ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) ) {
+		fprintf(stderr,"gpiolib: unable to request line(s) (%s)\n", strerror(errno));
+		return -1;
+	}
+	return req.fd;
+}
+
+static int
+set_values(int fd, uint64_t msk, uint64_t val)
+{
+struct gpio_v2_line_values v;
+	v.mask = msk;
+	v.bits = val;
+	gpio_nsys++;
+	return ioctl(fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &v) ? -1 : 0;
+}
+
+static int
+get_values(int fd, uint64_t msk, uint64_t *val_p)
+{
+struct gpio_v2_line_values v;
+	v.mask = msk;
+	v.bits = 0;
+	gpio_nsys++;
+	if ( ioctl(fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &v) )
+		return -1;
+	*val_p = v.bits;
+	return 0;
+}
+
+/* lines in 'outmsk' become outputs (driving 'outval'), all others inputs */
+static int
+set_dirs(int fd, uint64_t outmsk, uint64_t outval, unsigned n)
+{
+struct gpio_v2_line_config cfg;
+uint64_t                   all = (n < 64 ? ((uint64_t)1 << n) : 0) - 1;
+
+	memset( &cfg, 0, sizeof(cfg) );
+	if ( outmsk == all ) {
+		cfg.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+	} else {
+		cfg.flags = GPIO_V2_LINE_FLAG_INPUT;
+		if ( outmsk ) {
+			cfg.attrs[cfg.num_attrs].attr.id    = GPIO_V2_LINE_ATTR_ID_FLAGS;
+			cfg.attrs[cfg.num_attrs].attr.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+			cfg.attrs[cfg.num_attrs].mask       = outmsk;
+			cfg.num_attrs++;
+		}
+	}
+	if ( outmsk ) {
+		cfg.attrs[cfg.num_attrs].attr.id     = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		cfg.attrs[cfg.num_attrs].attr.values = outval;
+		cfg.attrs[cfg.num_attrs].mask        = outmsk;
+		cfg.num_attrs++;
+	}
+	gpio_nsys++;
+	return ioctl(fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &cfg) ? -1 : 0;
+}
+
+static h_impl
+cdev_open(unsigned pin)
+{
+cdev_impl rval;
+int       fd;
+
+	if ( (fd = line_request( &pin, 1 )) < 0 )
+		return 0;
+
+	if ( ! (rval = malloc(sizeof(*rval))) ) {
+		fprintf(stderr,"gpiolib: no memory\n");
+		close( fd );
+		return 0;
+	}
+	rval->hdr.be  = &gpio_backend_cdev;
+	rval->hdr.pin = pin;
+	rval->req_fd  = fd;
+	rval->edge    = 0;
+	return &rval->hdr;
+}
+
+static void
+cdev_close(h_impl p)
+{
+cdev_impl h = (cdev_impl)p;
+	close( h->req_fd );
+	free( h );
+}
+
+static int
+cdev_put(h_impl p, int val)
+{
+cdev_impl h = (cdev_impl)p;
+	return set_values( h->req_fd, 1, !!val );
+}
+
+static int
+cdev_dir(h_impl p, int out)
+{
+cdev_impl h = (cdev_impl)p;
+	/* also clears edge detection */
+	h->edge = 0;
+	return set_dirs( h->req_fd, !!out, 0, 1 );
+}
+
+static int
+cdev_get(h_impl p)
+{
+cdev_impl h = (cdev_impl)p;
+uint64_t  v;
+	if ( get_values( h->req_fd, 1, &v ) )
+		return -1;
+	return (int)(v & 1);
+}
+
+/* next queued edge event; returns 1, 0 if there is none before 'tmo'
+ * expires (zero: don't block), -1 on error
+ */
+static int
+cdev_read_event(cdev_impl h, const struct timespec *tmo, uint64_t *ts_p)
+{
+struct gpio_v2_line_event  ev;
+struct pollfd              pfd;
+int                        got;
+
+	pfd.fd     = h->req_fd;
+	pfd.events = POLLIN;
+	gpio_nsys++;
+	if ( (got = ppoll( &pfd, 1, tmo, 0 )) <= 0 )
+		return got;
+	gpio_nsys++;
+	if ( sizeof(ev) != read(h->req_fd, &ev, sizeof(ev)) )
+		return -1;
+	if ( ts_p )
+		*ts_p = ev.timestamp_ns;
+	return 1;
+}
+
+static int
+cdev_wait_edge(h_impl p, int edge, const struct timespec *tmo, uint64_t *ts_p)
+{
+static const struct timespec nowait = { 0, 0 };
+cdev_impl                  h = (cdev_impl)p;
+struct gpio_v2_line_config cfg;
+int                        got;
+uint64_t                   v;
+
+	if ( h->edge != edge ) {
+		memset( &cfg, 0, sizeof(cfg) );
+		cfg.flags = GPIO_V2_LINE_FLAG_INPUT;
+		if ( (edge & GPIO_EDGE_RISING) )
+			cfg.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+		if ( (edge & GPIO_EDGE_FALLING) )
+			cfg.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+		gpio_nsys++;
+		if ( ioctl(h->req_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &cfg) )
+			return -1;
+		h->edge = edge;
+		/* the edge may have happened before we armed */
+		if ( get_values( h->req_fd, 1, &v ) )
+			return -1;
+		/* ... or since; then it is queued: consume and report that one
+		 * (with the kernel's timestamp) lest the next call reports it
+		 * again
+		 */
+		if ( (got = cdev_read_event( h, &nowait, ts_p )) )
+			return got;
+		if ( gpio_edge_done( edge, (int)(v & 1) ) ) {
+			if ( ts_p )
+				*ts_p = gpio_ts_now();
+			return 1;
+		}
+	}
+	return cdev_read_event( h, tmo, ts_p );
+}
+
+/* find lines that are currently outputs */
+static int
+get_outputs(const unsigned pins[], unsigned n, uint64_t *outmsk_p)
+{
+struct gpio_v2_line_info info;
+unsigned                 i;
+uint64_t                 m = 0;
+
+	for ( i = 0; i < n; i++ ) {
+		memset( &info, 0, sizeof(info) );
+		info.offset = pins[i];
+		if ( ioctl(chip_fd, GPIO_V2_GET_LINEINFO_IOCTL, &info) ) {
+			fprintf(stderr,"gpiolib: unable to get line info (%s)\n", strerror(errno));
+			return -1;
+		}
+		if ( (info.flags & GPIO_V2_LINE_FLAG_OUTPUT) )
+			m |= ((uint64_t)1 << i);
+	}
+	*outmsk_p = m;
+	return 0;
+}
+
+static g_impl
+cdev_group_open(const unsigned pins[], unsigned n)
+{
+cdev_grp rval;
+int      fd;
+uint64_t outmsk, outval = 0;
+
+	if ( (fd = line_request( pins, n )) < 0 )
+		return 0;
+
+	if ( get_outputs( pins, n, &outmsk ) || ( outmsk && get_values( fd, outmsk, &outval ) ) ) {
+		close( fd );
+		return 0;
+	}
+
+	if ( ! (rval = malloc(sizeof(*rval))) ) {
+		fprintf(stderr,"gpiolib: no memory\n");
+		close( fd );
+		return 0;
+	}
+	rval->hdr.be  = &gpio_backend_cdev;
+	rval->hdr.n   = n;
+	rval->req_fd  = fd;
+	rval->outmsk  = outmsk;
+	rval->outval  = outval & outmsk;
+	return &rval->hdr;
+}
+
+static void
+cdev_group_close(g_impl p)
+{
+cdev_grp g = (cdev_grp)p;
+	close( g->req_fd );
+	free( g );
+}
+
+static int
+cdev_group_write(g_impl p, uint32_t msk, uint32_t val)
+{
+cdev_grp g = (cdev_grp)p;
+	if ( set_values( g->req_fd, msk, val ) )
+		return -1;
+	g->outval = (g->outval & ~(uint64_t)msk) | (val & msk);
+	return 0;
+}
+
+static int
+cdev_group_read(g_impl p, uint32_t msk, uint32_t *val_p)
+{
+cdev_grp g = (cdev_grp)p;
+uint64_t v;
+	msk &= ((uint64_t)1 << g->hdr.n) - 1;
+	if ( get_values( g->req_fd, msk, &v ) )
+		return -1;
+	*val_p = (uint32_t)v & msk;
+	return 0;
+}
+
+static int
+cdev_group_dir(g_impl p, uint32_t msk, uint32_t out)
+{
+cdev_grp g = (cdev_grp)p;
+uint64_t m = (g->outmsk & ~(uint64_t)msk) | (out & msk);
+uint64_t v = g->outval & ~(uint64_t)(out & msk);
+
+	if ( set_dirs( g->req_fd, m, v, g->hdr.n ) )
+		return -1;
+	g->outmsk = m;
+	g->outval = v & m;
+	return 0;
+}
+
+const gpio_backend gpio_backend_cdev = {
+	name:        "cdev",
+	open:        cdev_open,
+	close:       cdev_close,
+	put:         cdev_put,
+	dir:         cdev_dir,
+	get:         cdev_get,
+	wait_edge:   cdev_wait_edge,
+	group_open:  cdev_group_open,
+	group_close: cdev_group_close,
+	group_write: cdev_group_write,
+	group_read:  cdev_group_read,
+	group_dir:   cdev_group_dir,
+};
+
+#else /* GPIO_V2_GET_LINE_IOCTL */
+
+/* kernel headers too old for the v2 uAPI */
+static h_impl
+cdev_open(unsigned pin)
+{
+	fprintf(stderr,"gpiolib: 'cdev' backend not supported (built against kernel headers w/o GPIO v2 uAPI)\n");
+	errno = ENOSYS;
+	return 0;
+}
+
+static g_impl
+cdev_group_open(const unsigned pins[], unsigned n)
+{
+	return (g_impl) cdev_open( pins[0] );
+}
+
+const gpio_backend gpio_backend_cdev = {
+	name:        "cdev",
+	open:        cdev_open,
+	group_open:  cdev_group_open,
+};
+
+#endif /* GPIO_V2_GET_LINE_IOCTL */
@@ -0,0 +1,93 @@
+#ifndef GPIOLIB_IMPL_H
+#define GPIOLIB_IMPL_H
+
+/* gpiolib internals; shared by the backends -- not for applications */
+
+#include <gpiolib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define EMIO_OFFSET 54
+#define ZYNQ_GPIO   "zynq_gpio"
+
+typedef struct h_impl_ *h_impl;
+typedef struct g_impl_ *g_impl;
+
+/* 'pin' arguments are controller-relative (EMIO_OFFSET already applied).
+ * Backends which leave open_many or group_xxx NULL get a generic
+ * implementation that loops over per-pin handles.
+ */
+typedef struct gpio_backend_ {
+	const char *name;
+	h_impl    (*open)       (unsigned pin);
+	int       (*open_many)  (const unsigned pins[], unsigned n, h_impl h[]);
+	void      (*close)      (h_impl h);
+	int       (*put)        (h_impl h, int val);
+	int       (*dir)        (h_impl h, int out);
+	int       (*get)        (h_impl h);
+	int       (*wait_edge)  (h_impl h, int edge, const struct timespec *tmo, uint64_t *ts_p);
+	g_impl    (*group_open) (const unsigned pins[], unsigned n);
+	void      (*group_close)(g_impl g);
+	int       (*group_write)(g_impl g, uint32_t msk, uint32_t val);
+	int       (*group_read) (g_impl g, uint32_t msk, uint32_t *val_p);
+	int       (*group_dir)  (g_impl g, uint32_t msk, uint32_t out);
+} gpio_backend;
+
+/* every backend's handle starts with this header */
+struct h_impl_ {
+	const gpio_backend *be;
+	unsigned            pin;
+};
+
+struct g_impl_ {
+	const gpio_backend *be;
+	unsigned            n;
+	uint8_t             pin[GPIO_GROUP_MAX]; /* filled in by gpio_group_open() */
+};
+
+extern const gpio_backend gpio_backend_sysfs;
+extern const gpio_backend gpio_backend_cdev;
+extern const gpio_backend gpio_backend_zynq;
+extern const gpio_backend gpio_backend_sim;
+
+/* number of syscalls issued by pin/group operations (see gpio_syscalls()) */
+extern uint64_t gpio_nsys;
+
+/* CLOCK_MONOTONIC in ns */
+uint64_t
+gpio_ts_now(void);
+
+/* pin at 'lvl' is where a single 'edge' (not BOTH) leads to */
+static inline int
+gpio_edge_done(int edge, int lvl)
+{
+	return ( GPIO_EDGE_RISING == edge && lvl ) || ( GPIO_EDGE_FALLING == edge && ! lvl );
+}
+
+/* queued mode (gpiolib-uring.c); gpio_q_write() stores a pointer to 'buf'! */
+int
+gpio_q_active(void);
+
+int
+gpio_q_write(int fd, const char *buf, unsigned len);
+
+/* edge trace (gpiolib-trace.c); record the new output latch/direction
+ * of 'pin' (only if gpio_t_on)
+ */
+extern int gpio_t_on;
+
+void
+gpio_t_put(unsigned pin, int val, uint64_t now);
+
+void
+gpio_t_dir(unsigned pin, int out, uint64_t now);
+
+/* start tracing if GPIOLIB_TRACE is set (once) */
+void
+gpio_t_env(void);
+
+/* label of the controller we are looking for */
+const char *
+gpio_chip_label(void);
+
+#endif
@@ -0,0 +1,96 @@
+/* gpiolib backend simulating a controller without hardware (e.g., to
+ * trace bit-bang timing on a host): outputs read back what they drive,
+ * inputs read 1 (as if pulled up). Pin state is shared by all handles.
+ */
+
+#include <gpiolib-impl.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#define NUM_PINS 118
+
+typedef struct sim_impl_ {
+	struct h_impl_ hdr;
+} *sim_impl;
+
+static uint8_t sim_out[NUM_PINS];
+static uint8_t sim_val[NUM_PINS];
+
+static h_impl
+sim_open(unsigned pin)
+{
+sim_impl rval;
+
+	if ( pin >= NUM_PINS ) {
+		fprintf(stderr,"gpiolib: invalid pin # %d (max: %d)\n", pin, NUM_PINS - 1);
+		return 0;
+	}
+	if ( ! (rval = malloc(sizeof(*rval))) ) {
+		fprintf(stderr,"gpiolib: no memory\n");
+		return 0;
+	}
+	rval->hdr.be  = &gpio_backend_sim;
+	rval->hdr.pin = pin;
+	return &rval->hdr;
+}
+
+static void
+sim_close(h_impl p)
+{
+	free( p );
+}
+
+static int
+sim_put(h_impl p, int val)
+{
+	sim_val[p->pin] = !!val;
+	return 0;
+}
+
+static int
+sim_dir(h_impl p, int out)
+{
+	/* drive low, like sysfs does */
+	if ( (sim_out[p->pin] = !!out) )
+		sim_val[p->pin] = 0;
+	return 0;
+}
+
+static int
+sim_get(h_impl p)
+{
+	return sim_out[p->pin] ? sim_val[p->pin] : 1;
+}
+
+/* Nothing ever changes an input; a pin at the level the edge leads to
+ * (released input: high) reports it at once (see gpio_wait_edge()).
+ */
+static int
+sim_wait_edge(h_impl p, int edge, const struct timespec *tmo, uint64_t *ts_p)
+{
+struct timespec rem;
+	if ( gpio_edge_done( edge, sim_get( p ) ) ) {
+		if ( ts_p )
+			*ts_p = gpio_ts_now();
+		return 1;
+	}
+	if ( ! tmo ) {
+		errno = EDEADLK;
+		return -1;
+	}
+	rem = *tmo;
+	while ( nanosleep( &rem, &rem ) && EINTR == errno )
+		;
+	return 0;
+}
+
+const gpio_backend gpio_backend_sim = {
+	name:      "sim",
+	open:      sim_open,
+	close:     sim_close,
+	put:       sim_put,
+	dir:       sim_dir,
+	get:       sim_get,
+	wait_edge: sim_wait_edge,
+};
@@ -0,0 +1,235 @@
+/* Edge trace: every change of a pin's level caused by gpiolib calls
+ * is timestamped into a buffer which is written as a VCD file when
+ * tracing stops (explicitly or at exit).
+ *
+ * The level of a pin is derived from what we drive: '0'/'1' for an
+ * output and 'z' for an input (externally pulled up in the open-drain
+ * use cases we care about); 'x' until the direction is known.
+ * What other devices drive is not recorded.
+ *
+ * Recording is serialized (threads may drive different pins, e.g., one
+ * bit-bang bus each); entries stay in time order.
+ */
+
+#include <gpiolib-impl.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define TRACE_DEPTH_DFLT (1<<20)
+#define NUM_PINS         (2*EMIO_OFFSET + 10)
+
+typedef struct t_ent_ {
+	uint64_t ts;
+	uint8_t  pin;
+	char     lvl;
+} t_ent;
+
+int gpio_t_on = 0;
+
+static struct {
+	char     *path;
+	t_ent    *ents;
+	unsigned  depth, n;
+	unsigned long lost;
+	uint64_t  t0;
+	int       atexit_done;
+	/* per-pin state */
+	char      out[NUM_PINS];  /* direction: 1 = out, 0 = in, -1 = unknown */
+	char      drv[NUM_PINS];  /* output latch                              */
+	char      lvl[NUM_PINS];  /* last level recorded                       */
+	char      seen[NUM_PINS];
+} t;
+
+static char t_lock;
+
+static void
+t_lck(void)
+{
+	while ( __atomic_test_and_set( &t_lock, __ATOMIC_ACQUIRE ) )
+		;
+}
+
+static void
+t_unl(void)
+{
+	__atomic_clear( &t_lock, __ATOMIC_RELEASE );
+}
+
+static void
+trace_atexit(void)
+{
+	gpio_trace_stop();
+}
+
+int
+gpio_trace_start(const char *vcd_path, unsigned depth)
+{
+	if ( gpio_t_on ) {
+		errno = EBUSY;
+		return -1;
+	}
+	if ( ! depth )
+		depth = TRACE_DEPTH_DFLT;
+	if ( ! (t.path = strdup( vcd_path )) || ! (t.ents = malloc( depth * sizeof(*t.ents) )) ) {
+		free( t.path );
+		t.path = 0;
+		fprintf(stderr,"gpiolib: no memory for trace buffer\n");
+		return -1;
+	}
+	t.depth = depth;
+	t.n     = 0;
+	t.lost  = 0;
+	memset( t.out,  -1,  sizeof(t.out)  );
+	memset( t.drv,  0,   sizeof(t.drv)  );
+	memset( t.lvl,  'x', sizeof(t.lvl)  );
+	memset( t.seen, 0,   sizeof(t.seen) );
+	if ( ! t.atexit_done ) {
+		atexit( trace_atexit );
+		t.atexit_done = 1;
+	}
+	t.t0      = gpio_ts_now();
+	gpio_t_on = 1;
+	return 0;
+}
+
+void
+gpio_t_env(void)
+{
+static int  done = 0;
+const char *nm;
+	if ( done )
+		return;
+	done = 1;
+	if ( (nm = getenv("GPIOLIB_TRACE")) && *nm )
+		gpio_trace_start( nm, 0 );
+}
+
+static void
+rec(unsigned pin, uint64_t now)
+{
+char lvl;
+	if ( pin >= NUM_PINS )
+		return;
+	if ( t.out[pin] < 0 )
+		lvl = 'x';
+	else if ( t.out[pin] )
+		lvl = t.drv[pin] ? '1' : '0';
+	else
+		lvl = 'z';
+	t.seen[pin] = 1;
+	if ( lvl == t.lvl[pin] )
+		return;
+	if ( t.n >= t.depth ) {
+		t.lost++;
+		return;
+	}
+	now              -= t.t0;
+	/* another thread may have recorded a later timestamp meanwhile */
+	if ( t.n && now < t.ents[t.n - 1].ts )
+		now = t.ents[t.n - 1].ts;
+	t.lvl[pin]        = lvl;
+	t.ents[t.n].ts    = now;
+	t.ents[t.n].pin   = pin;
+	t.ents[t.n].lvl   = lvl;
+	t.n++;
+}
+
+void
+gpio_t_put(unsigned pin, int val, uint64_t now)
+{
+	if ( pin < NUM_PINS ) {
+		t_lck();
+		t.drv[pin] = !!val;
+		rec( pin, now );
+		t_unl();
+	}
+}
+
+void
+gpio_t_dir(unsigned pin, int out, uint64_t now)
+{
+	if ( pin < NUM_PINS ) {
+		t_lck();
+		/* outputs start driving low */
+		if ( (t.out[pin] = !!out) )
+			t.drv[pin] = 0;
+		rec( pin, now );
+		t_unl();
+	}
+}
+
+/* VCD identifiers are strings of printable characters '!'..'~' */
+static const char *
+vcd_id(unsigned pin)
+{
+static char id[3];
+	id[0] = '!' + pin % 94;
+	id[1] = pin >= 94 ? '!' + pin / 94 : 0;
+	id[2] = 0;
+	return id;
+}
+
+static int
+vcd_write(FILE *f)
+{
+unsigned i;
+uint64_t ts = (uint64_t)-1;
+
+	fprintf(f, "$version gpiolib edge trace $end\n");
+	fprintf(f, "$timescale 1ns $end\n");
+	fprintf(f, "$scope module gpio $end\n");
+	for ( i = 0; i < NUM_PINS; i++ ) {
+		if ( ! t.seen[i] )
+			continue;
+		if ( i >= EMIO_OFFSET )
+			fprintf(f, "$var wire 1 %s emio%u $end\n", vcd_id( i ), i - EMIO_OFFSET);
+		else
+			fprintf(f, "$var wire 1 %s mio%u $end\n",  vcd_id( i ), i);
+	}
+	fprintf(f, "$upscope $end\n");
+	fprintf(f, "$enddefinitions $end\n");
+	fprintf(f, "#0\n$dumpvars\n");
+	for ( i = 0; i < NUM_PINS; i++ ) {
+		if ( t.seen[i] )
+			fprintf(f, "x%s\n", vcd_id( i ));
+	}
+	fprintf(f, "$end\n");
+	for ( i = 0; i < t.n; i++ ) {
+		if ( t.ents[i].ts != ts ) {
+			ts = t.ents[i].ts;
+			fprintf(f, "#%llu\n", (unsigned long long)ts);
+		}
+		fprintf(f, "%c%s\n", t.ents[i].lvl, vcd_id( t.ents[i].pin ));
+	}
+	return ferror( f ) ? -1 : 0;
+}
+
+int
+gpio_trace_stop(void)
+{
+FILE *f;
+int   rval = -1;
+
+	if ( ! gpio_t_on )
+		return 0;
+	gpio_t_on = 0;
+
+	if ( t.lost )
+		fprintf(stderr,"gpiolib: WARNING: trace buffer full; %lu edges lost (at end of trace)\n", t.lost);
+	if ( ! (f = fopen( t.path, "w" )) ) {
+		fprintf(stderr,"gpiolib: unable to create trace file '%s': %s\n", t.path, strerror(errno));
+	} else {
+		rval = vcd_write( f );
+		if ( fclose( f ) )
+			rval = -1;
+		if ( rval )
+			fprintf(stderr,"gpiolib: error writing trace file '%s'\n", t.path);
+	}
+	free( t.ents );
+	free( t.path );
+	t.ents = 0;
+	t.path = 0;
+	return rval;
+}
@@ -0,0 +1,291 @@
+/* Queued mode for the sysfs backend: pin operations are collected and
+ * submitted as one io_uring batch of linked SQEs (preserving order).
+ *
+ * Uses raw syscalls (no liburing); if io_uring is not available (old
+ * kernel or headers) the queue is drained with sequential pwrite()s.
+ */
+
+#include <gpiolib-impl.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+#endif
+
+typedef struct q_ent_ {
+	int          fd;
+	struct iovec iov;
+} q_ent;
+
+static struct {
+	int                  active;
+	unsigned             depth, n;
+	q_ent               *ents;
+	int                  ring_fd;
+#ifdef HAVE_IO_URING
+	void                *sq_ptr, *cq_ptr;
+	size_t               sq_sz, cq_sz, sqes_sz;
+	unsigned            *sq_tail, *sq_mask, *sq_array;
+	unsigned            *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+#endif
+} q = { ring_fd: -1 };
+
+#ifdef HAVE_IO_URING
+static void
+ring_exit(void)
+{
+	if ( q.sqes )
+		munmap( q.sqes, q.sqes_sz );
+	if ( q.cq_ptr && q.cq_ptr != q.sq_ptr )
+		munmap( q.cq_ptr, q.cq_sz );
+	if ( q.sq_ptr )
+		munmap( q.sq_ptr, q.sq_sz );
+	if ( q.ring_fd >= 0 )
+		close( q.ring_fd );
+	q.sqes    = 0;
+	q.sq_ptr  = q.cq_ptr = 0;
+	q.ring_fd = -1;
+}
+
+static int
+ring_init(unsigned depth)
+{
+struct io_uring_params p;
+char                  *sq, *cq;
+
+	memset( &p, 0, sizeof(p) );
+	if ( (q.ring_fd = syscall( __NR_io_uring_setup, depth, &p )) < 0 )
+		return -1;
+
+	q.sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	q.cq_sz = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ( (p.features & IORING_FEAT_SINGLE_MMAP) && q.cq_sz > q.sq_sz )
+		q.sq_sz = q.cq_sz;
+
+	q.sq_ptr = mmap( 0, q.sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q.ring_fd, IORING_OFF_SQ_RING );
+	if ( MAP_FAILED == q.sq_ptr ) {
+		q.sq_ptr = 0;
+		goto bail;
+	}
+	if ( (p.features & IORING_FEAT_SINGLE_MMAP) ) {
+		q.cq_ptr = q.sq_ptr;
+	} else {
+		q.cq_ptr = mmap( 0, q.cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q.ring_fd, IORING_OFF_CQ_RING );
+		if ( MAP_FAILED == q.cq_ptr ) {
+			q.cq_ptr = 0;
+			goto bail;
+		}
+	}
+	q.sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	q.sqes    = mmap( 0, q.sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q.ring_fd, IORING_OFF_SQES );
+	if ( MAP_FAILED == q.sqes ) {
+		q.sqes = 0;
+		goto bail;
+	}
+
+	sq         = q.sq_ptr;
+	cq         = q.cq_ptr;
+	q.sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+	q.sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+	q.sq_array = (unsigned*)(sq + p.sq_off.array);
+	q.cq_head  = (unsigned*)(cq + p.cq_off.head);
+	q.cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+	q.cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+	q.cqes     = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return 0;
+
+bail:
+	ring_exit();
+	return -1;
+}
+
+/* After a short submit or a failed io_uring_enter the rings are out of
+ * step with q.ents: SQEs the kernel has not consumed yet, or CQEs not
+ * reaped, refer to entries which are about to be reused. Start over
+ * with a fresh ring (pwrite if that fails).
+ */
+static void
+ring_reset(void)
+{
+	ring_exit();
+	if ( ring_init( q.depth ) )
+		fprintf(stderr,"gpiolib: WARNING: io_uring re-init failed (%s); queue falls back to pwrite\n", strerror(errno));
+}
+
+/* submit all queued entries as one chain and reap the completions;
+ * returns 0 or -1 with errno of the first failing operation.
+ */
+static int
+ring_submit(void)
+{
+unsigned             i, tail, head, idx;
+struct io_uring_sqe *sqe;
+struct io_uring_cqe *cqe;
+int                  err = 0;
+unsigned             err_at = q.n;
+int                  got;
+
+	tail = *q.sq_tail;
+	for ( i = 0; i < q.n; i++ ) {
+		idx = (tail + i) & *q.sq_mask;
+		sqe = &q.sqes[idx];
+		memset( sqe, 0, sizeof(*sqe) );
+		sqe->opcode    = IORING_OP_WRITEV;
+		sqe->fd        = q.ents[i].fd;
+		sqe->addr      = (uintptr_t)&q.ents[i].iov;
+		sqe->len       = 1;
+		sqe->off       = 0;
+		sqe->flags     = i < q.n - 1 ? IOSQE_IO_LINK : 0;
+		sqe->user_data = i;
+		q.sq_array[idx] = idx;
+	}
+	__atomic_store_n( q.sq_tail, tail + q.n, __ATOMIC_RELEASE );
+
+	do {
+		gpio_nsys++;
+		got = syscall( __NR_io_uring_enter, q.ring_fd, q.n, q.n, IORING_ENTER_GETEVENTS, 0, 0 );
+	} while ( got < 0 && EINTR == errno );
+	if ( got < 0 ) {
+		err = errno;
+		goto reset;
+	}
+
+	/* 'got' SQEs consumed; wait for their completions (there may be fewer
+	 * than q.n if the kernel bailed out early).
+	 */
+	for ( i = 0; i < (unsigned)got; i++ ) {
+		head = *q.cq_head;
+		while ( head == __atomic_load_n( q.cq_tail, __ATOMIC_ACQUIRE ) ) {
+			gpio_nsys++;
+			if ( syscall( __NR_io_uring_enter, q.ring_fd, 0, 1, IORING_ENTER_GETEVENTS, 0, 0 ) < 0 && EINTR != errno ) {
+				err = errno;
+				goto reset;
+			}
+		}
+		cqe = &q.cqes[head & *q.cq_mask];
+		/* remember the earliest real failure (the rest are ECANCELED) */
+		if ( cqe->res < 0 && cqe->user_data < err_at && -ECANCELED != cqe->res ) {
+			err    = -cqe->res;
+			err_at = cqe->user_data;
+		} else if ( cqe->res >= 0 && cqe->res != q.ents[cqe->user_data].iov.iov_len && cqe->user_data < err_at ) {
+			err    = EIO;
+			err_at = cqe->user_data;
+		}
+		__atomic_store_n( q.cq_head, head + 1, __ATOMIC_RELEASE );
+	}
+	if ( (unsigned)got < q.n ) {
+		/* the operations not consumed fail */
+		if ( ! err )
+			err = ECANCELED;
+		goto reset;
+	}
+	if ( err ) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+
+reset:
+	ring_reset();
+	errno = err;
+	return -1;
+}
+#endif /* HAVE_IO_URING */
+
+int
+gpio_queue_start(unsigned depth)
+{
+	if ( q.active ) {
+		errno = EBUSY;
+		return -1;
+	}
+	if ( depth < 1 ) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ( ! (q.ents = malloc( depth * sizeof(*q.ents) )) ) {
+		fprintf(stderr,"gpiolib: no memory\n");
+		return -1;
+	}
+	q.depth = depth;
+	q.n     = 0;
+#ifdef HAVE_IO_URING
+	if ( ring_init( depth ) )
+		fprintf(stderr,"gpiolib: WARNING: io_uring unavailable (%s); queue falls back to pwrite\n", strerror(errno));
+#endif
+	q.active = 1;
+	return 0;
+}
+
+int
+gpio_flush(void)
+{
+unsigned i;
+int      rval = 0;
+
+	if ( ! q.active || 0 == q.n )
+		return 0;
+
+#ifdef HAVE_IO_URING
+	if ( q.ring_fd >= 0 ) {
+		rval = ring_submit();
+		q.n  = 0;
+		return rval;
+	}
+#endif
+	for ( i = 0; i < q.n; i++ ) {
+		gpio_nsys++;
+		if ( pwrite( q.ents[i].fd, q.ents[i].iov.iov_base, q.ents[i].iov.iov_len, 0 ) < 0 ) {
+			rval = -1;
+			break;
+		}
+	}
+	q.n = 0;
+	return rval;
+}
+
+int
+gpio_queue_stop(void)
+{
+int rval;
+	if ( ! q.active )
+		return 0;
+	rval = gpio_flush();
+#ifdef HAVE_IO_URING
+	ring_exit();
+#endif
+	free( q.ents );
+	q.ents   = 0;
+	q.active = 0;
+	return rval;
+}
+
+int
+gpio_q_active(void)
+{
+	return q.active;
+}
+
+int
+gpio_q_write(int fd, const char *buf, unsigned len)
+{
+	if ( q.n >= q.depth && gpio_flush() )
+		return -1;
+	q.ents[q.n].fd           = fd;
+	q.ents[q.n].iov.iov_base = (void*)buf;
+	q.ents[q.n].iov.iov_len  = len;
+	q.n++;
+	return 0;
+}
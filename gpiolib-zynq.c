@@ -0,0 +1,403 @@
+/* gpiolib backend accessing the Zynq PS GPIO controller registers directly
+ * (no syscalls once the register window is mapped).
+ *
+ * Outputs are set/cleared atomically via the MASK_DATA_x_LSW/MSW registers;
+ * DIRM/OEN are updated read-modify-write under a per-bank lock (which
+ * serializes the threads of this process; other processes changing the
+ * direction of pins in the same bank may still interfere!).
+ */
+
+#include <gpiolib-impl.h>
+#include <arm-mmio.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define ZYNQ_GPIO_DEV  "/dev/mem"
+#define ZYNQ_GPIO_ADDR 0xE000A000
+#define ZYNQ_GPIO_LEN  0x1000
+
+#define NUM_PINS       118
+
+/* register numbers (not byte offsets) */
+#define REG_MASK_DATA_LSW(bank) (0x000 + 2*(bank))
+#define REG_MASK_DATA_MSW(bank) (0x001 + 2*(bank))
+#define REG_DATA(bank)          (0x010 +   (bank))
+#define REG_DATA_RO(bank)       (0x018 +   (bank))
+#define REG_DIRM(bank)          (0x081 + 0x10*(bank))
+#define REG_OEN(bank)           (0x082 + 0x10*(bank))
+
+/* MASK_DATA: upper half masks (1 = leave alone), lower half holds data */
+#define MASK_DATA(msk, val) GPIO_ZYNQ_MASK_DATA(msk, val)
+
+typedef struct zynq_impl_ {
+	struct h_impl_ hdr;
+	unsigned       bank;
+	uint32_t       bit;    /* bit in DATA/DIRM/OEN          */
+	unsigned       mdreg;  /* MASK_DATA_LSW/MSW register #  */
+	uint32_t       mdclr;  /* MASK_DATA value to clear pin  */
+	uint32_t       mdset;  /* MASK_DATA value to set pin    */
+} *zynq_impl;
+
+typedef struct zynq_grp_ {
+	struct g_impl_ hdr;
+	/* per-pin location */
+	uint8_t        bank[GPIO_GROUP_MAX];
+	uint8_t        bitn[GPIO_GROUP_MAX];
+	/* group pins in each bank */
+	uint32_t       bmsk[4];
+} *zynq_grp;
+
+static Arm_MMIO mio = 0;
+
+/* per-bank DIRM/OEN lock (see gpio_zynq_lock()) */
+static char     bank_lock[4];
+
+static void
+lock_bank(unsigned bank)
+{
+	while ( __atomic_test_and_set( &bank_lock[bank], __ATOMIC_ACQUIRE ) )
+		;
+}
+
+static void
+unlock_bank(unsigned bank)
+{
+	__atomic_clear( &bank_lock[bank], __ATOMIC_RELEASE );
+}
+
+int
+gpio_zynq_map(const char *devnam, unsigned long offset)
+{
+Arm_MMIO m;
+	if ( ! (m = arm_mmio_init_2( devnam, ZYNQ_GPIO_LEN, offset )) ) {
+		fprintf(stderr,"gpiolib: unable to map GPIO registers ('%s' @0x%lx)\n", devnam, offset);
+		return -1;
+	}
+	if ( mio )
+		arm_mmio_exit( mio );
+	mio = m;
+	return 0;
+}
+
+static int
+zynq_map_dflt(void)
+{
+const char   *dev;
+const char   *off;
+unsigned long a = ZYNQ_GPIO_ADDR;
+
+	if ( mio )
+		return 0;
+
+	if ( ! (dev = getenv("GPIOLIB_ZYNQ_DEV")) || ! *dev )
+		dev = ZYNQ_GPIO_DEV;
+	if ( (off = getenv("GPIOLIB_ZYNQ_OFF")) && 1 != sscanf(off, "%li", &a) ) {
+		fprintf(stderr,"gpiolib: unable to parse GPIOLIB_ZYNQ_OFF\n");
+		return -1;
+	}
+	return gpio_zynq_map( dev, a );
+}
+
+static int
+pin2bank(unsigned pin, unsigned *bit_p)
+{
+	if ( pin < 32 ) {
+		*bit_p = pin;
+		return 0;
+	}
+	if ( pin < EMIO_OFFSET ) {
+		*bit_p = pin - 32;
+		return 1;
+	}
+	if ( pin < EMIO_OFFSET + 32 ) {
+		*bit_p = pin - EMIO_OFFSET;
+		return 2;
+	}
+	*bit_p = pin - EMIO_OFFSET - 32;
+	return 3;
+}
+
+static h_impl
+zynq_open(unsigned pin)
+{
+zynq_impl rval;
+unsigned  b;
+
+	if ( pin >= NUM_PINS ) {
+		fprintf(stderr,"gpiolib: invalid pin # %d (max: %d)\n", pin, NUM_PINS - 1);
+		return 0;
+	}
+
+	if ( zynq_map_dflt() )
+		return 0;
+
+	if ( ! (rval = malloc(sizeof(*rval))) ) {
+		fprintf(stderr,"gpiolib: no memory\n");
+		return 0;
+	}
+
+	rval->hdr.be  = &gpio_backend_zynq;
+	rval->hdr.pin = pin;
+	rval->bank    = pin2bank( pin, &b );
+	rval->bit     = (1u << b);
+	rval->mdreg   = b < 16 ? REG_MASK_DATA_LSW( rval->bank ) : REG_MASK_DATA_MSW( rval->bank );
+	rval->mdclr   = MASK_DATA( 1 << (b & 15), 0 );
+	rval->mdset   = MASK_DATA( 1 << (b & 15), 1 << (b & 15) );
+	return &rval->hdr;
+}
+
+static void
+zynq_close(h_impl p)
+{
+	free( p );
+}
+
+static int
+zynq_put(h_impl p, int val)
+{
+zynq_impl h = (zynq_impl)p;
+	iowrite32( mio, h->mdreg, val ? h->mdset : h->mdclr );
+	return 0;
+}
+
+static int
+zynq_dir(h_impl p, int out)
+{
+zynq_impl h = (zynq_impl)p;
+	if ( out ) {
+		/* drive low, like sysfs does */
+		iowrite32( mio, h->mdreg, h->mdclr );
+		lock_bank( h->bank );
+		iowrite32( mio, REG_DIRM( h->bank ), ioread32( mio, REG_DIRM( h->bank ) ) | h->bit );
+		iowrite32( mio, REG_OEN ( h->bank ), ioread32( mio, REG_OEN ( h->bank ) ) | h->bit );
+	} else {
+		lock_bank( h->bank );
+		iowrite32( mio, REG_OEN ( h->bank ), ioread32( mio, REG_OEN ( h->bank ) ) & ~h->bit );
+		iowrite32( mio, REG_DIRM( h->bank ), ioread32( mio, REG_DIRM( h->bank ) ) & ~h->bit );
+	}
+	unlock_bank( h->bank );
+	return 0;
+}
+
+static int
+zynq_get(h_impl p)
+{
+zynq_impl h = (zynq_impl)p;
+	return !! ( ioread32( mio, REG_DATA_RO( h->bank ) ) & h->bit );
+}
+
+/* no interrupts in user-space; busy-poll DATA_RO */
+static int
+zynq_wait_edge(h_impl p, int edge, const struct timespec *tmo, uint64_t *ts_p)
+{
+zynq_impl h = (zynq_impl)p;
+uint64_t  now;
+uint64_t  end = UINT64_MAX;
+uint32_t  prv, cur;
+
+	if ( tmo )
+		end = gpio_ts_now() + (uint64_t)tmo->tv_sec * 1000000000ULL + tmo->tv_nsec;
+
+	prv = ioread32( mio, REG_DATA_RO( h->bank ) ) & h->bit;
+	/* armed by every call: the edge may have happened before */
+	if ( gpio_edge_done( edge, !!prv ) ) {
+		if ( ts_p )
+			*ts_p = gpio_ts_now();
+		return 1;
+	}
+	do {
+		cur = ioread32( mio, REG_DATA_RO( h->bank ) ) & h->bit;
+		now = gpio_ts_now();
+		if ( cur != prv ) {
+			if ( ( cur && (edge & GPIO_EDGE_RISING) ) || ( !cur && (edge & GPIO_EDGE_FALLING) ) ) {
+				if ( ts_p )
+					*ts_p = now;
+				return 1;
+			}
+			prv = cur;
+		}
+	} while ( now < end );
+	return 0;
+}
+
+static g_impl
+zynq_group_open(const unsigned pins[], unsigned n)
+{
+zynq_grp rval;
+unsigned i, b;
+
+	for ( i = 0; i < n; i++ ) {
+		if ( pins[i] >= NUM_PINS ) {
+			fprintf(stderr,"gpiolib: invalid pin # %d (max: %d)\n", pins[i], NUM_PINS - 1);
+			return 0;
+		}
+	}
+
+	if ( zynq_map_dflt() )
+		return 0;
+
+	if ( ! (rval = calloc(1, sizeof(*rval))) ) {
+		fprintf(stderr,"gpiolib: no memory\n");
+		return 0;
+	}
+	rval->hdr.be = &gpio_backend_zynq;
+	rval->hdr.n  = n;
+	for ( i = 0; i < n; i++ ) {
+		rval->bank[i] = pin2bank( pins[i], &b );
+		rval->bitn[i] = b;
+		rval->bmsk[rval->bank[i]] |= (1u << b);
+	}
+	return &rval->hdr;
+}
+
+static void
+zynq_group_close(g_impl p)
+{
+	free( p );
+}
+
+/* one MASK_DATA write per affected half-bank */
+static int
+zynq_group_write(g_impl p, uint32_t msk, uint32_t val)
+{
+zynq_grp g = (zynq_grp)p;
+uint32_t m[4] = { 0 };
+uint32_t v[4] = { 0 };
+unsigned i;
+
+	for ( i = 0; i < g->hdr.n; i++ ) {
+		if ( (msk & (1u << i)) ) {
+			m[g->bank[i]] |= (1u << g->bitn[i]);
+			if ( (val & (1u << i)) )
+				v[g->bank[i]] |= (1u << g->bitn[i]);
+		}
+	}
+	for ( i = 0; i < 4; i++ ) {
+		if ( (m[i] & 0xffff) )
+			iowrite32( mio, REG_MASK_DATA_LSW(i), MASK_DATA( m[i],       v[i]       ) );
+		if ( (m[i] >> 16) )
+			iowrite32( mio, REG_MASK_DATA_MSW(i), MASK_DATA( m[i] >> 16, v[i] >> 16 ) );
+	}
+	return 0;
+}
+
+/* one DATA_RO read per affected bank */
+static int
+zynq_group_read(g_impl p, uint32_t msk, uint32_t *val_p)
+{
+zynq_grp g = (zynq_grp)p;
+uint32_t d[4];
+uint32_t v = 0;
+unsigned i;
+
+	for ( i = 0; i < 4; i++ ) {
+		if ( g->bmsk[i] )
+			d[i] = ioread32( mio, REG_DATA_RO(i) );
+	}
+	for ( i = 0; i < g->hdr.n; i++ ) {
+		if ( (d[g->bank[i]] & (1u << g->bitn[i])) )
+			v |= (1u << i);
+	}
+	*val_p = v & msk;
+	return 0;
+}
+
+/* one DIRM and OEN update per affected bank */
+static int
+zynq_group_dir(g_impl p, uint32_t msk, uint32_t out)
+{
+zynq_grp g = (zynq_grp)p;
+uint32_t m[4] = { 0 };
+uint32_t o[4] = { 0 };
+unsigned i;
+
+	for ( i = 0; i < g->hdr.n; i++ ) {
+		if ( (msk & (1u << i)) ) {
+			m[g->bank[i]] |= (1u << g->bitn[i]);
+			if ( (out & (1u << i)) )
+				o[g->bank[i]] |= (1u << g->bitn[i]);
+		}
+	}
+	for ( i = 0; i < 4; i++ ) {
+		if ( ! m[i] )
+			continue;
+		/* new outputs drive low, like sysfs does */
+		if ( (o[i] & 0xffff) )
+			iowrite32( mio, REG_MASK_DATA_LSW(i), MASK_DATA( o[i],       0 ) );
+		if ( (o[i] >> 16) )
+			iowrite32( mio, REG_MASK_DATA_MSW(i), MASK_DATA( o[i] >> 16, 0 ) );
+		lock_bank( i );
+		if ( o[i] != m[i] )
+			iowrite32( mio, REG_OEN ( i ), ioread32( mio, REG_OEN ( i ) ) & ~(m[i] & ~o[i]) );
+		iowrite32( mio, REG_DIRM( i ), (ioread32( mio, REG_DIRM( i ) ) & ~m[i]) | o[i] );
+		if ( o[i] )
+			iowrite32( mio, REG_OEN ( i ), ioread32( mio, REG_OEN ( i ) ) | o[i] );
+		unlock_bank( i );
+	}
+	return 0;
+}
+
+static void
+fill_regs(gpio_zynq_pin *r, unsigned bank, unsigned b)
+{
+	r->md_reg   = mio->bar + ( b < 16 ? REG_MASK_DATA_LSW( bank ) : REG_MASK_DATA_MSW( bank ) );
+	r->md_bit   = 1 << (b & 15);
+	r->ro_reg   = mio->bar + REG_DATA_RO( bank );
+	r->dirm_reg = mio->bar + REG_DIRM( bank );
+	r->oen_reg  = mio->bar + REG_OEN( bank );
+	r->bit      = 1u << b;
+	r->lock     = &bank_lock[bank];
+}
+
+int
+gpio_zynq_regs(gpio_handle p, gpio_zynq_pin *r)
+{
+zynq_impl h = (zynq_impl)p;
+unsigned  b;
+	if ( gpio_t_on ) {
+		errno = EBUSY;
+		return -1;
+	}
+	if ( &gpio_backend_zynq != h->hdr.be ) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	pin2bank( h->hdr.pin, &b );
+	fill_regs( r, h->bank, b );
+	return 0;
+}
+
+int
+gpio_group_zynq_regs(gpio_group p, gpio_zynq_pin r[])
+{
+zynq_grp g = (zynq_grp)p;
+unsigned i;
+	if ( gpio_t_on ) {
+		errno = EBUSY;
+		return -1;
+	}
+	if ( &gpio_backend_zynq != g->hdr.be ) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	for ( i = 0; i < g->hdr.n; i++ )
+		fill_regs( &r[i], g->bank[i], g->bitn[i] );
+	return 0;
+}
+
+const gpio_backend gpio_backend_zynq = {
+	name:        "zynq",
+	open:        zynq_open,
+	close:       zynq_close,
+	put:         zynq_put,
+	dir:         zynq_dir,
+	get:         zynq_get,
+	wait_edge:   zynq_wait_edge,
+	group_open:  zynq_group_open,
+	group_close: zynq_group_close,
+	group_write: zynq_group_write,
+	group_read:  zynq_group_read,
+	group_dir:   zynq_group_dir,
+};
@@ -1,4 +1,5 @@
-#include <gpiolib.h>
+#define _GNU_SOURCE
+#include <gpiolib-impl.h>
 #include <stdio.h>
 #include <dirent.h>
 #include <errno.h>
@@ -7,18 +8,38 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <poll.h>
+#include <time.h>
 
-#define EMIO_OFFSET 54
-#define ZYNQ_GPIO   "zynq_gpio"
 #define CLASS_GPIO  "/sys/class/gpio/"
+#define BOOT_ID     "/proc/sys/kernel/random/boot_id"
 
-typedef struct h_impl_ {
+typedef struct sysfs_impl_ {
+	struct h_impl_ hdr;
 	int val_fd, dir_fd;
-} *h_impl;
+	int edge_fd, edge;   /* 'edge' file opened on demand */
+} *sysfs_impl;
+
+typedef struct generic_grp_ {
+	struct g_impl_ hdr;
+	h_impl         pins[GPIO_GROUP_MAX];
+	/* level last written to each pin (if 'known'); unchanged pins are
+	 * skipped, i.e., only edges cost a syscall
+	 */
+	uint32_t       lvl;
+	uint32_t       known;
+} *generic_grp;
+
+static const gpio_backend *backend = 0;
 
 static int base  = -1;
 static int ngpio = 0;
 
+uint64_t gpio_nsys = 0;
+
+static const char *cache_path = 0;
+static int         cache_init = 0;
+
 static int
 fillb(char *buf, size_t bufsz, const char *fmt, ...)
 {
@@ -71,184 +92,725 @@ int b, n;
 	return 0;
 }
 
-gpio_handle
-gpio_open(unsigned pin, int is_emio)
+uint64_t
+gpio_ts_now(void)
 {
-DIR           *dir;
-struct dirent dent, *dentp;
-int           st;
-char          buf[256];
-h_impl        rval = 0;
-int           fd   = -1;
-int           got,min;
-int           val_fd = -1;
-int           dir_fd = -1;
-int           retry;
-FILE         *f = 0;
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
 
+const char *
+gpio_chip_label(void)
+{
+const char *l = getenv("GPIOLIB_LABEL");
+	return l && *l ? l : ZYNQ_GPIO;
+}
 
-	if ( pin >= EMIO_OFFSET ) {
-		fprintf(stderr,"gpiolib: Invalid pin number (must be < %d)\n", EMIO_OFFSET);
-		return 0;
+int
+gpio_use_cache(const char *path)
+{
+	cache_path = path;
+	cache_init = 1;
+	return 0;
+}
+
+static const char *
+get_cache_path(void)
+{
+	if ( ! cache_init ) {
+		cache_path = getenv("GPIOLIB_CACHE");
+		cache_init = 1;
 	}
-	if ( ! (dir = opendir( CLASS_GPIO )) ) {
-		fprintf(stderr,"gpiolib: error reading '%s'\n", CLASS_GPIO);
-		return 0;
+	return cache_path && *cache_path ? cache_path : 0;
+}
+
+/* read a (small) file into a NUL-terminated buffer */
+static int
+read_file(const char *path, char *buf, size_t bufsz)
+{
+int fd, got;
+	if ( (fd = open(path, O_RDONLY)) < 0 )
+		return -1;
+	got = read(fd, buf, bufsz - 1);
+	close(fd);
+	if ( got < 0 )
+		return -1;
+	buf[got] = 0;
+	return got;
+}
+
+/* cache holds a single line: "<boot_id> <label> <base> <ngpio>" */
+static int
+cache_load(void)
+{
+const char *path = get_cache_path();
+char        bid[64], buf[256], cbid[64], lbl[64];
+int         b, n;
+
+	if ( ! path || read_file(BOOT_ID, bid, sizeof(bid)) <= 0 )
+		return -1;
+	bid[strcspn(bid, "\n")] = 0;
+	if ( read_file(path, buf, sizeof(buf)) <= 0 )
+		return -1;
+	if ( 4 != sscanf(buf, "%63s %63s %d %d", cbid, lbl, &b, &n) )
+		return -1;
+	if ( strcmp(cbid, bid) || strcmp(lbl, gpio_chip_label()) || b < 0 || n <= 0 )
+		return -1;
+	base  = b;
+	ngpio = n;
+	return 0;
+}
+
+/* write to a temp. file and rename so concurrent readers never see a partial line */
+static void
+cache_store(void)
+{
+const char *path = get_cache_path();
+char        bid[64], buf[256], tmp[256];
+int         fd, len;
+
+	if ( ! path || read_file(BOOT_ID, bid, sizeof(bid)) <= 0 )
+		return;
+	bid[strcspn(bid, "\n")] = 0;
+	if ( fillb(tmp, sizeof(tmp), "%s.XXXXXX", path) )
+		return;
+	if ( (fd = mkstemp(tmp)) < 0 ) {
+		fprintf(stderr,"gpiolib: WARNING: unable to create cache file '%s' (%s)\n", tmp, strerror(errno));
+		return;
+	}
+	len = snprintf(buf, sizeof(buf), "%s %s %d %d\n", bid, gpio_chip_label(), base, ngpio);
+	if ( len >= sizeof(buf) || len != write(fd, buf, len) ) {
+		fprintf(stderr,"gpiolib: WARNING: unable to write cache file '%s'\n", tmp);
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	close(fd);
+	if ( rename(tmp, path) ) {
+		fprintf(stderr,"gpiolib: WARNING: unable to rename cache file '%s' (%s)\n", tmp, strerror(errno));
+		unlink(tmp);
 	}
+}
 
-	if ( is_emio )
-		pin += EMIO_OFFSET;
+/* find the controller's base and ngpio (once) */
+static int
+sysfs_find_chip(void)
+{
+DIR           *dir;
+struct dirent *dentp;
+char           buf[256];
+char           lbl[256];
+int            got,min;
+int            rval = -1;
 
+	if ( base >= 0 || 0 == cache_load() )
+		return 0;
 
-	while ( base < 0 ) {
+	if ( ! (dir = opendir( CLASS_GPIO )) ) {
+		fprintf(stderr,"gpiolib: error reading '%s'\n", CLASS_GPIO);
+		return -1;
+	}
 
-		if ( readdir_r( dir, &dent, &dentp ) ) {
-			fprintf(stderr,"gpiolib: readdir_r failed: %s\n", strerror(errno));
-			goto bail;
-		}
+	while ( 1 ) {
 
-		if ( !dentp ) {
-			printf("DIR END\n");
-			goto bail; /* end reached */
+		errno = 0;
+		if ( ! (dentp = readdir( dir )) ) {
+			if ( errno )
+				fprintf(stderr,"gpiolib: readdir failed: %s\n", strerror(errno));
+			else
+				fprintf(stderr,"gpiolib: no gpiochip labeled '%s' found\n", gpio_chip_label());
+			break;
 		}
 
-		if ( (got = strncmp("gpiochip", dent.d_name, 8)) ) {
+		if ( strncmp("gpiochip", dentp->d_name, 8) ) {
 			continue;
 		}
 
-		if ( fillb(buf, sizeof(buf), "%s%s/label", CLASS_GPIO, dent.d_name) ) {
-			goto bail;
+		if ( fillb(buf, sizeof(buf), "%s%s/label", CLASS_GPIO, dentp->d_name) ) {
+			break;
 		}
-		fd = open(buf, O_RDONLY);
-		if ( fd < 0 ) {
-			fprintf(stderr,"gpiolib: WARNING: unable to open '%s' (%s)\n", buf, strerror(errno));
-			continue;
-		}
-		got = read(fd, buf, sizeof(buf) - 1);
-		close(fd); fd = -1;
-
-		if ( got < 0 ) {
+		if ( (got = read_file(buf, lbl, sizeof(lbl))) < 0 ) {
 			fprintf(stderr,"gpiolib: WARNING: unable to read 'label' (%s)\n", strerror(errno));
 			continue;
 		}
-		buf[got] = 0;
-		min = strlen(ZYNQ_GPIO);
-		if ( sizeof(buf) < min )
-			min = sizeof(buf);
-		if ( 0 == strncmp(buf, ZYNQ_GPIO, min) ) {
+		min = strlen(gpio_chip_label());
+		if ( sizeof(lbl) < min )
+			min = sizeof(lbl);
+		if ( 0 == strncmp(lbl, gpio_chip_label(), min) ) {
 			/* Found it */
-			if ( (get_base( dent.d_name, &base, &ngpio)) < 0 )
-				goto bail;
+			if ( 0 == (rval = get_base( dentp->d_name, &base, &ngpio)) )
+				cache_store();
+			break;
 		}
 	}
 
-	if ( pin >= ngpio ) {
-		fprintf(stderr,"gpiolib: invalid pin # %d (max: %d)\n", pin, ngpio - 1);
-		goto bail;
+	closedir( dir );
+	return rval;
+}
+
+static int
+sysfs_export(int *exp_fd_p, unsigned pin)
+{
+char buf[32];
+int  len;
+	if ( *exp_fd_p < 0 && (*exp_fd_p = open(CLASS_GPIO "export", O_WRONLY)) < 0 ) {
+		fprintf(stderr,"gpiolib: unable to open '%sexport' (%s)\n", CLASS_GPIO, strerror(errno));
+		return -1;
 	}
+	len = snprintf(buf, sizeof(buf), "%d", base + pin);
+	if ( len != write(*exp_fd_p, buf, len) ) {
+		fprintf(stderr,"gpiolib: unable to export pin %d (%s)\n", pin, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int
+sysfs_open_file(unsigned pin, const char *nm)
+{
+char buf[256];
+	if ( fillb(buf, sizeof(buf), "%sgpio%d/%s", CLASS_GPIO, base + pin, nm) )
+		return -1;
+	return open(buf, O_RDWR);
+}
 
-	retry = 0;
+/* Open 'n' pins with a single chip lookup; pins that are already
+ * exported are reused, all others are exported in one go.
+ */
+static int
+sysfs_open_many(const unsigned pins[], unsigned n, h_impl h[])
+{
+sysfs_impl    p;
+int           exp_fd = -1;
+unsigned      i;
+int           retry;
+
+	if ( sysfs_find_chip() )
+		return -1;
 
-	do {
-		if ( fillb(buf, sizeof(buf), "%sgpio%d/value", CLASS_GPIO, base + pin) )
+	for ( i = 0; i < n; i++ ) {
+		h[i] = 0;
+		if ( pins[i] >= ngpio ) {
+			fprintf(stderr,"gpiolib: invalid pin # %d (max: %d)\n", pins[i], ngpio - 1);
+			return -1;
+		}
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		if ( ! (p = calloc(1, sizeof(*p))) ) {
+			fprintf(stderr,"gpiolib: no memory\n");
 			goto bail;
+		}
+		p->hdr.be  = &gpio_backend_sysfs;
+		p->hdr.pin = pins[i];
+		p->dir_fd  = -1;
+		p->edge_fd = -1;
+		h[i]       = &p->hdr;
+		if ( (p->val_fd = sysfs_open_file( pins[i], "value" )) < 0 ) {
+			if ( ENOENT != errno || sysfs_export( &exp_fd, pins[i] ) ) {
+				fprintf(stderr,"gpiolib: unable to open 'value' file for pin %d: %s\n", pins[i], strerror(errno));
+				goto bail;
+			}
+		}
+	}
 
-		val_fd = open(buf, O_RDWR);
+	for ( i = 0; i < n; i++ ) {
+		p = (sysfs_impl)h[i];
+		/* retry once if we just exported */
+		for ( retry = 0; p->val_fd < 0 && retry < 2; retry++ ) {
+			p->val_fd = sysfs_open_file( pins[i], "value" );
+		}
+		if ( p->val_fd < 0 ) {
+			fprintf(stderr,"gpiolib: unable to open 'value' file for pin %d: %s\n", pins[i], strerror(errno));
+			goto bail;
+		}
+		if ( (p->dir_fd = sysfs_open_file( pins[i], "direction" )) < 0 ) {
+			fprintf(stderr,"gpiolib: unable to open 'direction' file for pin %d: %s\n", pins[i], strerror(errno));
+			goto bail;
+		}
+	}
 
-		if ( val_fd < 0 ) {
-			if ( ! retry++ && ENOENT == errno ) {
-				if ( fillb(buf, sizeof(buf), "%sexport", CLASS_GPIO) )
-					goto bail;
+	if ( exp_fd >= 0 )
+		close( exp_fd );
+	return 0;
 
-				if ( (f = fopen(buf, "w")) < 0 ) {
-					fprintf(stderr,"gpiolib: unable to open '%s' (%s)\n", buf, strerror(errno));
-					goto bail;
-				}
+bail:
+	if ( exp_fd >= 0 )
+		close( exp_fd );
+	for ( i = 0; i < n; i++ ) {
+		if ( (p = (sysfs_impl)h[i]) ) {
+			if ( p->val_fd >= 0 )
+				close( p->val_fd );
+			if ( p->dir_fd >= 0 )
+				close( p->dir_fd );
+			free( p );
+			h[i] = 0;
+		}
+	}
+	return -1;
+}
 
-				if ( fprintf(f, "%d", base + pin) < 0 ) {
-					fprintf(stderr,"gpiolib: unable to write to '%s' (%s)\n", buf, strerror(errno));
-					goto bail;
-				}
+static h_impl
+sysfs_open(unsigned pin)
+{
+h_impl rval;
+	return sysfs_open_many( &pin, 1, &rval ) ? 0 : rval;
+}
 
-				fclose(f); f = 0;
-			} else {
-				fprintf(stderr,"gpiolib: unable to open 'value' file for pin %d: %s\n", pin, strerror(errno));
-				goto bail;
+static void
+sysfs_close(h_impl p)
+{
+sysfs_impl h = (sysfs_impl)p;
+	close(h->val_fd);
+	close(h->dir_fd);
+	if ( h->edge_fd >= 0 )
+		close(h->edge_fd);
+	free(h);
+}
+
+static int
+sysfs_put(h_impl p, int val)
+{
+sysfs_impl h = (sysfs_impl)p;
+int rval;
+	if ( gpio_q_active() )
+		return gpio_q_write(h->val_fd, val ? "1" : "0", 1);
+	gpio_nsys++;
+	rval = pwrite(h->val_fd, val ? "1" : "0", 1, 0);
+	return rval < 0 ? rval : 0;
+}
+
+static const char *edge_names[] = { "none", "rising", "falling", "both" };
+
+static int
+sysfs_set_edge(sysfs_impl h, int edge)
+{
+	if ( gpio_flush() )
+		return -1;
+	if ( h->edge_fd < 0 && (h->edge_fd = sysfs_open_file( h->hdr.pin, "edge" )) < 0 )
+		return -1;
+	gpio_nsys++;
+	if ( pwrite(h->edge_fd, edge_names[edge], strlen(edge_names[edge]), 0) < 0 )
+		return -1;
+	h->edge = edge;
+	return 0;
+}
+
+static int
+sysfs_dir(h_impl p, int out)
+{
+sysfs_impl h = (sysfs_impl)p;
+int rval;
+	/* kernel refuses to make a pin used as an IRQ an output */
+	if ( out && h->edge && sysfs_set_edge( h, 0 ) )
+		return -1;
+	if ( gpio_q_active() )
+		return out ? gpio_q_write(h->dir_fd,"out",3) : gpio_q_write(h->dir_fd,"in",2);
+	gpio_nsys++;
+	rval = out ? pwrite(h->dir_fd,"out",3,0) : pwrite(h->dir_fd,"in",2,0);
+	return rval < 0 ? rval : 0;
+}
+
+static int
+sysfs_get(h_impl p)
+{
+sysfs_impl    h = (sysfs_impl)p;
+unsigned char v;
+int           rval;
+	/* reading is a barrier */
+	if ( gpio_flush() )
+		return -1;
+	gpio_nsys++;
+	rval = pread(h->val_fd, &v, 1, 0);
+		return rval < 0 ? rval : ( v - '0' );
+}
+
+/* sysfs has no event timestamps; we record when poll() returns */
+static int
+sysfs_wait_edge(h_impl p, int edge, const struct timespec *tmo, uint64_t *ts_p)
+{
+static const struct timespec nowait = { 0, 0 };
+sysfs_impl    h = (sysfs_impl)p;
+struct pollfd pfd;
+unsigned char v;
+int           got;
+
+	if ( gpio_flush() )
+		return -1;
+	if ( h->edge != edge ) {
+		if ( sysfs_set_edge( h, edge ) )
+			return -1;
+		/* discard stale event */
+		gpio_nsys++;
+		if ( pread(h->val_fd, &v, 1, 0) < 0 )
+			return -1;
+		/* the edge may have happened before we armed; report it
+		 * and acknowledge any event raised since arming so that the
+		 * next call doesn't report it again
+		 */
+		if ( gpio_edge_done( edge, v - '0' ) ) {
+			pfd.fd     = h->val_fd;
+			pfd.events = POLLPRI | POLLERR;
+			gpio_nsys++;
+			if ( (got = ppoll( &pfd, 1, &nowait, 0 )) < 0 )
+				return -1;
+			if ( got ) {
+				gpio_nsys++;
+				if ( pread(h->val_fd, &v, 1, 0) < 0 )
+					return -1;
 			}
+			if ( ts_p )
+				*ts_p = gpio_ts_now();
+			return 1;
+		}
+	}
+	pfd.fd     = h->val_fd;
+	pfd.events = POLLPRI | POLLERR;
+	gpio_nsys++;
+	if ( (got = ppoll( &pfd, 1, tmo, 0 )) <= 0 )
+		return got;
+	if ( ts_p )
+		*ts_p = gpio_ts_now();
+	/* acknowledge */
+	gpio_nsys++;
+	if ( pread(h->val_fd, &v, 1, 0) < 0 )
+		return -1;
+	return 1;
+}
+
+const gpio_backend gpio_backend_sysfs = {
+	name:      "sysfs",
+	open:      sysfs_open,
+	open_many: sysfs_open_many,
+	close:     sysfs_close,
+	put:       sysfs_put,
+	dir:       sysfs_dir,
+	get:       sysfs_get,
+	wait_edge: sysfs_wait_edge,
+};
+
+static const gpio_backend *backends[] = {
+	&gpio_backend_sysfs,
+	&gpio_backend_cdev,
+	&gpio_backend_zynq,
+	&gpio_backend_sim,
+};
+
+int
+gpio_select_backend(const char *name)
+{
+int i;
+	for ( i = 0; i < sizeof(backends)/sizeof(backends[0]); i++ ) {
+		if ( 0 == strcmp(name, backends[i]->name) ) {
+			backend = backends[i];
+			return 0;
 		}
-	} while ( val_fd < 0 );
+	}
+	fprintf(stderr,"gpiolib: unknown backend '%s'\n", name);
+	return -1;
+}
 
-	if ( fillb(buf, sizeof(buf), "%sgpio%d/direction", CLASS_GPIO, base + pin) )
-		goto bail;
+static const gpio_backend *
+get_backend(void)
+{
+const char *nm;
+	if ( ! backend ) {
+		if ( ! (nm = getenv("GPIOLIB_BACKEND")) || gpio_select_backend( nm ) )
+			backend = &gpio_backend_sysfs;
+	}
+	/* however the backend was chosen (runs once) */
+	gpio_t_env();
+	return backend;
+}
 
-	dir_fd = open(buf, O_RDWR);
+uint64_t
+gpio_syscalls(void)
+{
+	return gpio_nsys;
+}
 
-	if ( dir_fd < 0 ) {
-		fprintf(stderr,"gpiolib: unable to open 'direction' file for pin %d: %s\n", pin, strerror(errno));
-		goto bail;
+gpio_handle
+gpio_open(unsigned pin, int is_emio)
+{
+	if ( pin >= EMIO_OFFSET ) {
+		fprintf(stderr,"gpiolib: Invalid pin number (must be < %d)\n", EMIO_OFFSET);
+		return 0;
 	}
 
-	if ( ! (rval = malloc(sizeof(*rval))) ) {
-		fprintf(stderr,"gpiolib: no memory\n");
-		goto bail;
+	if ( is_emio )
+		pin += EMIO_OFFSET;
+
+	return get_backend()->open( pin );
+}
+
+static int
+generic_open_many(const gpio_backend *be, const unsigned pins[], unsigned n, h_impl h[])
+{
+unsigned i;
+	for ( i = 0; i < n; i++ ) {
+		if ( ! (h[i] = be->open( pins[i] )) ) {
+			while ( i > 0 )
+				be->close( h[--i] );
+			return -1;
+		}
 	}
+	return 0;
+}
 
-	rval->dir_fd = dir_fd; dir_fd = -1;
-	rval->val_fd = val_fd; val_fd = -1;
+static int
+open_many(const gpio_backend *be, const unsigned pins[], unsigned n, h_impl h[])
+{
+	if ( be->open_many )
+		return be->open_many( pins, n, h );
+	return generic_open_many( be, pins, n, h );
+}
 
-bail:
-	if ( val_fd >= 0 )
-		close(val_fd);
-	if ( dir_fd >= 0 )
-		close(dir_fd);
-	if ( fd >= 0 )
-		close(fd);
-	closedir( dir );
-	if ( f )
-		fclose(f);
-	return rval;
+int
+gpio_open_many(const unsigned pins[], unsigned n, gpio_handle h[])
+{
+unsigned i;
+	for ( i = 0; i < n; i++ ) {
+		if ( pins[i] >= 2*EMIO_OFFSET ) {
+			fprintf(stderr,"gpiolib: Invalid pin number %d\n", pins[i]);
+			return -1;
+		}
+	}
+	return open_many( get_backend(), pins, n, (h_impl*)h );
 }
 
 void gpio_close(gpio_handle p)
 {
 h_impl h = (h_impl)p;
-	close(h->val_fd);
-	close(h->dir_fd);
-	free(h);
+	h->be->close( h );
+}
+
+static int
+pin_put(h_impl h, int val)
+{
+int rval = h->be->put( h, val );
+	if ( gpio_t_on && ! rval )
+		gpio_t_put( h->pin, val, gpio_ts_now() );
+	return rval;
+}
+
+static int
+pin_dir(h_impl h, int out)
+{
+int rval = h->be->dir( h, out );
+	if ( gpio_t_on && ! rval )
+		gpio_t_dir( h->pin, out, gpio_ts_now() );
+	return rval;
 }
 
 int gpio_set(gpio_handle p)
 {
-h_impl h = (h_impl)p;
-int rval = pwrite(h->val_fd,"1",1,0);
-	return rval < 0 ? rval : 0;
+	return pin_put( (h_impl)p, 1 );
 }
 
 int gpio_clr(gpio_handle p)
 {
-h_impl h = (h_impl)p;
-int rval = pwrite(h->val_fd,"0",1,0);
-	return rval < 0 ? rval : 0;
+	return pin_put( (h_impl)p, 0 );
 }
 
 int gpio_out(gpio_handle p)
 {
-h_impl h = (h_impl)p;
-int rval = pwrite(h->dir_fd,"out",3,0);
-	return rval < 0 ? rval : 0;
+	return pin_dir( (h_impl)p, 1 );
 }
 
 int gpio_inp(gpio_handle p)
 {
-h_impl h = (h_impl)p;
-int rval = pwrite(h->dir_fd,"in",2,0);
-	return rval < 0 ? rval : 0;
+	return pin_dir( (h_impl)p, 0 );
 }
 
 int  gpio_get(gpio_handle p)
 {
-h_impl        h = (h_impl)p;
-unsigned char v;
-int           rval = pread(h->val_fd, &v, 1, 0);
-		return rval < 0 ? rval : ( v - '0' );
+h_impl h = (h_impl)p;
+	return h->be->get( h );
+}
+
+int
+gpio_wait_edge(gpio_handle p, int edge, const struct timespec *timeout, uint64_t *ts_p)
+{
+h_impl h = (h_impl)p;
+	if ( edge < GPIO_EDGE_RISING || edge > GPIO_EDGE_BOTH ) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ( ! h->be->wait_edge ) {
+		errno = ENOSYS;
+		return -1;
+	}
+	return h->be->wait_edge( h, edge, timeout, ts_p );
+}
+
+static void
+generic_group_close(g_impl p)
+{
+generic_grp g = (generic_grp)p;
+unsigned    i;
+	for ( i = 0; i < g->hdr.n; i++ ) {
+		if ( g->pins[i] )
+			g->hdr.be->close( g->pins[i] );
+	}
+	free( g );
+}
+
+static g_impl
+generic_group_open(const gpio_backend *be, const unsigned pins[], unsigned n)
+{
+generic_grp g;
+
+	if ( ! (g = calloc(1, sizeof(*g))) ) {
+		fprintf(stderr,"gpiolib: no memory\n");
+		return 0;
+	}
+	g->hdr.be = be;
+	g->hdr.n  = n;
+	if ( open_many( be, pins, n, g->pins ) ) {
+		free( g );
+		return 0;
+	}
+	return &g->hdr;
+}
+
+static int
+generic_group_write(g_impl p, uint32_t msk, uint32_t val)
+{
+generic_grp g = (generic_grp)p;
+unsigned    i;
+	msk &= ~(g->known & ~(g->lvl ^ val));
+	for ( i = 0; i < g->hdr.n; i++ ) {
+		if ( ! (msk & (1u<<i)) )
+			continue;
+		if ( g->hdr.be->put( g->pins[i], !!(val & (1u<<i)) ) ) {
+			g->known &= ~(1u<<i);
+			return -1;
+		}
+		g->lvl    = (g->lvl & ~(1u<<i)) | (val & (1u<<i));
+		g->known |= (1u<<i);
+	}
+	return 0;
+}
+
+static int
+generic_group_read(g_impl p, uint32_t msk, uint32_t *val_p)
+{
+generic_grp g = (generic_grp)p;
+unsigned    i;
+uint32_t    v = 0;
+int         got;
+	for ( i = 0; i < g->hdr.n; i++ ) {
+		if ( ! (msk & (1u<<i)) )
+			continue;
+		if ( (got = g->hdr.be->get( g->pins[i] )) < 0 )
+			return -1;
+		if ( got )
+			v |= (1u<<i);
+	}
+	*val_p = v;
+	return 0;
+}
+
+static int
+generic_group_dir(g_impl p, uint32_t msk, uint32_t out)
+{
+generic_grp g = (generic_grp)p;
+unsigned    i;
+	/* the level after a direction change is the backend's business */
+	g->known &= ~msk;
+	for ( i = 0; i < g->hdr.n; i++ ) {
+		if ( (msk & (1u<<i)) && g->hdr.be->dir( g->pins[i], !!(out & (1u<<i)) ) )
+			return -1;
+	}
+	return 0;
+}
+
+gpio_group
+gpio_group_open(const unsigned pins[], unsigned n)
+{
+const gpio_backend *be = get_backend();
+unsigned            i;
+g_impl              g;
+
+	if ( n < 1 || n > GPIO_GROUP_MAX ) {
+		fprintf(stderr,"gpiolib: Invalid group size %d (must be 1..%d)\n", n, GPIO_GROUP_MAX);
+		return 0;
+	}
+	for ( i = 0; i < n; i++ ) {
+		if ( pins[i] >= 2*EMIO_OFFSET ) {
+			fprintf(stderr,"gpiolib: Invalid pin number %d\n", pins[i]);
+			return 0;
+		}
+	}
+	if ( be->group_open )
+		g = be->group_open( pins, n );
+	else
+		g = generic_group_open( be, pins, n );
+	if ( g ) {
+		for ( i = 0; i < n; i++ )
+			g->pin[i] = pins[i];
+	}
+	return g;
+}
+
+void
+gpio_group_close(gpio_group p)
+{
+g_impl g = (g_impl)p;
+	if ( g->be->group_close )
+		g->be->group_close( g );
+	else
+		generic_group_close( g );
+}
+
+int
+gpio_group_write(gpio_group p, uint32_t msk, uint32_t val)
+{
+g_impl   g = (g_impl)p;
+int      rval;
+uint64_t now;
+unsigned i;
+	if ( g->be->group_write )
+		rval = g->be->group_write( g, msk, val );
+	else
+		rval = generic_group_write( g, msk, val );
+	if ( gpio_t_on && ! rval ) {
+		now = gpio_ts_now();
+		for ( i = 0; i < g->n; i++ ) {
+			if ( (msk & (1u<<i)) )
+				gpio_t_put( g->pin[i], !!(val & (1u<<i)), now );
+		}
+	}
+	return rval;
+}
+
+int
+gpio_group_read(gpio_group p, uint32_t msk, uint32_t *val_p)
+{
+g_impl g = (g_impl)p;
+	if ( g->be->group_read )
+		return g->be->group_read( g, msk, val_p );
+	return generic_group_read( g, msk, val_p );
+}
+
+int
+gpio_group_dir(gpio_group p, uint32_t msk, uint32_t out)
+{
+g_impl   g = (g_impl)p;
+int      rval;
+uint64_t now;
+unsigned i;
+	if ( g->be->group_dir )
+		rval = g->be->group_dir( g, msk, out );
+	else
+		rval = generic_group_dir( g, msk, out );
+	if ( gpio_t_on && ! rval ) {
+		now = gpio_ts_now();
+		for ( i = 0; i < g->n; i++ ) {
+			if ( (msk & (1u<<i)) )
+				gpio_t_dir( g->pin[i], !!(out & (1u<<i)), now );
+		}
+	}
+	return rval;
 }
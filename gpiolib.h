@@ -1,7 +1,11 @@
 #ifndef GPIOLIB_H
 #define GPIOLIB_H
 
+#include <stdint.h>
+#include <time.h>
+
 typedef void *gpio_handle;
+typedef void *gpio_group;
 
 /* returns handle on success, NULL on error */
 #define EMIO_PIN 1
@@ -10,12 +14,194 @@ gpio_handle gpio_open(unsigned pin, int pin_type);
 
 void        gpio_close(gpio_handle);
 
+/* Open 'n' pins at once (pin numbering as for groups, see below);
+ * the sysfs backend looks up the controller once and exports all
+ * pins that are not exported already in one go.
+ * Returns 0 on success, -1 on error (no handles are left open).
+ */
+int         gpio_open_many(const unsigned pins[], unsigned n, gpio_handle h[]);
+
 /* set, clr, out, inp return 0 on success, -1 (with errno set) on error */
 int gpio_set(gpio_handle);
 int gpio_clr(gpio_handle);
+/* NOTE: gpio_out() drives the pin low (like writing 'out' to sysfs)    */
 int gpio_out(gpio_handle);
 int gpio_inp(gpio_handle);
 /* get returns  1 or 0 on success and -1 on error (with errno set)      */
 int gpio_get(gpio_handle);
 
+/* Block until 'edge' is seen on an (input) pin or 'timeout' (relative,
+ * NULL waits forever) expires. Detection is armed on the first call for
+ * a given 'edge' and disarmed by switching the pin to output; edges
+ * occurring in between are reported by the next call.
+ * When detection is armed (zynq, sim: on every call) with the pin
+ * already at the level a single edge leads to (high for RISING, low for
+ * FALLING), the edge may just have happened and is reported at once;
+ * i.e., after sampling a low level, waiting for RISING can't miss the
+ * transition.
+ * The time of the edge (CLOCK_MONOTONIC, ns) is stored in *ts_p (unless
+ * NULL):
+ *   cdev : kernel timestamp of the interrupt; an edge before arming
+ *          (reported from the level) gets the time the level was
+ *          read, not a kernel timestamp
+ *   sysfs: time poll() returned or the level was read (sysfs has no
+ *          event timestamps)
+ *   zynq : time the transition was seen (busy-polls the register, i.e.,
+ *          only edges during the call are detected)
+ *   sim  : time of the call (inputs never change; only the level
+ *          check above reports an edge, on every call)
+ * Returns 1 if an edge was seen, 0 on timeout, -1 on error.
+ */
+#define GPIO_EDGE_RISING  1
+#define GPIO_EDGE_FALLING 2
+#define GPIO_EDGE_BOTH    3
+int gpio_wait_edge(gpio_handle, int edge, const struct timespec *timeout, uint64_t *ts_p);
+
+/* Queued mode (sysfs backend only; other backends are unaffected):
+ * while active, gpio_set/clr/out/inp (also via groups) are merely
+ * recorded and later submitted in order as one io_uring batch of
+ * linked writes (sequential pwrite() if io_uring is unavailable).
+ *
+ * gpio_flush() submits the queue explicitly; this happens implicitly
+ * when 'depth' operations are pending and before gpio_get() or
+ * gpio_wait_edge() (reading is a barrier). Errors of queued operations
+ * are only reported by the flush; operations following a failure are
+ * cancelled.
+ * gpio_queue_stop() flushes and leaves queued mode.
+ * All return 0 on success, -1 (with errno set) on error.
+ */
+int gpio_queue_start(unsigned depth);
+int gpio_flush(void);
+int gpio_queue_stop(void);
+
+/* Number of syscalls issued by pin and group operations so far (open
+ * and close are not counted); for benchmarking.
+ */
+uint64_t gpio_syscalls(void);
+
+/* Edge trace: while active, every change of a pin level caused by
+ * gpio_set/clr/out/inp and group write/dir is timestamped (CLOCK_MONOTONIC,
+ * taken when the call returns) into a buffer of 'depth' edges (0 selects
+ * the default of 1M). gpio_trace_stop() -- called automatically at exit --
+ * writes the buffer to 'vcd_path' as a VCD file with one wire per pin
+ * (named [e]mio<X>, like gpiola). Outputs are recorded as 0/1, inputs as
+ * 'z' (we cannot know what others drive). In queued mode the time
+ * an operation was queued is recorded.
+ * Setting the GPIOLIB_TRACE environment variable to a file name starts
+ * tracing with the first pin/group opened.
+ * The trace can be checked for protocol timing with gpiodec.
+ * Both return 0 on success, -1 on error.
+ */
+int gpio_trace_start(const char *vcd_path, unsigned depth);
+int gpio_trace_stop(void);
+
+/* Select the backend used by subsequent gpio_open()/gpio_group_open():
+ *
+ *   "sysfs" : /sys/class/gpio (default)
+ *   "cdev"  : /dev/gpiochipN line requests (GPIO v2 uAPI)
+ *   "zynq"  : Zynq PS GPIO registers mapped from /dev/mem (no syscalls)
+ *   "sim"   : simulation without hardware; outputs read back what they
+ *             drive, inputs read 1 (pulled up)
+ *
+ * The GPIOLIB_BACKEND environment variable provides the default.
+ * Handles remember the backend they were opened with.
+ * Returns 0 on success, -1 if the name is unknown.
+ *
+ * The controller is found by its label (GPIOLIB_LABEL environment
+ * variable, default "zynq_gpio"); e.g., a gpio-sim chip can be
+ * substituted for testing.
+ */
+int gpio_select_backend(const char *name);
+
+/* Map the register window used by the "zynq" backend. By default
+ * (GPIOLIB_ZYNQ_DEV/GPIOLIB_ZYNQ_OFF environment variables override)
+ * 0xE000A000 is mapped from /dev/mem.
+ * For testing on a host, map a (4k) regular file at offset 0 instead.
+ * Returns 0 on success, -1 on error.
+ */
+int gpio_zynq_map(const char *devnam, unsigned long offset);
+
+/* Cache the sysfs controller lookup (base, ngpio) in 'path' (NULL
+ * disables). The entry is keyed by the kernel's boot id, i.e., it
+ * is rediscovered after a reboot. A file on tmpfs (e.g., in /run)
+ * is recommended. The GPIOLIB_CACHE environment variable provides
+ * the default (caching is off if unset).
+ */
+int gpio_use_cache(const char *path);
+
+/* Pin groups: operate on up to 32 pins with a single call.
+ * Pins are controller-relative, i.e., MIO pin 'n' is 'n' and EMIO pin
+ * 'n' is GPIO_EMIO(n).
+ * Bit 'i' of 'mask', 'val' refers to pins[i].
+ * The cdev backend sets/reads all pins with a single ioctl, the zynq
+ * backend uses one register access per (half-)bank.
+ *
+ * gpio_group_open returns NULL on error; write/read return 0 on success,
+ * -1 (with errno set) on error.
+ */
+#define GPIO_EMIO(n)   ((n) + 54)
+#define GPIO_GROUP_MAX 32
+gpio_group  gpio_group_open(const unsigned pins[], unsigned n);
+
+void        gpio_group_close(gpio_group);
+
+/* set pins in 'mask' to the corresponding bits in 'val' (outputs only)  */
+int gpio_group_write(gpio_group, uint32_t mask, uint32_t val);
+/* read the pins in 'mask' into *val_p (others read 0); with the sysfs
+ * backend every pin read is a syscall, i.e., only ask for what you need
+ */
+#define GPIO_GROUP_ALL 0xffffffff
+int gpio_group_read(gpio_group, uint32_t mask, uint32_t *val_p);
+/* pins in 'mask' become outputs (driving low) if the corresponding bit
+ * in 'out' is set and inputs otherwise.
+ */
+int gpio_group_dir(gpio_group, uint32_t mask, uint32_t out);
+
+/* Direct register access ("zynq" backend only) for code which wants to
+ * inline pin operations, e.g., bit-bang engines. For a pin:
+ *   md_reg : MASK_DATA_x_LSW/MSW register covering the pin; write
+ *            GPIO_ZYNQ_MASK_DATA(msk, val) with 'md_bit' (and the bits
+ *            of other pins in the same half-bank) in 'msk' and 'val'
+ *   ro_reg : DATA_RO register, pin is 'bit'
+ *   dirm_reg, oen_reg: DIRM/OEN registers, pin is 'bit' (OEN = 0
+ *            tri-states an output, i.e., open-drain emulation)
+ *   lock   : the bank's lock; DIRM/OEN can only be updated read-modify-
+ *            write, hence hold it (gpio_zynq_lock()/gpio_zynq_unlock())
+ *            across such an update. gpiolib's own direction changes
+ *            take it, too. It serializes the threads of one process only.
+ * Such accesses bypass gpiolib, hence they cannot be traced; the calls
+ * fail (errno EBUSY) while an edge trace is active and (ENOTSUP) for
+ * handles/groups of other backends.
+ * gpio_group_zynq_regs() fills r[i] for pins[i] of the group.
+ * Return 0 on success, -1 on error.
+ */
+typedef struct gpio_zynq_pin_ {
+	volatile uint32_t *md_reg;
+	uint32_t           md_bit;
+	volatile uint32_t *ro_reg;
+	volatile uint32_t *dirm_reg;
+	volatile uint32_t *oen_reg;
+	uint32_t           bit;
+	char              *lock;
+} gpio_zynq_pin;
+
+#define GPIO_ZYNQ_MASK_DATA(msk, val) ( ((~(msk) & 0xffff) << 16) | ((val) & 0xffff) )
+
+/* held for a few register accesses only; spin */
+static inline void
+gpio_zynq_lock(const gpio_zynq_pin *r)
+{
+	while ( __atomic_test_and_set( r->lock, __ATOMIC_ACQUIRE ) )
+		;
+}
+
+static inline void
+gpio_zynq_unlock(const gpio_zynq_pin *r)
+{
+	__atomic_clear( r->lock, __ATOMIC_RELEASE );
+}
+
+int gpio_zynq_regs(gpio_handle, gpio_zynq_pin *r);
+int gpio_group_zynq_regs(gpio_group, gpio_zynq_pin r[]);
+
 #endif
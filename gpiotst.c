@@ -1,33 +1,343 @@
+/* gpiolib benchmark
+ *
+ * For every selected backend:
+ *
+ *   toggle: 'n' set/clear cycles on the output pin (2n operations);
+ *           the rate is measured over an untimed loop, latencies in
+ *           a second, timed loop (clock overhead subtracted).
+ *   rtt   : 'n' round trips: set (alternately clear) the output pin
+ *           and gpio_get() the input pin until it follows; the input
+ *           defaults to the output pin itself, use a jumper (or an
+ *           EMIO loopback in the PL) for a real loopback.
+ *
+ * Results go to stdout as CSV (default) or JSON; syscalls/op is
+ * taken from gpio_syscalls().
+ * For stable numbers run pinned and real-time, e.g.,
+ *   taskset -c 1 chrt -f 80 gpiotst
+ */
+
 #include <gpiolib.h>
 #include <stdio.h>
-#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <inttypes.h>
+
+#define BACKENDS_DFLT "zynq,cdev,sysfs,sysfs-queued"
+#define NCYCLES_DFLT  1000000
+#define LAT_MAX       (1<<20)   /* latency samples kept per test */
+#define QUEUE_DEPTH   64
+#define RTT_TMO_NS    1000000000ULL
+
+#define FMT_CSV  0
+#define FMT_JSON 1
+
+typedef struct result_ {
+	const char *be;
+	const char *test;
+	uint64_t    ops;
+	double      secs;
+	double      rate;
+	uint32_t    p50, p90, p99, p999, max;
+	double      sys_per_op;
+} result;
+
+static inline uint64_t
+now_ns(void)
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* minimal cost of a pair of clock readings */
+static uint32_t
+clk_overhead(void)
+{
+uint64_t a, b, min = (uint64_t)-1;
+int      i;
+	for ( i = 0; i < 1000; i++ ) {
+		a = now_ns();
+		b = now_ns();
+		if ( b - a < min )
+			min = b - a;
+	}
+	return (uint32_t)min;
+}
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+uint32_t x = *(const uint32_t*)a;
+uint32_t y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void
+percentiles(result *r, uint32_t *lat, unsigned n)
+{
+	if ( ! n )
+		return;
+	qsort( lat, n, sizeof(*lat), cmp_u32 );
+	r->p50  = lat[ (uint64_t)n *  50 /  100 ];
+	r->p90  = lat[ (uint64_t)n *  90 /  100 ];
+	r->p99  = lat[ (uint64_t)n *  99 /  100 ];
+	r->p999 = lat[ (uint64_t)n * 999 / 1000 ];
+	r->max  = lat[ n - 1 ];
+}
+
+static int
+run_toggle(gpio_handle o, uint64_t n, uint32_t *lat, uint32_t clk, result *r)
+{
+uint64_t i, t0, t1, s0;
+unsigned nlat = n < LAT_MAX/2 ? 2*n : LAT_MAX;
+
+	s0 = gpio_syscalls();
+	t0 = now_ns();
+	for ( i = 0; i < n; i++ ) {
+		if ( gpio_set( o ) || gpio_clr( o ) )
+			goto bail;
+	}
+	if ( gpio_flush() )
+		goto bail;
+	t1 = now_ns();
+
+	r->test       = "toggle";
+	r->ops        = 2*n;
+	r->secs       = (double)(t1 - t0) / 1.0E9;
+	r->rate       = (double)r->ops / r->secs;
+	r->sys_per_op = (double)(gpio_syscalls() - s0) / (double)r->ops;
+
+	for ( i = 0; i < nlat; i++ ) {
+		t0 = now_ns();
+		if ( ( (i & 1) ? gpio_clr( o ) : gpio_set( o ) ) )
+			goto bail;
+		t1 = now_ns();
+		lat[i] = t1 - t0 > clk ? t1 - t0 - clk : 0;
+	}
+	if ( gpio_flush() )
+		goto bail;
+	percentiles( r, lat, nlat );
+	return 0;
+
+bail:
+	perror("toggle");
+	return -1;
+}
+
+static int
+run_rtt(gpio_handle o, gpio_handle inp, uint64_t n, uint32_t *lat, result *r)
+{
+uint64_t i, t0, t, s0, start;
+int      v, got;
+
+	s0    = gpio_syscalls();
+	start = t0 = now_ns();
+	for ( i = 0; i < n; i++ ) {
+		v = ! (i & 1);
+		if ( ( v ? gpio_set( o ) : gpio_clr( o ) ) )
+			goto bail;
+		while ( (got = gpio_get( inp )) != v ) {
+			if ( got < 0 )
+				goto bail;
+			if ( now_ns() - t0 > RTT_TMO_NS ) {
+				fprintf(stderr,"rtt: input does not follow output (no loopback?)\n");
+				return -1;
+			}
+		}
+		t = now_ns();
+		if ( i < LAT_MAX )
+			lat[i] = t - t0;
+		t0 = t;
+	}
+
+	r->test       = "rtt";
+	r->ops        = n;
+	r->secs       = (double)(t0 - start) / 1.0E9;
+	r->rate       = (double)r->ops / r->secs;
+	r->sys_per_op = (double)(gpio_syscalls() - s0) / (double)r->ops;
+	percentiles( r, lat, n < LAT_MAX ? n : LAT_MAX );
+	return 0;
+
+bail:
+	perror("rtt");
+	return -1;
+}
+
+static void
+emit(int fmt, const result *r, int first)
+{
+	if ( FMT_JSON == fmt ) {
+		printf("%s\n  {\"backend\": \"%s\", \"test\": \"%s\", \"ops\": %"PRIu64", \"seconds\": %.6f, \"rate_per_s\": %.1f, "
+		       "\"lat_ns\": {\"p50\": %"PRIu32", \"p90\": %"PRIu32", \"p99\": %"PRIu32", \"p99.9\": %"PRIu32", \"max\": %"PRIu32"}, "
+		       "\"syscalls_per_op\": %.3f}",
+		       first ? "" : ",", r->be, r->test, r->ops, r->secs, r->rate,
+		       r->p50, r->p90, r->p99, r->p999, r->max, r->sys_per_op);
+	} else {
+		printf("%s,%s,%"PRIu64",%.6f,%.1f,%"PRIu32",%"PRIu32",%"PRIu32",%"PRIu32",%"PRIu32",%.3f\n",
+		       r->be, r->test, r->ops, r->secs, r->rate,
+		       r->p50, r->p90, r->p99, r->p999, r->max, r->sys_per_op);
+	}
+	fflush( stdout );
+}
+
+static int
+parse_pin(const char *s, unsigned *pin_p)
+{
+unsigned p;
+	if ( 1 == sscanf(s, "emio%u", &p) ) {
+		*pin_p = GPIO_EMIO( p );
+	} else if ( 1 == sscanf(s, "mio%u", &p) ) {
+		*pin_p = p;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+static void
+usage(const char *nm)
+{
+	fprintf(stderr,"Usage: %s [-hjr] [-b backend[,backend...]] [-n cycles] [-o out-pin] [-i in-pin]\n", nm);
+	fprintf(stderr,"          benchmark gpiolib backends (toggle rate, set->get round trip)\n");
+	fprintf(stderr,"          pin       : mio<X> or emio<X>\n");
+	fprintf(stderr,"          -b        : backends to test (default %s);\n", BACKENDS_DFLT);
+	fprintf(stderr,"                      'sysfs-queued' is sysfs in queued (io_uring) mode\n");
+	fprintf(stderr,"          -n cycles : toggle cycles and round trips (default %d; k/M suffix ok)\n", NCYCLES_DFLT);
+	fprintf(stderr,"          -o pin    : output pin (default emio11)\n");
+	fprintf(stderr,"          -i pin    : loopback input pin for 'rtt' (default: output pin)\n");
+	fprintf(stderr,"          -r        : skip the round trip test\n");
+	fprintf(stderr,"          -j        : JSON output (default: CSV)\n");
+}
 
 int
 main(int argc, char **argv)
 {
-gpio_handle gpio = gpio_open(11, EMIO_PIN);
-int         got;
-int         i;
+int         rval   = 1;
+int         opt;
+int         fmt    = FMT_CSV;
+int         do_rtt = 1;
+int         first  = 1;
+int         queued;
+char       *bes    = strdup( BACKENDS_DFLT );
+char       *be, *sp, *end;
+uint64_t    n      = NCYCLES_DFLT;
+unsigned    pins[2];
+unsigned    npins;
+gpio_handle h[2];
+uint32_t   *lat    = 0;
+uint32_t    clk;
+result      r;
 
-	if ( ! gpio )
-		return 1;
+	pins[0] = GPIO_EMIO( 11 );
+	pins[1] = (unsigned)-1;
+
+	while ( (opt = getopt(argc, argv, "hjrb:n:o:i:")) > 0 ) {
+		switch ( opt ) {
+			case 'h': rval = 0;
+			default:
+				usage(argv[0]);
+				return rval;
+
+			case 'j': fmt    = FMT_JSON; break;
+			case 'r': do_rtt = 0;        break;
 
-	if ( gpio_out(gpio) ) {
-		perror("gpio_out");
+			case 'b':
+				free( bes );
+				bes = strdup( optarg );
+				break;
+
+			case 'n':
+				n = strtoull( optarg, &end, 0 );
+				if      ( 'k' == *end ) { n *= 1000;    end++; }
+				else if ( 'M' == *end ) { n *= 1000000; end++; }
+				if ( *end || ! n ) {
+					fprintf(stderr,"Invalid cycle count '%s'\n", optarg);
+					return 1;
+				}
+				break;
+
+			case 'o':
+			case 'i':
+				if ( parse_pin( optarg, &pins['o' == opt ? 0 : 1] ) ) {
+					fprintf(stderr,"Invalid pin '%s'\n", optarg);
+					return 1;
+				}
+				break;
+		}
+	}
+	if ( optind != argc ) {
+		usage(argv[0]);
 		return 1;
 	}
+	if ( (unsigned)-1 == pins[1] )
+		pins[1] = pins[0];
+	npins = pins[1] == pins[0] ? 1 : 2;
+
+	if ( ! bes || ! (lat = malloc( LAT_MAX * sizeof(*lat) )) ) {
+		fprintf(stderr,"No memory\n");
+		goto bail;
+	}
+	clk = clk_overhead();
+
+	if ( FMT_JSON == fmt )
+		printf("[");
+	else
+		printf("backend,test,ops,seconds,rate_per_s,lat_p50_ns,lat_p90_ns,lat_p99_ns,lat_p999_ns,lat_max_ns,syscalls_per_op\n");
+
+	for ( be = strtok_r( bes, ",", &sp ); be; be = strtok_r( 0, ",", &sp ) ) {
+		queued = ( 0 == strcmp(be, "sysfs-queued") );
+		if ( gpio_select_backend( queued ? "sysfs" : be ) )
+			continue;
+		if ( gpio_open_many( pins, npins, h ) ) {
+			fprintf(stderr,"Skipping backend '%s' (unable to open pins)\n", be);
+			continue;
+		}
+		if ( 1 == npins )
+			h[1] = h[0];
+		else if ( gpio_inp( h[1] ) )
+			perror("gpio_inp");
+		if ( gpio_out( h[0] ) ) {
+			perror("gpio_out");
+			goto next;
+		}
+		if ( queued && gpio_queue_start( QUEUE_DEPTH ) ) {
+			perror("gpio_queue_start");
+			goto next;
+		}
 
-	for ( i=0; i<5; i++ ) {
-		if ( gpio_clr(gpio) ) {
-			perror("gpio_clr");
-			return 1;
+		memset( &r, 0, sizeof(r) );
+		r.be = be;
+		if ( 0 == run_toggle( h[0], n, lat, clk, &r ) ) {
+			emit( fmt, &r, first );
+			first = 0;
 		}
-		sleep(1);
-		if ( gpio_set(gpio) ) {
-			perror("gpio_set");
-			return 1;
+		if ( do_rtt ) {
+			memset( &r, 0, sizeof(r) );
+			r.be = be;
+			if ( 0 == run_rtt( h[0], h[1], n, lat, &r ) ) {
+				emit( fmt, &r, first );
+				first = 0;
+			}
 		}
-		sleep(1);
+
+next:
+		if ( queued )
+			gpio_queue_stop();
+		gpio_close( h[0] );
+		if ( 2 == npins )
+			gpio_close( h[1] );
 	}
-	return 0;
+
+	if ( FMT_JSON == fmt )
+		printf("\n]\n");
+
+	rval = 0;
+
+bail:
+	free( lat );
+	free( bes );
+	return rval;
 }
@@ -0,0 +1,719 @@
+/* i2clib bit-bang backend (gpiolib)
+ *
+ * Spec: "[e]mio<X>/[e]mio<Y>[,khz=<n>]" -- SCL on pin X, SDA on pin Y;
+ * SCL rate 'n' kHz (1..1000, default 100).
+ *
+ * The lines are open-drain: a pin is released (input; pulled up) for
+ * 'high' and driven low for 'low'. With the "zynq" gpiolib backend the
+ * pins are accessed directly (see bb_direct_init()).
+ *
+ * Setup/hold times are the minimums of the I2C spec for the mode the
+ * rate falls into (standard <= 100, fast <= 400, fast-plus); SCL low
+ * and high are stretched to give the requested period. They are
+ * produced by busy-waiting with a spin loop calibrated at open time;
+ * SCL low/high waits are shortened by the measured cost of a pin
+ * operation (down to the spec minimum).
+ * After releasing SCL we wait (bounded) for it to actually go high,
+ * i.e., a slave may stretch the clock.
+ *
+ * Errors (GPIO failures, stretch timeout, bus stuck) abort the
+ * transaction; a bus found with SDA held low is cleared by clocking
+ * SCL up to 9 times and issuing a STOP.
+ */
+
+#include <i2clib-impl.h>
+#include <gpiolib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+
+#define BB_STRETCH_MAX_NS 500000000ULL
+
+#define KHZ_DFLT     100
+#define KHZ_MAX      1000
+
+#define CALIB_RUNS   64
+#define SPIN_RUNS    200
+#define BENCH_RUNS   1000
+
+/* spec minimums (ns) */
+typedef struct bb_spec_ {
+	unsigned khz;
+	unsigned low, high, su_sta, hd_sta, su_dat, su_sto, buf;
+} bb_spec;
+
+static const bb_spec specs[] = {
+	/* khz   low   high su_sta hd_sta su_dat su_sto   buf */
+	{  100, 4700, 4000,  4700,  4000,   250,  4000, 4700 },  /* standard  */
+	{  400, 1300,  600,   600,   600,   100,   600, 1300 },  /* fast      */
+	{ 1000,  500,  260,   260,   260,    50,   260,  500 },  /* fast-plus */
+};
+
+/* the same in spin-loop counts (net of pin operation cost) */
+typedef struct bb_tim_ {
+	unsigned low, high, su_sta, hd_sta, su_sto, buf;
+} bb_tim;
+
+typedef struct bb_bus_ {
+	struct i2c_bus_ hdr;
+	gpio_handle     sda;
+	gpio_handle     scl;
+	/* direct register access (zynq backend only) */
+	gpio_zynq_pin   zsda;
+	gpio_zynq_pin   zscl;
+	int             direct;
+	unsigned        khz;
+	bb_tim          tim;
+	int             err;     /* sticky during a transaction (errno) */
+} *bb_bus;
+
+/* calibrated busy-wait */
+static inline __attribute__((always_inline)) void
+spin(unsigned loops)
+{
+volatile unsigned i;
+	for ( i = loops; i; i-- )
+		/* nothing */;
+}
+
+static void
+bb_fail(bb_bus dat, int err, const char *what)
+{
+	if ( ! dat->err ) {
+		if ( what )
+			fprintf(stderr, "i2clib: %s: %s\n", what, strerror(err));
+		dat->err = err;
+	}
+}
+
+static void
+bb_scl_hi(bb_bus dat)
+{
+int             val;
+uint64_t        now, end = 0;
+struct timespec tmo;
+
+	if ( gpio_inp( dat->scl ) ) {
+		bb_fail( dat, EIO, "releasing SCL" );
+		return;
+	}
+	while ( 1 ) {
+		val = gpio_get( dat->scl );
+		if ( val < 0 ) {
+			bb_fail( dat, EIO, "reading SCL" );
+			return;
+		}
+		if ( val ) {
+			return;
+		}
+		/* slave stretches the clock; block for the rising edge */
+		now = i2c_ts_now();
+		if ( ! end ) {
+			end = now + BB_STRETCH_MAX_NS;
+		} else if ( now >= end ) {
+			break;
+		}
+		tmo.tv_sec  = (end - now) / 1000000000ULL;
+		tmo.tv_nsec = (end - now) % 1000000000ULL;
+		if ( gpio_wait_edge( dat->scl, GPIO_EDGE_RISING, &tmo, 0 ) < 0 ) {
+			bb_fail( dat, EIO, "waiting for SCL" );
+			return;
+		}
+	}
+	bb_fail( dat, ETIMEDOUT, "clock stretching" );
+}
+
+static void
+bb_scl_lo(bb_bus dat)
+{
+	if ( gpio_out( dat->scl ) )
+		bb_fail( dat, EIO, "driving SCL" );
+}
+
+static void
+bb_sda_hi(bb_bus dat)
+{
+	if ( gpio_inp( dat->sda ) )
+		bb_fail( dat, EIO, "releasing SDA" );
+}
+
+static void
+bb_sda_lo(bb_bus dat)
+{
+	if ( gpio_out( dat->sda ) )
+		bb_fail( dat, EIO, "driving SDA" );
+}
+
+static int
+bb_sda_get(bb_bus dat)
+{
+int val;
+	if ( (val = gpio_get( dat->sda )) < 0 ) {
+		bb_fail( dat, EIO, "reading SDA" );
+		return 1;
+	}
+	return val;
+}
+
+static void
+bb_release(bb_bus dat)
+{
+	if ( dat->scl ) {
+		gpio_inp( dat->scl );
+		gpio_close( dat->scl );
+		dat->scl = 0;
+	}
+	if ( dat->sda ) {
+		gpio_inp( dat->sda );
+		gpio_close( dat->sda );
+		dat->sda = 0;
+	}
+}
+
+/* Direct register access (zynq backend): the pins stay in output mode
+ * driving 0 and OEN switches between driving low and releasing the line.
+ * OEN/DIRM are shared with the other pins of the bank (possibly used by
+ * other buses in other threads); update them under the bank lock.
+ */
+static inline __attribute__((always_inline)) void
+bb_oen(const gpio_zynq_pin *r, int drive)
+{
+	gpio_zynq_lock( r );
+	if ( drive )
+		*r->oen_reg |=  r->bit;
+	else
+		*r->oen_reg &= ~r->bit;
+	gpio_zynq_unlock( r );
+}
+
+static void
+bb_dirm_out(const gpio_zynq_pin *r)
+{
+	gpio_zynq_lock( r );
+	*r->dirm_reg |= r->bit;
+	gpio_zynq_unlock( r );
+}
+
+static int
+bb_direct_init(bb_bus dat)
+{
+	if ( gpio_zynq_regs( dat->scl, &dat->zscl ) || gpio_zynq_regs( dat->sda, &dat->zsda ) )
+		return -1;
+	/* both released */
+	bb_oen( &dat->zscl, 0 );
+	bb_oen( &dat->zsda, 0 );
+	*dat->zscl.md_reg = GPIO_ZYNQ_MASK_DATA( dat->zscl.md_bit, 0 );
+	*dat->zsda.md_reg = GPIO_ZYNQ_MASK_DATA( dat->zsda.md_bit, 0 );
+	bb_dirm_out( &dat->zscl );
+	bb_dirm_out( &dat->zsda );
+	return 0;
+}
+
+static void
+bb_scl_stretch_zynq(bb_bus dat)
+{
+uint64_t now, end = 0;
+
+	while ( ! (*dat->zscl.ro_reg & dat->zscl.bit) ) {
+		now = i2c_ts_now();
+		if ( ! end ) {
+			end = now + BB_STRETCH_MAX_NS;
+		} else if ( now >= end ) {
+			bb_fail( dat, ETIMEDOUT, "clock stretching" );
+			return;
+		}
+	}
+}
+
+/* The bit engine below is instantiated twice (gpiolib calls and direct
+ * register access); 'direct' is a constant in each instantiation so the
+ * compiler generates separate code paths with the pin operations inlined.
+ */
+#define BB_INLINE static inline __attribute__((always_inline))
+
+BB_INLINE void bb_scl_hi_t(bb_bus dat, const int direct)
+{
+	if ( direct ) {
+		bb_oen( &dat->zscl, 0 );
+		if ( ! (*dat->zscl.ro_reg & dat->zscl.bit) )
+			bb_scl_stretch_zynq( dat );
+	} else {
+		bb_scl_hi( dat );
+	}
+}
+
+BB_INLINE void bb_scl_lo_t(bb_bus dat, const int direct)
+{
+	if ( direct )
+		bb_oen( &dat->zscl, 1 );
+	else
+		bb_scl_lo( dat );
+}
+
+BB_INLINE void bb_sda_hi_t(bb_bus dat, const int direct)
+{
+	if ( direct )
+		bb_oen( &dat->zsda, 0 );
+	else
+		bb_sda_hi( dat );
+}
+
+BB_INLINE void bb_sda_lo_t(bb_bus dat, const int direct)
+{
+	if ( direct )
+		bb_oen( &dat->zsda, 1 );
+	else
+		bb_sda_lo( dat );
+}
+
+BB_INLINE int bb_sda_get_t(bb_bus dat, const int direct)
+{
+	if ( direct )
+		return !! (*dat->zsda.ro_reg & dat->zsda.bit);
+	return bb_sda_get( dat );
+}
+
+/* one clock with SDA as is; returns SDA sampled while SCL is high */
+BB_INLINE int bb_clock_t(bb_bus dat, const int direct)
+{
+int val;
+	spin( dat->tim.low );
+	bb_scl_hi_t( dat, direct );
+	spin( dat->tim.high );
+	val = bb_sda_get_t( dat, direct );
+	bb_scl_lo_t( dat, direct );
+	return val;
+}
+
+/* (repeated) START; SCL is low unless the bus is idle */
+BB_INLINE void bb_start_t(bb_bus dat, const int direct)
+{
+	bb_sda_hi_t( dat, direct );
+	spin       ( dat->tim.low );
+	bb_scl_hi_t( dat, direct );
+	spin       ( dat->tim.su_sta );
+	bb_sda_lo_t( dat, direct );
+	spin       ( dat->tim.hd_sta );
+	bb_scl_lo_t( dat, direct );
+}
+
+BB_INLINE void bb_stop_t(bb_bus dat, const int direct)
+{
+	bb_scl_lo_t( dat, direct );
+	bb_sda_lo_t( dat, direct );
+	spin       ( dat->tim.low );
+	bb_scl_hi_t( dat, direct );
+	spin       ( dat->tim.su_sto );
+	bb_sda_hi_t( dat, direct );
+	spin       ( dat->tim.buf );
+}
+
+/* write byte, return ACK */
+BB_INLINE int bb_write_byte_t(bb_bus dat, uint8_t byte, const int direct)
+{
+int bit;
+	for ( bit=0; bit<8; bit++ ) {
+		if ( (byte & 0x80) ) {
+			bb_sda_hi_t( dat, direct );
+		} else {
+			bb_sda_lo_t( dat, direct );
+		}
+		byte <<= 1;
+		bb_clock_t( dat, direct );
+	}
+	/* release SDA for the slave's ACK */
+	bb_sda_hi_t( dat, direct );
+	return ! bb_clock_t( dat, direct );
+}
+
+BB_INLINE uint8_t bb_read_byte_t(bb_bus dat, int do_ack, const int direct)
+{
+uint8_t byte = 0;
+int     bit;
+
+	/* release SDA for the slave */
+	bb_sda_hi_t( dat, direct );
+	for ( bit = 0; bit < 8; bit ++ ) {
+		byte = (byte << 1) | bb_clock_t( dat, direct );
+	}
+	/* send ACK */
+	if ( do_ack ) {
+		bb_sda_lo_t( dat, direct );
+	}
+	bb_clock_t( dat, direct );
+	return byte;
+}
+
+/* Bus clear: a slave holding SDA low (e.g., we stopped in the middle of
+ * its read) releases it after at most 9 clocks; then STOP.
+ * Returns 0 if SDA is high.
+ */
+BB_INLINE int bb_clear_t(bb_bus dat, const int direct)
+{
+int i;
+	bb_sda_hi_t( dat, direct );
+	for ( i = 0; i < 9 && ! bb_sda_get_t( dat, direct ); i++ ) {
+		bb_scl_lo_t( dat, direct );
+		bb_clock_t( dat, direct );
+	}
+	bb_stop_t( dat, direct );
+	return bb_sda_get_t( dat, direct ) ? 0 : -1;
+}
+
+BB_INLINE int bb_xfer_t(bb_bus dat, struct i2c_msg msgs[], unsigned n, const int direct)
+{
+struct i2c_msg *m;
+unsigned        i, j;
+int             rd;
+
+	dat->err = 0;
+	/* idle bus has SDA high; try to recover otherwise */
+	if ( ! bb_sda_get_t( dat, direct ) && bb_clear_t( dat, direct ) ) {
+		bb_fail( dat, EBUSY, 0 );
+		errno = dat->err;
+		return 0;
+	}
+	for ( i = 0; i < n; i++ ) {
+		m  = &msgs[i];
+		rd = !! (m->flags & I2C_M_RD);
+		bb_start_t( dat, direct );
+		if ( ! bb_write_byte_t( dat, (m->addr << 1) | rd, direct ) ) {
+			bb_fail( dat, ENXIO, 0 );
+		}
+		for ( j = 0; j < m->len && ! dat->err; j++ ) {
+			if ( rd ) {
+				m->buf[j] = bb_read_byte_t( dat, j != m->len - 1, direct );
+			} else if ( ! bb_write_byte_t( dat, m->buf[j], direct ) ) {
+				bb_fail( dat, EIO, 0 );
+			}
+		}
+		if ( dat->err )
+			break;
+	}
+	if ( dat->err ) {
+		errno = dat->err;
+		/* leave the bus idle if we can */
+		dat->err = 0;
+		if ( ! bb_sda_get_t( dat, direct ) )
+			bb_clear_t( dat, direct );
+		else
+			bb_stop_t( dat, direct );
+		return i;
+	}
+	bb_stop_t( dat, direct );
+	if ( dat->err ) {
+		/* count the last message as failed */
+		errno = dat->err;
+		return n ? n - 1 : 0;
+	}
+	return n;
+}
+
+/* Time (ns) of a clock with the current SCL low/high waits; with SDA
+ * released this is harmless on an idle bus (no START).
+ */
+BB_INLINE uint64_t bb_clock_time_t(bb_bus dat, const int direct)
+{
+uint64_t t0;
+unsigned i;
+
+	bb_sda_hi_t( dat, direct );
+	bb_scl_lo_t( dat, direct );
+	t0 = i2c_ts_now();
+	for ( i = 0; i < CALIB_RUNS; i++ )
+		bb_clock_t( dat, direct );
+	t0 = (i2c_ts_now() - t0) / CALIB_RUNS;
+	spin( dat->tim.low );
+	bb_scl_hi_t( dat, direct );
+	return t0;
+}
+
+static int bb_xfer_gpio(i2c_bus p, struct i2c_msg msgs[], unsigned n)
+{
+	return bb_xfer_t( (bb_bus)p, msgs, n, 0 );
+}
+
+static int bb_xfer_zynq(i2c_bus p, struct i2c_msg msgs[], unsigned n)
+{
+	return bb_xfer_t( (bb_bus)p, msgs, n, 1 );
+}
+
+static int bb_xfer(i2c_bus p, struct i2c_msg msgs[], unsigned n)
+{
+	return ((bb_bus)p)->direct ? bb_xfer_zynq( p, msgs, n ) : bb_xfer_gpio( p, msgs, n );
+}
+
+/* Generic engine (i2c_bb_bench() only): the bit loop dispatching every
+ * pin operation through function pointers.
+ */
+typedef struct bb_ops_ {
+	void (*scl_hi) (bb_bus);
+	void (*scl_lo) (bb_bus);
+	void (*sda_hi) (bb_bus);
+	void (*sda_lo) (bb_bus);
+	int  (*sda_get)(bb_bus);
+} bb_ops;
+
+static void bb_scl_hi_zynq(bb_bus dat) { bb_scl_hi_t( dat, 1 ); }
+static void bb_scl_lo_zynq(bb_bus dat) { bb_scl_lo_t( dat, 1 ); }
+static void bb_sda_hi_zynq(bb_bus dat) { bb_sda_hi_t( dat, 1 ); }
+static void bb_sda_lo_zynq(bb_bus dat) { bb_sda_lo_t( dat, 1 ); }
+static int  bb_sda_get_zynq(bb_bus dat) { return bb_sda_get_t( dat, 1 ); }
+
+static const bb_ops bb_ops_gpio = {
+	scl_hi:  bb_scl_hi,
+	scl_lo:  bb_scl_lo,
+	sda_hi:  bb_sda_hi,
+	sda_lo:  bb_sda_lo,
+	sda_get: bb_sda_get,
+};
+
+static const bb_ops bb_ops_zynq = {
+	scl_hi:  bb_scl_hi_zynq,
+	scl_lo:  bb_scl_lo_zynq,
+	sda_hi:  bb_sda_hi_zynq,
+	sda_lo:  bb_sda_lo_zynq,
+	sda_get: bb_sda_get_zynq,
+};
+
+/* as bb_write_byte_t() */
+static int
+bb_write_byte_generic(bb_bus dat, const bb_ops *o, uint8_t byte)
+{
+int bit, val = 0;
+	/* the 9th clock (SDA released) is the ACK */
+	for ( bit = 0; bit < 9; bit++ ) {
+		if ( bit == 8 || (byte & 0x80) ) {
+			o->sda_hi( dat );
+		} else {
+			o->sda_lo( dat );
+		}
+		byte <<= 1;
+		spin( dat->tim.low );
+		o->scl_hi( dat );
+		spin( dat->tim.high );
+		val = o->sda_get( dat );
+		o->scl_lo( dat );
+	}
+	return ! val;
+}
+
+BB_INLINE void bb_bench_t(bb_bus dat, const int direct)
+{
+unsigned i;
+	for ( i = 0; i < BENCH_RUNS; i++ )
+		bb_write_byte_t( dat, 0xff, direct );
+}
+
+/* Bytes of 1s with all waits zero: SDA stays released, i.e., there is
+ * no START and an idle bus is not disturbed.
+ */
+int
+i2c_bb_bench(i2c_bus p, double *ns_generic, double *ns_special, const char **kind)
+{
+bb_bus        b = (bb_bus)p;
+const bb_ops *o;
+bb_tim        tim;
+uint64_t      t0, t_gen, t_spc;
+unsigned      i;
+
+	if ( p->be != &i2c_backend_bb ) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	o   = b->direct ? &bb_ops_zynq : &bb_ops_gpio;
+	tim = b->tim;
+	memset( &b->tim, 0, sizeof(b->tim) );
+	b->err = 0;
+
+	o->sda_hi( b );
+	o->scl_lo( b );
+	t0 = i2c_ts_now();
+	for ( i = 0; i < BENCH_RUNS; i++ )
+		bb_write_byte_generic( b, o, 0xff );
+	t_gen = i2c_ts_now() - t0;
+	t0 = i2c_ts_now();
+	if ( b->direct )
+		bb_bench_t( b, 1 );
+	else
+		bb_bench_t( b, 0 );
+	t_spc = i2c_ts_now() - t0;
+	o->scl_hi( b );
+
+	b->tim = tim;
+	if ( b->err ) {
+		errno  = b->err;
+		b->err = 0;
+		return -1;
+	}
+	*ns_generic = (double)t_gen / (9.0 * BENCH_RUNS);
+	*ns_special = (double)t_spc / (9.0 * BENCH_RUNS);
+	*kind       = b->direct ? "zynq" : "gpio";
+	return 0;
+}
+
+/* busy-wait for 'ns' less the pin operation 'cost', but never shorter
+ * than the spec minimum 'min' (we can't tell where within an operation
+ * the pin actually changes)
+ */
+static unsigned
+loops(uint64_t ns, uint64_t cost, uint64_t min, uint64_t loop_ns)
+{
+	ns = ns > cost ? ns - cost : 0;
+	if ( ns < min )
+		ns = min;
+	return ns * 1000000 / loop_ns;
+}
+
+/* Spin counts for the requested rate: time the spin loop, then the
+ * pin operations (which only shorten SCL low/high beyond the spec
+ * minimums to approach the requested period).
+ */
+static int
+calibrate(bb_bus b)
+{
+const bb_spec *s;
+uint64_t       t0, loop_ns, op_ns, period, low, high;
+unsigned       i;
+
+	for ( s = specs; s->khz < b->khz; s++ )
+		;
+	/* ns per 1M iterations: fastest of many short runs (which are not
+	 * likely to be preempted; the first ones may still see a low CPU
+	 * clock), i.e., the waits are never shorter than computed
+	 */
+	loop_ns = (uint64_t)-1;
+	for ( i = 0; i < SPIN_RUNS; i++ ) {
+		t0 = i2c_ts_now();
+		spin( 10000 );
+		if ( (t0 = i2c_ts_now() - t0) < loop_ns )
+			loop_ns = t0;
+	}
+	loop_ns *= 100;
+	if ( ! loop_ns )
+		loop_ns = 1;
+
+	/* a clock (at the spec minimums) is the waits plus 3 pin operations
+	 * (SCL high incl. read-back, SDA sample, SCL low)
+	 */
+	b->tim.low  = loops( 0, 0, s->low,  loop_ns );
+	b->tim.high = loops( 0, 0, s->high, loop_ns );
+	op_ns  = b->direct ? bb_clock_time_t( b, 1 ) : bb_clock_time_t( b, 0 );
+	t0     = (uint64_t)(b->tim.low + b->tim.high) * loop_ns / 1000000;
+	op_ns  = op_ns > t0 ? (op_ns - t0) / 3 : 0;
+
+	period = 1000000 / b->khz;
+	low    = period / 2 > s->low  ? period / 2 : s->low;
+	high   = period > low + s->high ? period - low : s->high;
+
+	if ( s->low + s->high + 3 * op_ns > period ) {
+		fprintf(stderr,"i2clib: WARNING: SCL limited to ~%"PRIu64" kHz by I/O cost (%"PRIu64" ns/edge)\n",
+			(uint64_t)1000000 / (s->low + s->high + 3 * op_ns), op_ns);
+	}
+	/* SDA changes and is sampled during SCL low/high, resp. */
+	b->tim.low    = loops( low,  op_ns, s->low,    loop_ns );
+	b->tim.high   = loops( high, op_ns, s->high,   loop_ns );
+	b->tim.su_sta = loops( 0,    0,     s->su_sta, loop_ns );
+	b->tim.hd_sta = loops( 0,    0,     s->hd_sta, loop_ns );
+	b->tim.su_sto = loops( 0,    0,     s->su_sto, loop_ns );
+	b->tim.buf    = loops( 0,    0,     s->buf,    loop_ns );
+	return 0;
+}
+
+static i2c_bus
+bb_open(const char *spec)
+{
+bb_bus      b;
+int         sda_pin, scl_pin, sda_emio = 0, scl_emio = 0;
+unsigned    pins[2];
+gpio_handle hdls[2];
+char        pinspec[256];
+char       *opt, *sp;
+int         khz = KHZ_DFLT;
+
+	if ( strlen( spec ) >= sizeof(pinspec) ) {
+		errno = EINVAL;
+		return 0;
+	}
+	strcpy( pinspec, spec );
+	strtok_r( pinspec, ",", &sp );
+	while ( (opt = strtok_r( 0, ",", &sp )) ) {
+		if ( 0 == strncmp( opt, "khz=", 4 ) ) {
+			if ( 1 == sscanf( opt, "khz=%i", &khz ) && khz >= 1 && khz <= KHZ_MAX )
+				continue;
+		} else if ( i2c_opt_known( opt ) ) {
+			continue;
+		}
+		fprintf(stderr,"i2clib: invalid option '%s' (khz=1..%d)\n", opt, KHZ_MAX);
+		errno = EINVAL;
+		return 0;
+	}
+	if        ( 2 == sscanf(pinspec, "mio%d/mio%d",   &scl_pin, &sda_pin ) ) {
+	} else if ( 2 == sscanf(pinspec, "emio%d/mio%d",  &scl_pin, &sda_pin ) ) {
+		scl_emio = 1;
+	} else if ( 2 == sscanf(pinspec, "mio%d/emio%d",  &scl_pin, &sda_pin ) ) {
+		sda_emio = 1;
+	} else if ( 2 == sscanf(pinspec, "emio%d/emio%d", &scl_pin, &sda_pin ) ) {
+		scl_emio = 1;
+		sda_emio = 1;
+	} else {
+		fprintf(stderr, "i2clib: invalid bit-bang configuration, must be [e]mio[0-9]+[/][e]mio[0-9]+\n");
+		errno = EINVAL;
+		return 0;
+	}
+	pins[0] = scl_emio ? GPIO_EMIO( scl_pin ) : scl_pin;
+	pins[1] = sda_emio ? GPIO_EMIO( sda_pin ) : sda_pin;
+	if ( ! (b = calloc( 1, sizeof(*b) )) ) {
+		fprintf(stderr,"i2clib: no memory\n");
+		return 0;
+	}
+	b->hdr.be = &i2c_backend_bb;
+	b->khz    = khz;
+	if ( gpio_open_many( pins, 2, hdls ) ) {
+		fprintf(stderr, "i2clib: unable to open GPIO for SCL/SDA pins %d/%d\n", scl_pin, sda_pin);
+		free( b );
+		return 0;
+	}
+	b->scl = hdls[0];
+	b->sda = hdls[1];
+
+	if ( gpio_inp( b->sda ) || gpio_inp( b->scl ) ) {
+		fprintf(stderr, "i2clib: unable to release SCL/SDA\n");
+		goto bail;
+	}
+	/* Ignore return value of gpio_clr; it signals failure but
+	 * the output is cleared anyways
+	 */
+	gpio_clr( b->scl );
+	gpio_clr( b->sda );
+	/* inlined register access unless tracing or another backend */
+	b->direct = ! bb_direct_init( b );
+	if ( calibrate( b ) || b->err ) {
+		fprintf(stderr, "i2clib: unable to calibrate the bit-bang engine\n");
+		goto bail;
+	}
+	return &b->hdr;
+
+bail:
+	bb_release( b );
+	free( b );
+	return 0;
+}
+
+static void
+bb_close(i2c_bus p)
+{
+bb_bus b = (bb_bus)p;
+	bb_release( b );
+	free( b );
+}
+
+const i2c_backend i2c_backend_bb = {
+	name:  "bb",
+	open:  bb_open,
+	close: bb_close,
+	xfer:  bb_xfer,
+};
@@ -0,0 +1,83 @@
+/* i2clib backend for the kernel's i2c-dev interface (/dev/i2c-<X>):
+ * a transaction is one I2C_RDWR, i.e., the driver issues it as a single
+ * combined transaction.
+ */
+
+#include <i2clib-impl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+typedef struct cdev_bus_ {
+	struct i2c_bus_ hdr;
+	int             fd;
+} *cdev_bus;
+
+static i2c_bus
+cdev_open(const char *spec)
+{
+cdev_bus b;
+char     dev[256];
+char    *opt, *sp;
+
+	if ( strlen( spec ) >= sizeof(dev) ) {
+		errno = EINVAL;
+		return 0;
+	}
+	/* no options of our own */
+	strcpy( dev, spec );
+	strtok_r( dev, ",", &sp );
+	while ( (opt = strtok_r( 0, ",", &sp )) ) {
+		if ( ! i2c_opt_known( opt ) ) {
+			fprintf(stderr,"i2clib: invalid option '%s'\n", opt);
+			errno = EINVAL;
+			return 0;
+		}
+	}
+	if ( ! (b = calloc( 1, sizeof(*b) )) ) {
+		fprintf(stderr,"i2clib: no memory\n");
+		return 0;
+	}
+	b->hdr.be = &i2c_backend_cdev;
+	if ( (b->fd = open( dev, O_RDWR )) < 0 ) {
+		fprintf(stderr,"i2clib: error opening device %s: %s\n", dev, strerror(errno));
+		free( b );
+		return 0;
+	}
+	return &b->hdr;
+}
+
+static void
+cdev_close(i2c_bus p)
+{
+cdev_bus b = (cdev_bus)p;
+	close( b->fd );
+	free( b );
+}
+
+static int
+cdev_xfer(i2c_bus p, struct i2c_msg msgs[], unsigned n)
+{
+cdev_bus                   b = (cdev_bus)p;
+struct i2c_rdwr_ioctl_data d;
+int                        got;
+
+	d.msgs  = msgs;
+	d.nmsgs = n;
+	/* errno is the driver's */
+	if ( (got = ioctl( b->fd, I2C_RDWR, &d )) < 0 )
+		return 0;
+	return got;
+}
+
+const i2c_backend i2c_backend_cdev = {
+	name:  "cdev",
+	open:  cdev_open,
+	close: cdev_close,
+	xfer:  cdev_xfer,
+};
@@ -0,0 +1,39 @@
+#ifndef I2CLIB_IMPL_H
+#define I2CLIB_IMPL_H
+
+/* i2clib internals; shared by the backends -- not for applications */
+
+#include <i2clib.h>
+#include <stdint.h>
+
+/* 'spec' is the complete spec passed to i2c_open().
+ * 'xfer' returns the number of messages completed (see i2c_xfer()).
+ */
+typedef struct i2c_backend_ {
+	const char *name;
+	i2c_bus   (*open) (const char *spec);
+	void      (*close)(i2c_bus b);
+	int       (*xfer) (i2c_bus b, struct i2c_msg msgs[], unsigned n);
+} i2c_backend;
+
+/* every backend's bus starts with this header (allocate zeroed) */
+struct i2c_bus_ {
+	const i2c_backend *be;
+};
+
+extern const i2c_backend i2c_backend_mmio;
+extern const i2c_backend i2c_backend_cdev;
+extern const i2c_backend i2c_backend_bb;
+
+/* Options of any backend ("off=", "poll", "khz="): a spec may carry
+ * those of other backends (i2cm passes its options regardless of the
+ * device); a backend ignores them but rejects unknown ones.
+ */
+int
+i2c_opt_known(const char *opt);
+
+/* CLOCK_MONOTONIC in ns */
+uint64_t
+i2c_ts_now(void);
+
+#endif
@@ -0,0 +1,201 @@
+/* i2clib backend for the i2c master in fabric/PL ("mmio").
+ *
+ * Spec: "<uio-device>[,off=<n>][,poll]"
+ *   off  : byte offset of the registers in the device
+ *   poll : busy-poll the status for completion rather than block for
+ *          the (UIO) interrupt
+ *
+ * The core executes one command (START + address, byte write, byte
+ * read, STOP) at a time. A transaction is issued back-to-back: the
+ * next command is written as soon as the previous one is done.
+ */
+
+#include <i2clib-impl.h>
+#include <arm-mmio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define CSR 0
+
+#define CSR_CLR 0
+
+#define MAP_LEN 0x1000
+
+#define CMD_START (1<<(8+0))
+#define CMD_STOP  (1<<(8+1))
+#define CMD_READ  (1<<(8+2))
+#define CMD_WRITE (1<<(8+3))
+#define CMD_NACK  (1<<(8+4))
+
+#define ST_DON (1<<(16+0))
+#define ST_ERR (1<<(16+1))
+#define ST_ALO (1<<(16+2))
+#define ST_BBL (1<<(16+3))
+#define ST_ACK (1<<(16+4))
+
+#define I2C_RD 1
+
+/* a byte takes ~90us at 100kHz; allow for clock stretching */
+#define TMO_NS      100000000ULL
+#define POLL_CHUNK  64          /* register reads between clock checks */
+
+typedef struct mmio_bus_ {
+	struct i2c_bus_ hdr;
+	Arm_MMIO        mio;
+	int             poll;
+} *mmio_bus;
+
+/* execute one command; returns the status or -1 (errno set) */
+static int64_t
+mmio_cmd(mmio_bus b, uint32_t cmd)
+{
+uint32_t irq_ena = 1;
+uint32_t status;
+uint64_t end = 0, now;
+unsigned i;
+
+	/* clear status */
+	iowrite32(b->mio, CSR, CSR_CLR);
+	if ( b->poll ) {
+		iowrite32(b->mio, CSR, cmd);
+		while ( 1 ) {
+			for ( i = 0; i < POLL_CHUNK; i++ ) {
+				if ( ((status = ioread32(b->mio, CSR)) & ST_DON) )
+					goto done;
+			}
+			now = i2c_ts_now();
+			if ( ! end ) {
+				end = now + TMO_NS;
+			} else if ( now >= end ) {
+				errno = ETIMEDOUT;
+				return -1;
+			}
+		}
+	} else {
+		/* enable IRQ   */
+		write( b->mio->fd, &irq_ena, sizeof(irq_ena) );
+		iowrite32(b->mio, CSR, cmd);
+		/* block for completion */
+		if ( sizeof(status) != read( b->mio->fd, &status, sizeof(status) ) ) {
+			fprintf(stderr,"i2clib: blocking for IRQ -- read error\n");
+			errno = EIO;
+			return -1;
+		}
+		status = ioread32(b->mio, CSR);
+	}
+
+done:
+	if ( (status & ST_ERR) ) {
+		if ( (status & ST_ALO) )
+			errno = EAGAIN;
+		else if ( (status & ST_BBL) )
+			errno = EBUSY;
+		else
+			errno = EIO;
+		return -1;
+	}
+	return status;
+}
+
+static i2c_bus
+mmio_open(const char *spec)
+{
+mmio_bus b;
+char     dev[256];
+char    *opt, *sp;
+int      off = 0;
+
+	if ( strlen( spec ) >= sizeof(dev) ) {
+		errno = EINVAL;
+		return 0;
+	}
+	if ( ! (b = calloc( 1, sizeof(*b) )) ) {
+		fprintf(stderr,"i2clib: no memory\n");
+		return 0;
+	}
+	b->hdr.be = &i2c_backend_mmio;
+	strcpy( dev, spec );
+	strtok_r( dev, ",", &sp );
+	while ( (opt = strtok_r( 0, ",", &sp )) ) {
+		if ( 0 == strcmp( opt, "poll" ) ) {
+			b->poll = 1;
+			continue;
+		}
+		if ( 0 == strncmp( opt, "off=", 4 ) ) {
+			if ( 1 == sscanf( opt, "off=%i", &off ) && off >= 0 )
+				continue;
+		} else if ( i2c_opt_known( opt ) ) {
+			continue;
+		}
+		fprintf(stderr,"i2clib: invalid option '%s' (off=<n>, poll)\n", opt);
+		errno = EINVAL;
+		free( b );
+		return 0;
+	}
+	if ( ! (b->mio = arm_mmio_init_2( dev, MAP_LEN, off )) ) {
+		fprintf(stderr,"i2clib: unable to open device '%s'\n", dev);
+		free( b );
+		return 0;
+	}
+	return &b->hdr;
+}
+
+static void
+mmio_close(i2c_bus p)
+{
+mmio_bus b = (mmio_bus)p;
+	arm_mmio_exit( b->mio );
+	free( b );
+}
+
+static int
+mmio_xfer(i2c_bus p, struct i2c_msg msgs[], unsigned n)
+{
+mmio_bus        b = (mmio_bus)p;
+struct i2c_msg *m;
+unsigned        i, j;
+int64_t         st;
+int             rd, err = 0;
+
+	for ( i = 0; i < n; i++ ) {
+		m  = &msgs[i];
+		rd = !! (m->flags & I2C_M_RD);
+		/* (repeated) START + address */
+		if ( (st = mmio_cmd( b, CMD_START | CMD_WRITE | (m->addr << 1) | (rd ? I2C_RD : 0) )) < 0 )
+			goto bail;
+		if ( ! (st & ST_ACK) ) {
+			errno = ENXIO;
+			goto bail;
+		}
+		for ( j = 0; j < m->len; j++ ) {
+			if ( rd ) {
+				if ( (st = mmio_cmd( b, CMD_READ | (j == m->len - 1 ? CMD_NACK : 0) )) < 0 )
+					goto bail;
+				m->buf[j] = st & 0xff;
+			} else {
+				if ( (st = mmio_cmd( b, CMD_WRITE | m->buf[j] )) < 0 )
+					goto bail;
+				if ( ! (st & ST_ACK) ) {
+					errno = EIO;
+					goto bail;
+				}
+			}
+		}
+	}
+
+bail:
+	err = errno;
+	mmio_cmd( b, CMD_STOP );
+	errno = err;
+	return i;
+}
+
+const i2c_backend i2c_backend_mmio = {
+	name:  "mmio",
+	open:  mmio_open,
+	close: mmio_close,
+	xfer:  mmio_xfer,
+};
@@ -0,0 +1,292 @@
+/* Cached register map (see i2clib.h).
+ *
+ * The shadow is an array parallel to the profile's register
+ * descriptions (devices have a handful of registers).
+ */
+
+#include <i2clib-impl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+typedef struct shadow_ {
+	unsigned val;
+	int      valid;
+} shadow;
+
+struct i2c_regmap_ {
+	i2c_bus                bus;
+	const i2c_regmap_desc *d;
+	unsigned               addr;
+	shadow                *sh;
+	char                  *path;
+	unsigned long          writes, skipped;
+};
+
+/* WM8731 audio codec: 7-bit register, 9-bit value, write-only */
+static const i2c_reg_desc wm8731_regs[] = {
+	{ "linvol",  0x0, 0x097, I2C_REG_WO },
+	{ "rinvol",  0x1, 0x097, I2C_REG_WO },
+	{ "lout1v",  0x2, 0x079, I2C_REG_WO },
+	{ "rout1v",  0x3, 0x079, I2C_REG_WO },
+	{ "apana",   0x4, 0x00a, I2C_REG_WO },
+	{ "apdigi",  0x5, 0x008, I2C_REG_WO },
+	{ "pwr",     0x6, 0x09f, I2C_REG_WO },
+	{ "iface",   0x7, 0x00a, I2C_REG_WO },
+	{ "srate",   0x8, 0x000, I2C_REG_WO },
+	{ "active",  0x9, 0x000, I2C_REG_WO },
+	{ "reset",   0xf, 0x000, I2C_REG_WO | I2C_REG_VOLATILE | I2C_REG_RESET },
+};
+
+static const i2c_regmap_desc profiles[] = {
+	{
+		name:     "wm8731",
+		addr:     0x1a,
+		reg_bits: 7,
+		val_bits: 9,
+		nregs:    sizeof(wm8731_regs)/sizeof(wm8731_regs[0]),
+		regs:     wm8731_regs,
+	},
+};
+
+const i2c_regmap_desc *
+i2c_regmap_profile(const char *name)
+{
+unsigned i;
+	for ( i = 0; i < sizeof(profiles)/sizeof(profiles[0]); i++ ) {
+		if ( 0 == strcmp( profiles[i].name, name ) )
+			return &profiles[i];
+	}
+	return 0;
+}
+
+static int
+idx_of(const i2c_regmap_desc *d, unsigned reg)
+{
+unsigned i;
+	for ( i = 0; i < d->nregs; i++ ) {
+		if ( d->regs[i].reg == reg )
+			return i;
+	}
+	return -1;
+}
+
+int
+i2c_regmap_reg(const i2c_regmap_desc *d, const char *name)
+{
+unsigned i;
+int      reg, n;
+
+	for ( i = 0; i < d->nregs; i++ ) {
+		if ( 0 == strcmp( d->regs[i].name, name ) )
+			return d->regs[i].reg;
+	}
+	if ( 1 == sscanf( name, "%i%n", &reg, &n ) && ! name[n] && idx_of( d, reg ) >= 0 )
+		return reg;
+	return -1;
+}
+
+static void
+reset(i2c_regmap m)
+{
+unsigned i;
+	for ( i = 0; i < m->d->nregs; i++ ) {
+		m->sh[i].val   = m->d->regs[i].dflt;
+		m->sh[i].valid = ! (m->d->regs[i].flags & I2C_REG_VOLATILE);
+	}
+}
+
+/* text: one '<reg> <val>' per line */
+static void
+load(i2c_regmap m)
+{
+FILE    *f;
+unsigned reg, val;
+int      i;
+
+	if ( ! (f = fopen( m->path, "r" )) )
+		return;
+	while ( 2 == fscanf( f, "%x %x", &reg, &val ) ) {
+		if ( (i = idx_of( m->d, reg )) >= 0 && ! (m->d->regs[i].flags & I2C_REG_VOLATILE) ) {
+			m->sh[i].val   = val;
+			m->sh[i].valid = 1;
+		}
+	}
+	fclose( f );
+}
+
+/* write a new file and rename it, i.e., readers never see a partial one */
+static int
+save(i2c_regmap m)
+{
+FILE    *f;
+char    *tmp;
+unsigned i;
+
+	if ( ! (tmp = malloc( strlen( m->path ) + sizeof(".tmp") )) )
+		return -1;
+	sprintf( tmp, "%s.tmp", m->path );
+	if ( ! (f = fopen( tmp, "w" )) ) {
+		fprintf(stderr,"i2clib: unable to save registers to '%s': %s\n", tmp, strerror(errno));
+		free( tmp );
+		return -1;
+	}
+	for ( i = 0; i < m->d->nregs; i++ ) {
+		if ( m->sh[i].valid )
+			fprintf( f, "0x%02x 0x%04x\n", m->d->regs[i].reg, m->sh[i].val );
+	}
+	if ( fclose( f ) || rename( tmp, m->path ) ) {
+		fprintf(stderr,"i2clib: unable to save registers to '%s': %s\n", m->path, strerror(errno));
+		unlink( tmp );
+		free( tmp );
+		return -1;
+	}
+	free( tmp );
+	return 0;
+}
+
+i2c_regmap
+i2c_regmap_open(i2c_bus bus, const i2c_regmap_desc *d, int addr, const char *path)
+{
+i2c_regmap m;
+
+	if ( (d->reg_bits + d->val_bits) % 8 || d->reg_bits + d->val_bits > 32 || addr > 0x7f ) {
+		errno = EINVAL;
+		return 0;
+	}
+	if (    ! (m = calloc( 1, sizeof(*m) ))
+	     || ! (m->sh = calloc( d->nregs, sizeof(*m->sh) ))
+	     || ( path && ! (m->path = strdup( path )) ) ) {
+		fprintf(stderr,"i2clib: no memory\n");
+		if ( m ) {
+			free( m->sh );
+			free( m );
+		}
+		return 0;
+	}
+	m->bus  = bus;
+	m->d    = d;
+	m->addr = addr < 0 ? d->addr : addr;
+	if ( m->path )
+		load( m );
+	return m;
+}
+
+int
+i2c_regmap_close(i2c_regmap m)
+{
+int rval = 0;
+	if ( m->path )
+		rval = save( m );
+	free( m->path );
+	free( m->sh );
+	free( m );
+	return rval;
+}
+
+int
+i2c_regmap_write(i2c_regmap m, unsigned reg, unsigned val)
+{
+uint8_t        buf[4];
+struct i2c_msg msg;
+uint32_t       w;
+int            i, n;
+
+	if ( (i = idx_of( m->d, reg )) < 0 || (val >> m->d->val_bits) ) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ( m->sh[i].valid && m->sh[i].val == val ) {
+		m->skipped++;
+		return 0;
+	}
+	w         = (reg << m->d->val_bits) | val;
+	msg.addr  = m->addr;
+	msg.flags = 0;
+	msg.len   = (m->d->reg_bits + m->d->val_bits) / 8;
+	msg.buf   = buf;
+	for ( n = msg.len - 1; n >= 0; n--, w >>= 8 )
+		buf[n] = w & 0xff;
+	m->writes++;
+	if ( i2c_xfer( m->bus, &msg, 1 ) < 1 ) {
+		m->sh[i].valid = 0;
+		return -1;
+	}
+	if ( (m->d->regs[i].flags & I2C_REG_RESET) ) {
+		reset( m );
+	} else if ( ! (m->d->regs[i].flags & I2C_REG_VOLATILE) ) {
+		m->sh[i].val   = val;
+		m->sh[i].valid = 1;
+	}
+	return 1;
+}
+
+int
+i2c_regmap_read(i2c_regmap m, unsigned reg, unsigned *val)
+{
+uint8_t        rbuf[4], wbuf[4];
+struct i2c_msg msgs[2];
+uint32_t       w;
+int            i, n;
+
+	if ( (i = idx_of( m->d, reg )) < 0 ) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ( m->sh[i].valid ) {
+		*val = m->sh[i].val;
+		return 0;
+	}
+	if ( (m->d->regs[i].flags & I2C_REG_WO) || (m->d->reg_bits % 8) || (m->d->val_bits % 8) ) {
+		errno = ENODATA;
+		return -1;
+	}
+	msgs[0].addr  = m->addr;
+	msgs[0].flags = 0;
+	msgs[0].len   = m->d->reg_bits / 8;
+	msgs[0].buf   = wbuf;
+	for ( n = msgs[0].len - 1, w = reg; n >= 0; n--, w >>= 8 )
+		wbuf[n] = w & 0xff;
+	msgs[1].addr  = m->addr;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len   = m->d->val_bits / 8;
+	msgs[1].buf   = rbuf;
+	if ( i2c_xfer( m->bus, msgs, 2 ) < 2 )
+		return -1;
+	for ( n = 0, w = 0; n < msgs[1].len; n++ )
+		w = (w << 8) | rbuf[n];
+	if ( ! (m->d->regs[i].flags & I2C_REG_VOLATILE) ) {
+		m->sh[i].val   = w;
+		m->sh[i].valid = 1;
+	}
+	*val = w;
+	return 0;
+}
+
+int
+i2c_regmap_update(i2c_regmap m, unsigned reg, unsigned mask, unsigned val)
+{
+unsigned old;
+	if ( i2c_regmap_read( m, reg, &old ) )
+		return -1;
+	return i2c_regmap_write( m, reg, (old & ~mask) | (val & mask) );
+}
+
+void
+i2c_regmap_invalidate(i2c_regmap m)
+{
+unsigned i;
+	for ( i = 0; i < m->d->nregs; i++ )
+		m->sh[i].valid = 0;
+}
+
+void
+i2c_regmap_stats(i2c_regmap m, unsigned long *writes, unsigned long *skipped)
+{
+	if ( writes )
+		*writes  = m->writes;
+	if ( skipped )
+		*skipped = m->skipped;
+}
@@ -0,0 +1,79 @@
+#include <i2clib-impl.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+uint64_t
+i2c_ts_now(void)
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+int
+i2c_opt_known(const char *opt)
+{
+	return    0 == strcmp ( opt, "poll"    )
+	       || 0 == strncmp( opt, "off=", 4 )
+	       || 0 == strncmp( opt, "khz=", 4 );
+}
+
+/* the device names i2cm always accepted */
+static const i2c_backend *
+select_be(const char *spec)
+{
+	if ( strstr( spec, "uio" ) || strstr( spec, "mem" ) )
+		return &i2c_backend_mmio;
+	if ( strstr( spec, "i2c-" ) )
+		return &i2c_backend_cdev;
+	if ( strstr( spec, "mio" ) )
+		return &i2c_backend_bb;
+	return 0;
+}
+
+i2c_bus
+i2c_open(const char *spec)
+{
+const i2c_backend *be;
+
+	if ( ! spec ) {
+		errno = EINVAL;
+		return 0;
+	}
+	if ( ! (be = select_be( spec )) ) {
+		fprintf(stderr,"i2clib: don't know how to handle '%s' (/dev/uio<X>, /dev/i2c-<X> or [e]mio<X>/[e]mio<Y>)\n", spec);
+		errno = EINVAL;
+		return 0;
+	}
+	return be->open( spec );
+}
+
+void
+i2c_close(i2c_bus b)
+{
+	if ( b )
+		b->be->close( b );
+}
+
+const char *
+i2c_backend_name(i2c_bus b)
+{
+	return b->be->name;
+}
+
+int
+i2c_xfer(i2c_bus b, struct i2c_msg msgs[], unsigned n)
+{
+unsigned i;
+	for ( i = 0; i < n; i++ ) {
+		if ( (msgs[i].addr & ~0x7f) || (msgs[i].flags & ~I2C_M_RD) ) {
+			fprintf(stderr,"i2clib: unsupported message (addr 0x%x, flags 0x%x)\n", msgs[i].addr, msgs[i].flags);
+			errno = EINVAL;
+			/* nothing executed */
+			return 0;
+		}
+	}
+	return b->be->xfer( b, msgs, n );
+}
@@ -0,0 +1,126 @@
+#ifndef I2CLIB_H
+#define I2CLIB_H
+
+#include <stdint.h>
+#include <linux/i2c.h>
+
+/* I2C master transactions with pluggable backends */
+
+typedef struct i2c_bus_ *i2c_bus;
+
+/* Open a bus; 'spec' selects the backend (as i2cm's -d):
+ *
+ *   "/dev/uio<X>[,off=<n>][,poll]"
+ *             : i2c master in fabric/PL; registers at byte offset 'n'
+ *               of the UIO device (also /dev/mem); 'poll': busy-poll
+ *               for command completion rather than block for the IRQ
+ *   "/dev/i2c-<X>"
+ *             : PS i2c master X (kernel driver)
+ *   "[e]mio<X>/[e]mio<Y>[,khz=<n>]"
+ *             : bit-bang via gpiolib, SCL on pin X, SDA on pin Y
+ *               (direct register access with the "zynq" backend);
+ *               SCL rate 'n' kHz (default 100, 400: fast-mode)
+ *
+ * Options of the other backends ("off=", "poll", "khz=") are ignored,
+ * i.e., a tool may pass all it has; unknown ones are rejected.
+ * Returns NULL on error.
+ */
+i2c_bus i2c_open(const char *spec);
+
+void    i2c_close(i2c_bus);
+
+/* Backend of an open bus: "mmio", "cdev" or "bb" */
+const char *i2c_backend_name(i2c_bus);
+
+/* Execute a transaction: START, the messages (struct i2c_msg of
+ * <linux/i2c.h>: 7-bit 'addr', 'flags' 0 (write) or I2C_M_RD, 'len'
+ * bytes at 'buf') separated by repeated STARTs, STOP. The last byte of
+ * a read is NACKed.
+ * Returns the number of messages completed; less than 'n' means
+ * msgs[<return value>] failed (the kernel backend can't tell which
+ * and returns 0; errno is the driver's, e.g., EREMOTEIO for a NACK),
+ * errno:
+ *   ENXIO     : address not ACKed
+ *   EIO       : data not ACKed or controller error
+ *   EAGAIN    : arbitration lost
+ *   EBUSY     : bus busy
+ *   ETIMEDOUT : no completion (clock stretched too long)
+ * A STOP is issued in any case.
+ */
+int     i2c_xfer(i2c_bus, struct i2c_msg msgs[], unsigned n);
+
+/* Bit-bang backend only: per-bit cost (incl. the ACK clock) of the
+ * engine specialized for the pin access method ('kind' is "gpio" or
+ * "zynq") and of a generic one (pin operations via function pointers).
+ * NOTE: SCL runs unthrottled; SDA stays released (no START).
+ * Returns 0 on success, -1 (errno ENOTSUP) for other backends.
+ */
+int     i2c_bb_bench(i2c_bus, double *ns_generic, double *ns_special, const char **kind);
+
+/* Cached register map ("regmap") of a device with register/value
+ * writes: a write is one message of (reg << val_bits | val), reg_bits +
+ * val_bits long, MSB first; a read (of a readable register, byte-sized
+ * reg_bits and val_bits) writes the register number and reads the
+ * value in a combined transaction.
+ *
+ * A shadow copy of the registers is kept; writes of a value the
+ * register is known to hold are skipped, registers known to the shadow
+ * are read from there (write-only registers of, e.g., codecs, can't be
+ * read at all). Writing the reset register (I2C_REG_RESET) puts all
+ * registers to their defaults. With a 'path' (put it on a tmpfs, e.g.,
+ * /run, so it doesn't survive a power-cycle) the shadow is loaded from
+ * there and saved by i2c_regmap_close(), i.e., it persists across
+ * invocations.
+ */
+#define I2C_REG_WO        1  /* not readable                          */
+#define I2C_REG_VOLATILE  2  /* never cached                          */
+#define I2C_REG_RESET     4  /* writing it resets all to their 'dflt' */
+
+typedef struct i2c_reg_desc_ {
+	const char *name;
+	unsigned    reg;
+	unsigned    dflt;         /* value after reset */
+	unsigned    flags;
+} i2c_reg_desc;
+
+typedef struct i2c_regmap_desc_ {
+	const char         *name;
+	unsigned            addr;         /* default slave address */
+	unsigned            reg_bits;
+	unsigned            val_bits;
+	unsigned            nregs;
+	const i2c_reg_desc *regs;
+} i2c_regmap_desc;
+
+typedef struct i2c_regmap_ *i2c_regmap;
+
+/* Built-in profiles by name ("wm8731"); NULL if unknown */
+const i2c_regmap_desc *i2c_regmap_profile(const char *name);
+
+/* Register number by name or number; -1 if the profile has no such */
+int        i2c_regmap_reg(const i2c_regmap_desc *, const char *name);
+
+/* 'addr' < 0: the profile's; 'path' may be NULL (no persistence) */
+i2c_regmap i2c_regmap_open(i2c_bus, const i2c_regmap_desc *, int addr, const char *path);
+
+/* Saves the shadow; returns -1 if that failed */
+int        i2c_regmap_close(i2c_regmap);
+
+/* Returns 1 if written, 0 if skipped (unchanged), -1 on error (errno
+ * as i2c_xfer(); the register's state is unknown afterwards).
+ */
+int        i2c_regmap_write(i2c_regmap, unsigned reg, unsigned val);
+
+/* Read-modify-write of the bits in 'mask' */
+int        i2c_regmap_update(i2c_regmap, unsigned reg, unsigned mask, unsigned val);
+
+/* From the shadow if known, the device otherwise; ENODATA if neither */
+int        i2c_regmap_read(i2c_regmap, unsigned reg, unsigned *val);
+
+/* Forget the shadow (e.g., the device was power-cycled) */
+void       i2c_regmap_invalidate(i2c_regmap);
+
+/* Writes issued / skipped */
+void       i2c_regmap_stats(i2c_regmap, unsigned long *writes, unsigned long *skipped);
+
+#endif
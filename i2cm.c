@@ -1,476 +1,499 @@
-#include <arm-mmio.h>
+#include <i2clib.h>
 #include <stdio.h>
-#include <time.h>
 #include <string.h>
 #include <stdlib.h>
 #include <getopt.h>
-#include <linux/i2c-dev.h>
-#include <sys/fcntl.h>
-#include <sys/ioctl.h>
 #include <errno.h>
-#include <unistd.h>
-#include <gpiolib.h>
-
-#define CSR 0
-
-#define CSR_CLR 0
-
-#define MAP_LEN 0x1000
-
-#define CMD_START (1<<(8+0))
-#define CMD_STOP  (1<<(8+1))
-#define CMD_READ  (1<<(8+2))
-#define CMD_WRITE (1<<(8+3))
-#define CMD_NACK  (1<<(8+4))
+#include <inttypes.h>
+#include <time.h>
 
-#define ST_DON (1<<(16+0))
-#define ST_ERR (1<<(16+1))
-#define ST_ALO (1<<(16+2))
-#define ST_BBL (1<<(16+3))
-#define ST_ACK (1<<(16+4))
+#define MAXBUF 1024
 
-#define IS_ERR(status) ((status) & ST_ERR)
+/* image mode */
+#define EE_MAXLEN   65536
+#define EE_CHUNK    256            /* read transaction size            */
+#define EE_WR_TMO   100            /* ms; write cycle is <= 10ms typ.  */
 
-#define FLAG_POLL (1<<0)
+/* script mode */
+#define SC_MAXSEG   16             /* segments per transaction */
 
-#define MAXBUF 1024
+/* addressable bytes: 16-bit or 8-bit + 3 block select bits */
+#define EE_SPACE(alen) ( 2 == (alen) ? 0x10000 : 0x800 )
 
-typedef struct CDevDat  {
-    uint8_t  buf[MAXBUF];
-    unsigned len;
-    int      fd;
-} CDevDat;
-
-typedef struct BBDat {
-    uint8_t     buf[MAXBUF];
-    unsigned    len;
-    gpio_handle sda;
-    gpio_handle scl;
-} BBDat;
-
-typedef struct i2c_io_ {
-	union {
-		Arm_MMIO mio;
-		CDevDat  dat;
-		BBDat    bbd;
-	} handle;
-	uint32_t (*sync_cmd)(struct i2c_io_ *io, uint32_t cmd);
-	void     (*cleanup) (struct i2c_io_ *io);
-	int      flags;
-} i2c_io;
-
-static void slp(unsigned us)
+static const char *
+xfer_err(int err, const struct i2c_msg *m)
 {
-struct timespec t;
-	t.tv_sec = 0;
-	t.tv_nsec = us * 1000;
-	nanosleep(&t, 0);
+	switch ( err ) {
+		case ENXIO:  return (m->flags & I2C_M_RD) ? "Missing ACK (Addressing slave (for RD))" : "Missing ACK (Addressing slave (for WR))";
+		case EIO:    return "Missing ACK (Sending values) or controller error";
+		case EAGAIN: return "arbitration lost";
+		case EBUSY:  return "bus busy";
+		default:     return strerror( err );
+	}
 }
 
-static void mmio_cleanup(struct i2c_io_ *io)
+/* EEPROM memory address: 'alen' bytes in 'wbuf'; with 1-byte addressing
+ * bits 8.. select the block (24C04..24C16) in the slave address.
+ * Returns the slave address.
+ */
+static int
+ee_addr(int slv_addr, int alen, unsigned off, uint8_t *wbuf)
 {
-	if ( io->handle.mio )
-		arm_mmio_exit(io->handle.mio);
+	if ( 2 == alen ) {
+		wbuf[0] = (off >> 8) & 0xff;
+		wbuf[1] = off & 0xff;
+		return slv_addr;
+	}
+	wbuf[0] = off & 0xff;
+	return slv_addr | ((off >> 8) & 7);
 }
 
-static uint32_t mmio_sync_cmd(i2c_io *io, uint32_t cmd)
+static int
+ee_read(i2c_bus bus, int slv_addr, int alen, unsigned off, uint8_t *buf, unsigned len)
 {
-uint32_t irq_ena = 1;
-uint32_t status;
-Arm_MMIO mio = io->handle.mio;
-
-	if ( ! mio ) {
-		return ST_ERR;
-	}
-
-	/* clear status */
-	iowrite32(mio, CSR, CSR_CLR);
-	/* enable IRQ   */
-	write( mio->fd, &irq_ena, sizeof(irq_ena) );
-	/* enable IRQ   */
-	/* issue command */
-	iowrite32(mio, CSR, cmd);
-	/* enable IRQ   */
-	/* block for completion */
-	if ( (io->flags & FLAG_POLL) ) {
-		while ( ! ((status = ioread32(mio, CSR)) & ST_DON) ) {
-			slp(100);
-		}
-	} else {
-		if ( sizeof(status) != read( mio->fd, &status, sizeof(status) ) ) {
-			fprintf(stderr,"Blocking for IRQ -- read error\n");
+uint8_t        wbuf[2];
+struct i2c_msg msgs[2];
+unsigned       l;
+int            done;
+
+	while ( len > 0 ) {
+		/* don't cross a block (1-byte addressing) */
+		l = EE_CHUNK - (off % EE_CHUNK);
+		if ( l > len )
+			l = len;
+		msgs[0].addr  = ee_addr( slv_addr, alen, off, wbuf );
+		msgs[0].flags = 0;
+		msgs[0].len   = alen;
+		msgs[0].buf   = wbuf;
+		msgs[1].addr  = msgs[0].addr;
+		msgs[1].flags = I2C_M_RD;
+		msgs[1].len   = l;
+		msgs[1].buf   = buf;
+		if ( (done = i2c_xfer( bus, msgs, 2 )) < 2 ) {
+			fprintf(stderr,"Error reading @0x%04x: %s\n", off, xfer_err( errno, &msgs[done] ));
+			return -1;
 		}
-		/* enable IRQ   */
-		status = ioread32(mio, CSR);
-		/* enable IRQ   */
+		off += l;
+		buf += l;
+		len -= l;
 	}
-
-	if ( IS_ERR(status) ) {
-		fprintf(stderr,"Error (status 0x%08"PRIx32") ", status);
-		if ( status & ST_ALO )
-			fprintf(stderr," [arbitration lost]");
-		if ( status & ST_BBL )
-			fprintf(stderr," [bus busy]");
-	}
-
-	return status;
+	return 0;
 }
 
-static void cdev_cleanup(struct i2c_io_ *io)
+static uint64_t
+now_ms(void)
 {
-	if ( io->handle.dat.fd >= 0 )
-		close( io->handle.dat.fd );
+struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-static int cdev_flush(CDevDat *dat)
+/* ACK polling: the device doesn't respond while busy with the write
+ * cycle; address it (setting the pointer to 'off') until it does.
+ */
+static int
+ee_wait(i2c_bus bus, int slv_addr, int alen, unsigned off)
 {
-unsigned len = dat->len;
-	if ( len > 0 ) {
-		dat->len = 0;
-		if ( len != write( dat->fd, dat->buf, len ) ) {
-			perror("cdev_sync_cmd() writing:");
+uint8_t        wbuf[2];
+struct i2c_msg msg;
+uint64_t       end = now_ms() + EE_WR_TMO;
+
+	msg.addr  = ee_addr( slv_addr, alen, off, wbuf );
+	msg.flags = 0;
+	msg.len   = alen;
+	msg.buf   = wbuf;
+	while ( i2c_xfer( bus, &msg, 1 ) < 1 ) {
+		if ( now_ms() > end ) {
+			fprintf(stderr,"Error: no ACK after write cycle @0x%04x: %s\n", off, xfer_err( errno, &msg ));
 			return -1;
 		}
 	}
 	return 0;
 }
 
-static int cdev_cache(CDevDat *dat, uint8_t b)
+/* page writes, each followed by ACK polling */
+static int
+ee_write(i2c_bus bus, int slv_addr, int alen, unsigned psz, unsigned off, const uint8_t *buf, unsigned len)
 {
-	if ( dat->len >= sizeof(dat->buf) ) {
-		fprintf(stderr,"ERROR: cdev write buffer exhausted\n");
-		return -1;
+uint8_t        wbuf[MAXBUF + 2];
+struct i2c_msg msg;
+unsigned       l;
+
+	while ( len > 0 ) {
+		/* the address wraps within a page */
+		l = psz - (off % psz);
+		if ( l > len )
+			l = len;
+		msg.addr  = ee_addr( slv_addr, alen, off, wbuf );
+		msg.flags = 0;
+		msg.len   = alen + l;
+		msg.buf   = wbuf;
+		memcpy( wbuf + alen, buf, l );
+		if ( i2c_xfer( bus, &msg, 1 ) < 1 ) {
+			fprintf(stderr,"Error writing @0x%04x: %s\n", off, xfer_err( errno, &msg ));
+			return -1;
+		}
+		off += l;
+		buf += l;
+		len -= l;
+		if ( ee_wait( bus, slv_addr, alen, off - l ) )
+			return -1;
 	}
-	dat->buf[dat->len] = b;
-	dat->len++;
 	return 0;
 }
 
-static uint32_t cdev_sync_cmd(i2c_io *io, uint32_t cmd)
+/* read image into 'fnam' ("-": stdout) */
+static int
+ee_image_rd(i2c_bus bus, int slv_addr, int alen, unsigned off, unsigned len, const char *fnam)
 {
-uint32_t status = ST_ACK;
-int      fd = io->handle.dat.fd;
-uint8_t  byte = (uint8_t)(cmd & 0xff);
-unsigned len;
-
-		if ( fd < 0 )
-			return ST_ERR;
-
-		if ( (cmd & CMD_START) ) {
-			if ( ioctl(fd, I2C_SLAVE, (cmd>>1) & 0x7f) ) {
-				perror("cdev_sync_cmd(START) via ioctl(SLAVE_ADDR):");
-				return ST_ERR;
-			}
-		} else if ( (cmd & CMD_STOP) ) {
-			if ( cdev_flush( &io->handle.dat ) ) {
-				return ST_ERR;
-			}
-		} else if ( (cmd & CMD_WRITE) ) {
-			if ( cdev_cache( &io->handle.dat, byte ) ) {
-				return ST_ERR;
-			}
-		} else if ( (cmd & CMD_READ) ) {
-            if ( cdev_flush( &io->handle.dat ) ) {
-				return ST_ERR;
-			}
-			if ( 1 != read(fd, &byte, 1) ) {
-				perror("cdev_sync_cmd() reading:");
-				return ST_ERR;
-			}
-			status |= byte;
-		} else {
-			fprintf(stderr,"Warning: cdev_sync_cmd() ignoring command 0x%08"PRIx32"\n", cmd);
-			return ST_ERR;
-		}
+uint8_t *img;
+FILE    *f   = 0;
+int      rval = -1;
 
-		return status;
-}
-
-static void bb_close(BBDat *dat)
-{
-	if ( dat->scl ) {
-		gpio_inp( dat->scl );
-		gpio_close( dat->scl );
-		dat->scl = 0;
+	if ( ! (img = malloc( len )) ) {
+		fprintf(stderr,"No memory\n");
+		return -1;
+	}
+	if ( ee_read( bus, slv_addr, alen, off, img, len ) )
+		goto bail;
+	if ( ! (f = strcmp( fnam, "-" ) ? fopen( fnam, "wb" ) : stdout) ) {
+		perror("Unable to open image file");
+		goto bail;
 	}
-	if ( dat->sda ) {
-		gpio_inp( dat->sda );
-		gpio_close( dat->sda );
-		dat->sda = 0;
+	if ( len != fwrite( img, 1, len, f ) || fflush( f ) ) {
+		perror("Unable to write image file");
+		goto bail;
 	}
+	rval = 0;
+bail:
+	if ( f && f != stdout )
+		fclose( f );
+	free( img );
+	return rval;
 }
 
-static void bb_dly(BBDat *dat)
+/* write image from 'fnam' ("-": stdin), at most 'len' bytes, and verify */
+static int
+ee_image_wr(i2c_bus bus, int slv_addr, int alen, unsigned psz, unsigned off, unsigned len, const char *fnam)
 {
-struct timespec v;
-	v.tv_sec  = 0;
-	v.tv_nsec = 500000;
-	nanosleep( &v, 0 );
-}
+uint8_t *img, *chk;
+FILE    *f    = 0;
+int      rval = -1;
+unsigned i;
 
-static void bb_scl_hi(BBDat *dat)
-{
-int attempt, val;
-
-	if ( gpio_inp( dat->scl ) ) {
-		fprintf(stderr, "bb_scl_hi failed\n");
-		bb_close( dat );
-		exit( 1 );
-	}
-	for ( attempt = 0; attempt < 1000; attempt++ ) {
-		val = gpio_get( dat->scl );
-		if ( val < 0 ) {
-			fprintf(stderr, "gpio_get(SCL) failed\n");
-			bb_close( dat );
-			exit( 1 );
-		}
-		if ( val ) {
-			return;
-		}
-		bb_dly( dat );
+	img = malloc( len );
+	chk = malloc( len );
+	if ( ! img || ! chk ) {
+		fprintf(stderr,"No memory\n");
+		goto bail;
 	}
-	fprintf(stderr, "bb_scl_hi -- clock stretching timeout\n");
-	bb_close( dat );
-	exit( 1 );
-}
-
-static void bb_scl_lo(BBDat *dat)
-{
-	if ( gpio_out( dat->scl ) ) {
-		fprintf(stderr, "bb_scl_lo failed\n");
-		bb_close( dat );
-		exit( 1 );
+	if ( ! (f = strcmp( fnam, "-" ) ? fopen( fnam, "rb" ) : stdin) ) {
+		perror("Unable to open image file");
+		goto bail;
 	}
-}
-
-static void bb_sda_hi(BBDat *dat)
-{
-	if ( gpio_inp( dat->sda ) ) {
-		fprintf(stderr, "bb_sda_hi failed\n");
-		bb_close( dat );
-		exit( 1 );
+	len = fread( img, 1, len, f );
+	if ( ferror( f ) ) {
+		perror("Unable to read image file");
+		goto bail;
 	}
-}
-
-static void bb_sda_lo(BBDat *dat)
-{
-	if ( gpio_out( dat->sda ) ) {
-		fprintf(stderr, "bb_sda_lo failed\n");
-		bb_close( dat );
-		exit( 1 );
+	if ( off + len > EE_SPACE( alen ) ) {
+		fprintf(stderr,"Image (%u bytes @0x%x) exceeds the address space (0x%x)\n", len, off, EE_SPACE( alen ));
+		goto bail;
+	}
+	if ( ee_write( bus, slv_addr, alen, psz, off, img, len ) )
+		goto bail;
+	if ( ee_read( bus, slv_addr, alen, off, chk, len ) )
+		goto bail;
+	for ( i = 0; i < len; i++ ) {
+		if ( img[i] != chk[i] ) {
+			fprintf(stderr,"Verify error @0x%04x: wrote 0x%02"PRIX8", read 0x%02"PRIX8"\n", off + i, img[i], chk[i]);
+			goto bail;
+		}
 	}
+	fprintf(stderr,"%u bytes written and verified\n", len);
+	rval = 0;
+bail:
+	if ( f && f != stdin )
+		fclose( f );
+	free( chk );
+	free( img );
+	return rval;
 }
 
-static void bb_cleanup(struct i2c_io_ *io)
+static int
+sc_int(const char *tok, int *v)
 {
-BBDat *dat = &io->handle.bbd;
-	bb_close( dat );
+int n;
+	return tok && 1 == sscanf( tok, "%i%n", v, &n ) && ! tok[n] ? 0 : -1;
 }
 
-static void bb_start(BBDat *dat)
+/* Script: one transaction or delay per line ('#' starts a comment)
+ *
+ *   w <addr> {<byte>}  [ w|r ... ]  : segments, combined with repeated START
+ *   r <addr> <len>     [ w|r ... ]
+ *   d <ms>                          : delay
+ *   s <reg> <val>                   : register map write (unless unchanged)
+ *   g <reg>                         : register map read
+ *
+ * Output per transaction (stdout):
+ *   <line> ok {<byte read>}           (g: the register value)
+ *   <line> err <errno> <message>
+ * Execution stops at the first error.
+ */
+static const char *
+rm_err(int err, int rd)
 {
-	bb_sda_hi( dat );
-    bb_scl_hi( dat );
-	bb_dly   ( dat );
-	bb_sda_lo( dat );
-	bb_dly   ( dat );
-    bb_scl_lo( dat );
+struct i2c_msg m;
+	switch ( err ) {
+		case EINVAL:  return "invalid value";
+		case ENODATA: return "write-only register not known";
+		default:      break;
+	}
+	m.flags = rd ? I2C_M_RD : 0;
+	return xfer_err( err, &m );
 }
 
-static void bb_stop(BBDat *dat)
+/* register by name or number */
+static int
+rm_reg(const i2c_regmap_desc *prof, const char *tok, const char *ctx)
 {
-	bb_scl_lo( dat );
-	bb_sda_lo( dat );
-	bb_dly   ( dat );
-    bb_scl_hi( dat );
-	bb_dly   ( dat );
-    bb_sda_hi( dat );
+int reg;
+	if ( ! tok || (reg = i2c_regmap_reg( prof, tok )) < 0 )
+		fprintf(stderr,"%s: no register '%s' in profile '%s'\n", ctx, tok ? tok : "", prof->name);
+	return tok ? reg : -1;
 }
 
-/* write byte, return ACK */
-static int bb_write_byte(BBDat *dat, uint8_t byte)
+static int
+run_script(i2c_bus bus, FILE *f, i2c_regmap rm, const i2c_regmap_desc *prof)
 {
-int bit;
-int val;
-printf("bb writing 0x%08x\n", byte);
-	for ( bit=0; bit<8; bit++ ) {
-		if ( (byte & 0x80) ) {
-			bb_sda_hi( dat );
-		} else {
-			bb_sda_lo( dat );
+char           line[1024];
+char           ctx[32];
+char          *tok, *sp, *c;
+int            reg;
+unsigned       rv;
+uint8_t        buf[MAXBUF];
+struct i2c_msg msgs[SC_MAXSEG];
+unsigned       used;
+int            lno = 0;
+int            n, i, j, val, done;
+struct timespec ts;
+
+	while ( fgets( line, sizeof(line), f ) ) {
+		lno++;
+		if ( (c = strchr( line, '#' )) )
+			*c = 0;
+		if ( ! (tok = strtok_r( line, " \t\r\n", &sp )) )
+			continue;
+		if ( 0 == strcmp( tok, "d" ) ) {
+			if ( sc_int( strtok_r( 0, " \t\r\n", &sp ), &val ) || val < 0 || strtok_r( 0, " \t\r\n", &sp ) ) {
+				fprintf(stderr,"Line %d: syntax error (d <ms>)\n", lno);
+				return -1;
+			}
+			fflush( stdout );
+			ts.tv_sec  = val / 1000;
+			ts.tv_nsec = (val % 1000) * 1000000;
+			nanosleep( &ts, 0 );
+			continue;
 		}
-		byte <<= 1;
-		bb_dly( dat );
-		bb_scl_hi( dat );
-		bb_dly( dat );
-		bb_scl_lo( dat );
-	}
-	bb_dly( dat );
-	bb_scl_hi( dat );
-	bb_dly( dat );
-
-	val = gpio_get( dat->sda );
-	if ( val < 0 ) {
-		fprintf(stderr, "gpio_get(SDA) failed\n");
-		bb_close( dat );
-		exit( 1 );
-	}
-
-	bb_scl_lo( dat );
-
-	return !val;
-}
-
-static void bb_read_byte(BBDat *dat, uint8_t *byte_p, int do_ack)
-{
-uint8_t byte = 0;
-int     bit, val;
-
-	for ( bit = 0; bit < 8; bit ++ ) {
-		byte <<= 1;
-		bb_dly   ( dat );
-		bb_scl_hi( dat );
-		bb_dly   ( dat );
-		val = gpio_get( dat->sda );
-		if ( val < 0 ) {
-			fprintf(stderr, "bb_read_byte: gpio_get(SDA) failed\n");
-			bb_close( dat );
-			exit( 1 );
+		if ( 0 == strcmp( tok, "s" ) || 0 == strcmp( tok, "g" ) ) {
+			sprintf( ctx, "Line %d", lno );
+			if ( ! rm ) {
+				fprintf(stderr,"%s: no register map (-m)\n", ctx);
+				return -1;
+			}
+			if ( (reg = rm_reg( prof, strtok_r( 0, " \t\r\n", &sp ), ctx )) < 0 )
+				return -1;
+			if ( 's' == *tok ) {
+				if ( sc_int( strtok_r( 0, " \t\r\n", &sp ), &val ) || strtok_r( 0, " \t\r\n", &sp ) ) {
+					fprintf(stderr,"%s: syntax error (s <reg> <val>)\n", ctx);
+					return -1;
+				}
+				if ( i2c_regmap_write( rm, reg, val ) < 0 ) {
+					printf("%d err %d %s\n", lno, errno, rm_err( errno, 0 ));
+					return -1;
+				}
+				printf("%d ok\n", lno);
+			} else {
+				if ( i2c_regmap_read( rm, reg, &rv ) ) {
+					printf("%d err %d %s\n", lno, errno, rm_err( errno, 1 ));
+					return -1;
+				}
+				printf("%d ok %X\n", lno, rv);
+			}
+			continue;
 		}
-		if ( val ) {
-			byte |= 1;
+		n    = 0;
+		used = 0;
+		while ( tok ) {
+			if ( n >= SC_MAXSEG ) {
+				fprintf(stderr,"Line %d: too many segments (max %d)\n", lno, SC_MAXSEG);
+				return -1;
+			}
+			if ( strcmp( tok, "w" ) && strcmp( tok, "r" ) ) {
+				fprintf(stderr,"Line %d: syntax error at '%s' (w, r, d, s or g expected)\n", lno, tok);
+				return -1;
+			}
+			msgs[n].flags = 'r' == *tok ? I2C_M_RD : 0;
+			msgs[n].buf   = buf + used;
+			msgs[n].len   = 0;
+			if ( sc_int( strtok_r( 0, " \t\r\n", &sp ), &val ) || (val & ~0x7f) ) {
+				fprintf(stderr,"Line %d: invalid or missing slave address\n", lno);
+				return -1;
+			}
+			msgs[n].addr = val;
+			if ( msgs[n].flags ) {
+				if ( sc_int( strtok_r( 0, " \t\r\n", &sp ), &val ) || val < 1 || val > sizeof(buf) - used ) {
+					fprintf(stderr,"Line %d: invalid or missing read length\n", lno);
+					return -1;
+				}
+				msgs[n].len = val;
+				tok = strtok_r( 0, " \t\r\n", &sp );
+			} else {
+				while ( (tok = strtok_r( 0, " \t\r\n", &sp )) && strcmp( tok, "w" ) && strcmp( tok, "r" ) ) {
+					if ( sc_int( tok, &val ) || (val & ~0xff) ) {
+						fprintf(stderr,"Line %d: invalid byte '%s'\n", lno, tok);
+						return -1;
+					}
+					if ( used + msgs[n].len >= sizeof(buf) ) {
+						fprintf(stderr,"Line %d: too many bytes\n", lno);
+						return -1;
+					}
+					msgs[n].buf[msgs[n].len++] = val;
+				}
+			}
+			used += msgs[n].len;
+			n++;
 		}
-		bb_scl_lo( dat );
-	}
-	/* send ACK */
-	if ( do_ack ) {
-		bb_sda_lo( dat );
-	} else {
-		bb_sda_hi( dat );
-	}
-	bb_dly   ( dat );
-	bb_scl_hi( dat );
-	bb_dly   ( dat );
-	bb_scl_lo( dat );
-	*byte_p = byte;
-}
-
-static int bb_flush(BBDat *dat)
-{
-unsigned i;
-	for ( i = 0; i < dat->len; i++ ) {
-		if ( ! bb_write_byte( dat, dat->buf[i] ) ) {
-			fprintf(stderr, "bb_flush: no ACK (byte %d)\n", i);
-			bb_close( dat );
+		if ( (done = i2c_xfer( bus, msgs, n )) < n ) {
+			printf("%d err %d %s\n", lno, errno, xfer_err( errno, &msgs[done] ));
 			return -1;
 		}
+		printf("%d ok", lno);
+		for ( i = 0; i < n; i++ ) {
+			if ( (msgs[i].flags & I2C_M_RD) ) {
+				for ( j = 0; j < msgs[i].len; j++ )
+					printf(" %02"PRIX8, msgs[i].buf[j]);
+			}
+		}
+		printf("\n");
 	}
-	dat->len = 0;
-	return 0;
-}
-
-static int bb_cache(BBDat *dat, uint8_t b)
-{
-	if ( dat->len >= sizeof(dat->buf) ) {
-		fprintf(stderr,"ERROR: bb write buffer exhausted\n");
+	if ( ferror( f ) ) {
+		perror("Error reading script");
 		return -1;
 	}
-	dat->buf[dat->len] = b;
-	dat->len++;
 	return 0;
 }
 
-static uint32_t bb_sync_cmd(i2c_io *io, uint32_t cmd)
+/* register map arguments: '<reg>=<val>' writes (unless unchanged),
+ * '<reg>' prints the value
+ */
+static int
+run_regs(i2c_regmap rm, const i2c_regmap_desc *prof, int n, char **args)
 {
-uint32_t status = ST_ACK;
-BBDat   *dat    = &io->handle.bbd;
-uint8_t  byte   = (uint8_t)(cmd & 0xff);
-unsigned len;
-
-		if ( ! dat->scl || ! dat->sda )
-			return ST_ERR;
-
-		if ( (cmd & CMD_START) ) {
-			bb_start( dat );
-			if ( ! bb_write_byte( dat, cmd & 0xff ) ) {
-				/* Not ACK */
-				return 0;
-			}
-		} else if ( (cmd & CMD_STOP) ) {
-			if ( bb_flush( dat ) ) {
-				return ST_ERR;
-			}
-			bb_stop( dat );
-		} else if ( (cmd & CMD_WRITE) ) {
-			if ( bb_cache( dat, byte ) ) {
-				return ST_ERR;
+char           nam[64];
+char          *eq;
+int            i, reg, val;
+unsigned       rv;
+
+	for ( i = 0; i < n; i++ ) {
+		snprintf( nam, sizeof(nam), "%s", args[i] );
+		if ( (eq = strchr( nam, '=' )) )
+			*eq++ = 0;
+		if ( (reg = rm_reg( prof, nam, "Error" )) < 0 )
+			return -1;
+		if ( eq ) {
+			if ( sc_int( eq, &val ) ) {
+				fprintf(stderr,"Unable to parse value '%s'\n", eq);
+				return -1;
 			}
-		} else if ( (cmd & CMD_READ) ) {
-            if ( bb_flush( dat ) ) {
-				return ST_ERR;
+			if ( i2c_regmap_write( rm, reg, val ) < 0 ) {
+				fprintf(stderr,"Error writing '%s': %s\n", nam, rm_err( errno, 0 ));
+				return -1;
 			}
-			bb_read_byte( dat, &byte, ! (cmd & CMD_NACK) );
-			status |= byte;
 		} else {
-			fprintf(stderr,"Warning: cdev_sync_cmd() ignoring command 0x%08"PRIx32"\n", cmd);
-			return ST_ERR;
+			if ( i2c_regmap_read( rm, reg, &rv ) ) {
+				fprintf(stderr,"Error reading '%s': %s\n", nam, rm_err( errno, 1 ));
+				return -1;
+			}
+			printf("%s 0x%0*X\n", nam, (prof->val_bits + 3) / 4, rv);
 		}
-
-		return status;
+	}
+	return 0;
 }
 
-
-#define I2C_RD 1
-
-#define CHECK(status, io, cmd) \
-	do { \
-		status=(io)->sync_cmd(io, cmd); \
-		if ( IS_ERR(status) ) \
-			goto bail; \
-	} while (0)
-
-#define CHECK_ACK(status, io, cmd, msg) \
-	do { \
-		CHECK(status, io, cmd); \
-		if ( ! (status & ST_ACK) ) { \
-			fprintf(stderr,"Error: Missing ACK (%s): 0x%08"PRIx32"\n", msg, status); \
-			goto bail; \
-		} \
-	} while (0)
-
 static void
 usage(const char *nm)
 {
-	fprintf(stderr,"Usage: %s -d device [-hp] [-b base_off]  [-o offset] [-a i2c_addr] [-l len] {value}\n", nm);
+	fprintf(stderr,"Usage: %s -d device [-hp] [-b base_off] [-f khz] [-o offset] [-a i2c_addr] [-l len] [-A addr_bytes] {value}\n", nm);
+	fprintf(stderr,"       %s -d device [-hp] [-b base_off] [-f khz] [-o offset] [-a i2c_addr] [-l len] [-A addr_bytes] [-P page_size] -r|-w image_file\n", nm);
+	fprintf(stderr,"       %s -d device [-hp] [-b base_off] [-f khz] -s script_file\n", nm);
+	fprintf(stderr,"       %s -d device [-hpI] [-b base_off] [-f khz] [-a i2c_addr] -m profile [-S shadow_file] [-s script_file] {reg[=value]}\n", nm);
+	fprintf(stderr,"       %s -d [e]mio<X>/[e]mio<Y> -B\n", nm);
 	fprintf(stderr,"          -p polled operation\n");
+	fprintf(stderr,"          -A addr_bytes          : EEPROM address width 1 (default) or 2 (24C32 and larger)\n");
+	fprintf(stderr,"          -r image_file          : read 'len' bytes (default 256) to binary file ('-': stdout)\n");
+	fprintf(stderr,"          -w image_file          : write binary file ('-': stdin; at most 'len' bytes), verify\n");
+	fprintf(stderr,"          -P page_size           : EEPROM write page size (default 8)\n");
+	fprintf(stderr,"          -s script_file         : execute transactions from file ('-': stdin), one per line:\n");
+	fprintf(stderr,"                                     w <addr> {<byte>} | r <addr> <len>  (segments; may be combined)\n");
+	fprintf(stderr,"                                     d <ms>                              (delay)\n");
+	fprintf(stderr,"                                     s <reg> <val> | g <reg>             (register map write/read)\n");
+	fprintf(stderr,"                                   prints '<line> ok {<byte read>}' or '<line> err <errno> <msg>'\n");
+	fprintf(stderr,"          -m profile             : register map of device 'profile' (wm8731); registers by name\n");
+	fprintf(stderr,"                                   or number, writes of unchanged values are skipped\n");
+	fprintf(stderr,"          -S shadow_file         : persist the register map's shadow (put it on a tmpfs)\n");
+	fprintf(stderr,"          -I                     : forget the shadow (device was power-cycled)\n");
 	fprintf(stderr,"          -d /dev/uio<X>         : i2c master in fabric/PL\n");
 	fprintf(stderr,"          -d /dev/i2c-<X>        : PS i2c master X\n");
 	fprintf(stderr,"          -b base_offset         : offset of device registers in UIO device\n");
 	fprintf(stderr,"          -d [e]mio<X>/[e]mio<Y> : bit-bang via gpio SCL pin X, SDA pin Y\n");
+	fprintf(stderr,"          -f khz                 : bit-bang SCL rate (default 100; 400: fast-mode)\n");
+	fprintf(stderr,"          -B                     : benchmark the bit-bang engines (ns/bit); NOTE: toggles SCL\n");
+	fprintf(stderr,"                                   at full speed (SDA stays released)\n");
 }
 
 int
 main(int argc, char **argv)
 {
-i2c_io    io  = {0};
+i2c_bus   bus = 0;
 int rval      = 1;
 int ch;
 
-int       len  = 256;
+int       len  = -1;
 int    romaddr = -1;
 int    rdoff   = 0;
-int   slv_addr = 0x50;
+int   slv_addr = -1;
 int      *i_p;
 int       i,val;
 const char   *devnam = 0;
-unsigned      basoff = 0;
-
-uint32_t sta, cmd;
-
-uint32_t cmd_addr;
-
-
-	while ( (ch = getopt(argc, argv, "ho:l:a:d:b:p")) >= 0 ) {
+int           basoff = 0;
+int           poll   = 0;
+int           khz    = 0;
+int           alen   = 1;
+int           psz    = 8;
+const char   *rdimg  = 0;
+const char   *wrimg  = 0;
+const char   *script = 0;
+FILE         *sf;
+const char   *pnam   = 0;
+const char   *shadow = 0;
+int           inval  = 0;
+int           bench  = 0;
+double        ns_gen, ns_spc;
+const char   *kind;
+const i2c_regmap_desc *prof = 0;
+i2c_regmap    rm     = 0;
+unsigned long wr, sk;
+char          spec[256];
+
+uint8_t        wbuf[MAXBUF];
+unsigned       wlen;
+uint8_t        rbuf[256];
+struct i2c_msg msgs[2];
+int            n, done;
+
+
+	while ( (ch = getopt(argc, argv, "ho:l:a:d:b:f:pA:P:r:w:s:m:S:IB")) >= 0 ) {
 		i_p = 0;
 		switch (ch) {
 			case 'h':
@@ -483,10 +506,21 @@ uint32_t cmd_addr;
 			case 'l': i_p = &len;      break;
 			case 'a': i_p = &slv_addr; break;
 			case 'b': i_p = &basoff;   break;
+			case 'f': i_p = &khz;      break;
+			case 'A': i_p = &alen;     break;
+			case 'P': i_p = &psz;      break;
 
 			case 'd': devnam = optarg; break;
 
-			case 'p': io.flags |= FLAG_POLL; break;
+			case 'p': poll   = 1;      break;
+
+			case 'r': rdimg  = optarg; break;
+			case 'w': wrimg  = optarg; break;
+			case 's': script = optarg; break;
+			case 'm': pnam   = optarg; break;
+			case 'S': shadow = optarg; break;
+			case 'I': inval  = 1;      break;
+			case 'B': bench  = 1;      break;
 		}
 		if ( i_p ) {
 			if ( 1 != sscanf(optarg, "%i", i_p) ) {
@@ -496,125 +530,189 @@ uint32_t cmd_addr;
 		}
 	}
 
+	if ( pnam && ! (prof = i2c_regmap_profile( pnam )) ) {
+		fprintf(stderr,"Unknown register map profile '%s'\n", pnam);
+		return rval;
+	}
+
+	if ( slv_addr < 0 )
+		slv_addr = prof ? prof->addr : 0x50;
+
 	if ( slv_addr & ~0x7f ) {
 		fprintf(stderr,"Invalid slave address 0x%x (> 0x7f)\n", slv_addr);
 		return rval;
 	}
 
-	if ( len < 0 || len > 256 ) {
-		fprintf(stderr,"Invalid length %d (> 256)\n", len);
+	if ( alen < 1 || alen > 2 ) {
+		fprintf(stderr,"Invalid address width %d (1 or 2)\n", alen);
 		return rval;
 	}
 
-	if ( ! devnam ) {
-		fprintf(stderr,"No device name -- use -d option\n");
+	if ( psz < 1 || psz > MAXBUF ) {
+		fprintf(stderr,"Invalid page size %d (1..%d)\n", psz, MAXBUF);
 		return rval;
 	}
 
-	if ( romaddr != -1 ) {
-		if ( romaddr & ~0xff ) {
-			fprintf(stderr,"Invalid offset %d (> 256)\n", len);
-			return rval;
-		}
-		rdoff = romaddr;
+	if ( !!rdimg + !!wrimg + !!script > 1 ) {
+		fprintf(stderr,"Only one of -r, -w, -s\n");
+		return rval;
 	}
 
-	if ( strstr(devnam, "uio") || strstr(devnam, "mem") ) {
-		if ( ! (io.handle.mio = arm_mmio_init_2( devnam, MAP_LEN, basoff )) ) {
-			return rval;
-		}
-		io.sync_cmd = mmio_sync_cmd;
-		io.cleanup  = mmio_cleanup;
-	} else if ( strstr(devnam, "i2c-") ) {
-		if ( (io.handle.dat.fd = open(devnam, O_RDWR)) < 0 ) {
-			fprintf(stderr,"Error opening device %s: %s\n", devnam, strerror(errno));
+	if ( prof && (rdimg || wrimg) ) {
+		fprintf(stderr,"No register map in image mode\n");
+		return rval;
+	}
+
+	if ( script && argc > optind ) {
+		fprintf(stderr,"No values in script mode\n");
+		return rval;
+	}
+
+	if ( rdimg || wrimg ) {
+		if ( len < 0 )
+			len = wrimg ? EE_MAXLEN : 256;
+		if ( len > EE_MAXLEN ) {
+			fprintf(stderr,"Invalid length %d (> %d)\n", len, EE_MAXLEN);
 			return rval;
 		}
-		io.handle.dat.len = 0;
-		io.sync_cmd = cdev_sync_cmd;
-		io.cleanup  = cdev_cleanup;
-	} else if ( strstr(devnam, "mio") ) {
-		int sda_pin, scl_pin, sda_emio = 0, scl_emio = 0;
-		if        ( 2 == sscanf(devnam, "mio%d/mio%d",   &scl_pin, &sda_pin ) ) {
-		} else if ( 2 == sscanf(devnam, "emio%d/mio%d",  &scl_pin, &sda_pin ) ) {
-			scl_emio = 1;
-		} else if ( 2 == sscanf(devnam, "mio%d/emio%d",  &scl_pin, &sda_pin ) ) {
-			sda_emio = 1;
-		} else if ( 2 == sscanf(devnam, "emio%d/emio%d", &scl_pin, &sda_pin ) ) {
-			scl_emio = 1;
-			sda_emio = 1;
-		} else {
-			fprintf(stderr, "Invalid bit-bang configuration, must be [e]mio[0-9]+[/][e]mio[0-9]+\n");
+		if ( argc > optind ) {
+			fprintf(stderr,"No values in image mode\n");
 			return rval;
 		}
-		if ( ! ( io.handle.bbd.scl = gpio_open( scl_pin, scl_emio ) ) ) {
-			fprintf(stderr, "Unable to open GPIO for SCL pin %d\n", scl_pin);
+	} else {
+		if ( len < 0 )
+			len = 256;
+		if ( len > 256 ) {
+			fprintf(stderr,"Invalid length %d (> 256)\n", len);
 			return rval;
 		}
-		if ( ! ( io.handle.bbd.sda = gpio_open( sda_pin, sda_emio ) ) ) {
-			fprintf(stderr, "Unable to open GPIO for SDA pin %d\n", sda_pin);
-			gpio_close( io.handle.bbd.scl );
+	}
+
+	if ( ! devnam ) {
+		fprintf(stderr,"No device name -- use -d option\n");
+		return rval;
+	}
+
+	if ( romaddr != -1 ) {
+		/* 1-byte addressing: block select in the slave address */
+		if ( romaddr < 0 || romaddr >= EE_SPACE( alen ) ) {
+			fprintf(stderr,"Invalid offset 0x%x (> 0x%x)\n", romaddr, EE_SPACE( alen ) - 1);
 			return rval;
 		}
+		rdoff = romaddr;
+	}
 
-		bb_sda_hi( &io.handle.bbd );
-		if ( gpio_inp( io.handle.bbd.scl ) ) {
-			fprintf(stderr, "gpio_inp(SCL) failed\n");
-			bb_close( &io.handle.bbd );
-			exit( 1 );
-		}
-		/* Ignore return value of gpio_clr; it signals failure but
-		 * the output is cleared anyways
-		 */
-		gpio_clr( io.handle.bbd.scl );
-		gpio_clr( io.handle.bbd.sda );
-		io.handle.bbd.len = 0;
-		io.sync_cmd = bb_sync_cmd;
-		io.cleanup  = bb_cleanup;
-	} else {
-		fprintf(stderr,"Don't know how to handle this device: %s\n", devnam);
+	if ( rdimg && rdoff + len > EE_SPACE( alen ) ) {
+		fprintf(stderr,"Invalid length %d (offset + length > 0x%x)\n", len, EE_SPACE( alen ));
 		return rval;
 	}
 
-	cmd_addr = CMD_START | CMD_WRITE | (slv_addr<<1) ;
-	CHECK_ACK( sta, &io, cmd_addr, "Addressing slave (for WR)" );
+	/* base offset and polling are options of the fabric master, the
+	 * rate is one of bit-bang
+	 */
+	if ( strlen( devnam ) + sizeof(",off=-2147483648,poll,khz=-2147483648") > sizeof(spec) ) {
+		fprintf(stderr,"Device name too long\n");
+		return rval;
+	}
+	strcpy( spec, devnam );
+	if ( basoff )
+		sprintf( spec + strlen( spec ), ",off=%i", basoff );
+	if ( poll )
+		strcat( spec, ",poll" );
+	if ( khz )
+		sprintf( spec + strlen( spec ), ",khz=%i", khz );
+
+	if ( ! (bus = i2c_open( spec )) ) {
+		return rval;
+	}
 
-	if ( -1 != romaddr ) {
-		/*
-		   cmd = CMD_WRITE | ((romaddr>>8) & 0xff);
-		   CHECK_ACK( sta, &io, cmd, "Sending ROMaddr (HI)" );
-		 */
+	if ( bench ) {
+		if ( i2c_bb_bench( bus, &ns_gen, &ns_spc, &kind ) ) {
+			fprintf(stderr,"Benchmark only supported by the bit-bang backend\n");
+		} else {
+			printf("ns/bit: generic %.1f, specialized (%s) %.1f\n", ns_gen, kind, ns_spc);
+			rval = 0;
+		}
+		goto bail;
+	}
 
-		cmd = CMD_WRITE | (romaddr & 0xff);
-		CHECK_ACK( sta, &io, cmd, "Sending ROMaddr (LO)" );
+	if ( prof ) {
+		if ( ! (rm = i2c_regmap_open( bus, prof, slv_addr, shadow )) ) {
+			fprintf(stderr,"Unable to create register map\n");
+			goto bail;
+		}
+		if ( inval )
+			i2c_regmap_invalidate( rm );
+		if ( ! script ) {
+			rval = run_regs( rm, prof, argc - optind, argv + optind ) ? 1 : 0;
+			goto bail;
+		}
+	}
+	if ( script ) {
+		if ( ! (sf = strcmp( script, "-" ) ? fopen( script, "r" ) : stdin) ) {
+			perror("Unable to open script");
+			goto bail;
+		}
+		rval = run_script( bus, sf, rm, prof ) ? 1 : 0;
+		if ( sf != stdin )
+			fclose( sf );
+		goto bail;
+	}
+	if ( rdimg ) {
+		rval = ee_image_rd( bus, slv_addr, alen, rdoff, len, rdimg ) ? 1 : 0;
+		goto bail;
+	}
+	if ( wrimg ) {
+		rval = ee_image_wr( bus, slv_addr, alen, psz, rdoff, len, wrimg ) ? 1 : 0;
+		goto bail;
 	}
 
-	if ( argc > optind ) {
-		/* write */
-		for ( i=optind; i<argc; i++ ) {
-			if ( 1 != sscanf(argv[i],"%i", &val) ) {
-				fprintf(stderr,"Unable to parse value %i\n", i-optind+1);
-				goto bail;
-			}
-			if ( (val & ~0xff) ) {
-				fprintf(stderr,"Warning: Value %i out of range (0..255) -- truncating\n", i-optind+1);
-			}
-			cmd = CMD_WRITE | (val & 0xff);
-			CHECK_ACK( sta, &io, cmd, "Sending values" );
+	/* offset and values */
+	wlen = 0;
+	if ( -1 != romaddr ) {
+		slv_addr = ee_addr( slv_addr, alen, romaddr, wbuf );
+		wlen     = alen;
+	}
+	for ( i=optind; i<argc; i++ ) {
+		if ( 1 != sscanf(argv[i],"%i", &val) ) {
+			fprintf(stderr,"Unable to parse value %i\n", i-optind+1);
+			goto bail;
 		}
-	} else {
-		/* read  */
-		CHECK_ACK( sta, &io, cmd_addr | I2C_RD, "Addressing slave (for RD)" );
+		if ( (val & ~0xff) ) {
+			fprintf(stderr,"Warning: Value %i out of range (0..255) -- truncating\n", i-optind+1);
+		}
+		if ( wlen >= sizeof(wbuf) ) {
+			fprintf(stderr,"Too many values\n");
+			goto bail;
+		}
+		wbuf[wlen++] = val & 0xff;
+	}
 
-		cmd = CMD_READ;
+	n = 0;
+	if ( wlen > 0 || argc > optind ) {
+		msgs[n].addr  = slv_addr;
+		msgs[n].flags = 0;
+		msgs[n].len   = wlen;
+		msgs[n].buf   = wbuf;
+		n++;
+	}
+	if ( argc <= optind ) {
+		msgs[n].addr  = slv_addr;
+		msgs[n].flags = I2C_M_RD;
+		msgs[n].len   = len;
+		msgs[n].buf   = rbuf;
+		n++;
+	}
+	if ( (done = i2c_xfer( bus, msgs, n )) < n ) {
+		fprintf(stderr,"Error: %s\n", xfer_err( errno, &msgs[done] ));
+		goto bail;
+	}
 
+	if ( argc <= optind ) {
 		for ( i = 0; i < len; i++ ) {
 			if ( ! (i&0xf) )
 				printf("\n%04x: ", rdoff + i);
-			if ( i == len - 1 )
-				cmd |= CMD_NACK;
-			CHECK( sta, &io, cmd );
-			printf(" %02"PRIX32, (sta & 0xff));
+			printf(" %02"PRIX8, rbuf[i]);
 		}
 		printf("\n");
 	}
@@ -622,7 +720,12 @@ uint32_t cmd_addr;
 	rval = 0;
 
 bail:
-	io.sync_cmd( &io, CMD_STOP );
-	io.cleanup( &io );
+	if ( rm ) {
+		i2c_regmap_stats( rm, &wr, &sk );
+		fprintf(stderr,"%s: %lu writes, %lu unchanged (skipped)\n", prof->name, wr, sk);
+		if ( i2c_regmap_close( rm ) )
+			rval = 1;
+	}
+	i2c_close( bus );
 	return rval;
 }
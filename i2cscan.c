@@ -0,0 +1,223 @@
+/* I2C bus scan
+ *
+ * Probes the 7-bit addresses (0x08..0x77 unless -a) on one or more
+ * buses (i2clib specs, as i2cm's -d) and prints a presence map per bus
+ * with the time the scan took. Each bus is scanned by its own thread.
+ *
+ * Probes (as i2cdetect):
+ *   quick-write : START, address + W, STOP; the default except for
+ *   read-byte   : START, address + R, one byte (NACKed), STOP; the
+ *                 default for 0x30..0x37 and 0x50..0x5f where a quick
+ *                 write might corrupt an EEPROM (write-protect latch)
+ * Unlike i2cdetect we don't use SMBus Quick but a zero-length write
+ * which some adapters reject (EOPNOTSUPP, EINVAL); the default then
+ * falls back to read-byte probes for the rest of that bus.
+ *
+ * Buses are scanned concurrently, bit-bang buses included (gpiolib
+ * serializes the updates of GPIO registers shared by their pins).
+ */
+
+#include <i2clib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <inttypes.h>
+
+#define ADDR_FIRST  0x08
+#define ADDR_LAST   0x77
+
+#define PROBE_AUTO  0
+#define PROBE_QUICK 1
+#define PROBE_READ  2
+
+/* presence map entries */
+#define ST_ABSENT   0
+#define ST_PRESENT  1
+#define ST_ERROR    2
+
+typedef struct scan_ {
+	const char *spec;
+	i2c_bus     bus;
+	int         probe;
+	int         no_quick;   /* adapter rejects zero-length writes */
+	unsigned    first, last;
+	uint8_t     st[128];
+	int         err;        /* first error other than a NACK */
+	unsigned    found;
+	uint64_t    ns;
+	pthread_t   thr;
+} scan;
+
+static uint64_t
+now_ns(void)
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static int
+use_read(const scan *s, unsigned a)
+{
+	if ( PROBE_AUTO == s->probe )
+		return s->no_quick || (a >= 0x30 && a <= 0x37) || (a >= 0x50 && a <= 0x5f);
+	return PROBE_READ == s->probe;
+}
+
+static void *
+scanner(void *arg)
+{
+scan          *s = (scan*)arg;
+struct i2c_msg msg;
+uint8_t        b;
+unsigned       a;
+int            ok;
+uint64_t       t0 = now_ns();
+
+	for ( a = s->first; a <= s->last; a++ ) {
+		msg.addr  = a;
+		msg.flags = use_read( s, a ) ? I2C_M_RD : 0;
+		msg.len   = msg.flags ? 1 : 0;
+		msg.buf   = &b;
+		ok = 1 == i2c_xfer( s->bus, &msg, 1 );
+		if (    ! ok && ! msg.flags && PROBE_AUTO == s->probe
+		     && ( EOPNOTSUPP == errno || EINVAL == errno ) ) {
+			s->no_quick = 1;
+			msg.flags   = I2C_M_RD;
+			msg.len     = 1;
+			ok = 1 == i2c_xfer( s->bus, &msg, 1 );
+		}
+		/* NACK: ENXIO; the kernel's drivers may say EREMOTEIO */
+		if ( ok ) {
+			s->st[a] = ST_PRESENT;
+			s->found++;
+		} else if ( ENXIO == errno || EREMOTEIO == errno ) {
+			s->st[a] = ST_ABSENT;
+		} else {
+			s->st[a] = ST_ERROR;
+			if ( ! s->err )
+				s->err = errno;
+		}
+	}
+	s->ns = now_ns() - t0;
+	return 0;
+}
+
+static void
+print_map(const scan *s)
+{
+unsigned a;
+unsigned n = s->last - s->first + 1;
+
+	printf("%s (%s): %u device(s), %u probes in %.3f ms (%.1f us/probe)\n",
+		s->spec, i2c_backend_name( s->bus ), s->found, n,
+		(double)s->ns / 1.0E6, (double)s->ns / 1.0E3 / n);
+	if ( s->no_quick )
+		printf("  quick write not supported by the adapter; read-byte probes used\n");
+	if ( s->err )
+		printf("  errors (marked '!!'), first: %s\n", strerror( s->err ));
+	printf("     0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f");
+	for ( a = 0; a < 128; a++ ) {
+		if ( ! (a & 0xf) )
+			printf("\n%02x:", a);
+		if ( a < s->first || a > s->last )
+			printf("   ");
+		else if ( ST_PRESENT == s->st[a] )
+			printf(" %02x", a);
+		else if ( ST_ERROR == s->st[a] )
+			printf(" !!");
+		else
+			printf(" --");
+	}
+	printf("\n");
+}
+
+static void
+usage(const char *nm)
+{
+	fprintf(stderr,"Usage: %s [-haqr] bus [bus...]\n", nm);
+	fprintf(stderr,"          probe all addresses on the buses (in parallel) and print presence maps\n");
+	fprintf(stderr,"          bus : /dev/uio<X>[,off=<n>][,poll] : i2c master in fabric/PL\n");
+	fprintf(stderr,"                /dev/i2c-<X>                 : PS i2c master X\n");
+	fprintf(stderr,"                [e]mio<X>/[e]mio<Y>[,khz=<n>]: bit-bang via gpio SCL pin X, SDA pin Y\n");
+	fprintf(stderr,"          -a  : all addresses 0x00..0x7f (default 0x%02x..0x%02x)\n", ADDR_FIRST, ADDR_LAST);
+	fprintf(stderr,"          -q  : quick-write probes only\n");
+	fprintf(stderr,"          -r  : read-byte probes only\n");
+	fprintf(stderr,"                (default: read-byte for 0x30..0x37, 0x50..0x5f, quick-write otherwise;\n");
+	fprintf(stderr,"                 read-byte everywhere if the adapter rejects quick writes)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+int       opt, i, n, started;
+int       rval  = 1;
+int       probe = PROBE_AUTO;
+unsigned  first = ADDR_FIRST;
+unsigned  last  = ADDR_LAST;
+scan     *s     = 0;
+uint64_t  t0;
+
+	while ( (opt = getopt(argc, argv, "haqr")) > 0 ) {
+		switch ( opt ) {
+			case 'h': rval = 0;
+			default:
+				usage(argv[0]);
+				return rval;
+
+			case 'a': first = 0; last = 0x7f;  break;
+			case 'q': probe = PROBE_QUICK;     break;
+			case 'r': probe = PROBE_READ;      break;
+		}
+	}
+	if ( (n = argc - optind) <= 0 ) {
+		usage(argv[0]);
+		return 1;
+	}
+	if ( ! (s = calloc( n, sizeof(*s) )) ) {
+		fprintf(stderr,"No memory\n");
+		return 1;
+	}
+	for ( i = 0; i < n; i++ ) {
+		s[i].spec  = argv[optind + i];
+		s[i].probe = probe;
+		s[i].first = first;
+		s[i].last  = last;
+		if ( ! (s[i].bus = i2c_open( s[i].spec )) ) {
+			fprintf(stderr,"Unable to open bus '%s'\n", s[i].spec);
+			goto bail;
+		}
+	}
+
+	t0 = now_ns();
+	for ( started = 0; started < n; started++ ) {
+		if ( (errno = pthread_create( &s[started].thr, 0, scanner, &s[started] )) ) {
+			perror("Unable to create thread");
+			break;
+		}
+	}
+	/* scan the rest ourselves */
+	for ( i = started; i < n; i++ )
+		scanner( &s[i] );
+	for ( i = 0; i < started; i++ )
+		pthread_join( s[i].thr, 0 );
+	t0 = now_ns() - t0;
+
+	rval = 0;
+	for ( i = 0; i < n; i++ ) {
+		print_map( &s[i] );
+		if ( s[i].err )
+			rval = 1;
+	}
+	printf("%d bus(es) scanned in %.3f ms\n", n, (double)t0 / 1.0E6);
+
+bail:
+	for ( i = 0; i < n; i++ )
+		i2c_close( s[i].bus );
+	free( s );
+	return rval;
+}
@@ -1,26 +1,31 @@
 /* Access MDIO registers on xilinx 10G-Ethernet */
 
 #include <stdio.h>
-#include <arm-mmio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <time.h>
-
-#define REG_C0 0x140 /* register, not byte-offset (0x500) */
-#define REG_C1 0x141 /* register, not byte-offset (0x504) */
-#define REG_TD 0x142 /* register, not byte-offset (0x508) */
-#define REG_RD 0x143 /* register, not byte-offset (0x50c) */
+#include <mdiolib.h>
 
 #define DIV    62    /* 156.25MHz / 2.5MHz                */
 
-#define OP_ADDR (0<<14)
-#define OP_WRTE (1<<14)
-#define OP_READ (3<<14)
+/* PHY identifier (PMA/PMD); used to verify a faster MDC */
+#define DEV_PMA  1
+#define REG_ID1  2
+#define REG_ID2  3
+
+#define FMT_TXT  0
+#define FMT_JSON 1
+#define FMT_BIN  2
 
-#define CM_GO   0x800
-#define ST_DONE 0x080
+#define BIN_MAGIC "MD45"
 
-#define CMD(p,d,o) (((p)<<24) | ((d)<<16) | (o) | CM_GO)
+/* registers 'first'..'last' of MMD 'dev' on port 'prt' */
+typedef struct range_ {
+	int prt, dev, first, last;
+} range;
 
 static void
 usage(const char *nm)
@@ -28,20 +33,195 @@ usage(const char *nm)
 	fprintf(stderr,"Usage: %s -d <uio-device> [-P phy_portddr] [-D phy_devaddr] phy_reg [value]\n", nm);
 	fprintf(stderr,"       phy_portaddr defaults to 0\n");
 	fprintf(stderr,"       phy_devaddr  defaults to 1\n");
+	fprintf(stderr,"       -d also accepts any mdiolib bus, e.g., 'if:eth0' (kernel driver)\n");
+	fprintf(stderr,"       -c div : set the MDC divider (0..63; MDC = s_axi_aclk / (2*(div+1)));\n");
+	fprintf(stderr,"                verified by reading the PHY ID (port phy_portaddr) before and\n");
+	fprintf(stderr,"                after; reverted to %d on mismatch\n", DIV);
+	fprintf(stderr,"       -i     : block for the MDIO interrupt (default: busy-poll)\n");
+	fprintf(stderr,"       -t     : print elapsed time (stderr)\n");
+	fprintf(stderr,"       -C file: cache static/write-through registers in 'file' across runs\n");
+	fprintf(stderr,"                (use a tmpfs, e.g., /run/mdio.cache; '-': this run only)\n");
+	fprintf(stderr,"       -K rules: classify registers for the cache, e.g., '1.0=w,7.16=w'\n");
+	fprintf(stderr,"                (default: IDs static, rest volatile; see mdiolib.h)\n");
+	fprintf(stderr,"       -x [prt/]dev:first[-last][,...]\n");
+	fprintf(stderr,"              : dump register ranges (port defaults to phy_portaddr) using\n");
+	fprintf(stderr,"                post-read-increment-address, one frame per register;\n");
+	fprintf(stderr,"                printed as 'prt.dev.reg: value' unless -j or -o is given\n");
+	fprintf(stderr,"       -j     : dump as JSON (one register per line)\n");
+	fprintf(stderr,"       -o file: dump to binary 'file' ('-': stdout): \"%s\", then per range\n", BIN_MAGIC);
+	fprintf(stderr,"                u8 port, u8 dev, u16 first, u16 count, count x u16 value\n");
+	fprintf(stderr,"                (little-endian)\n");
 }
 
-static void
-exec_cmd(Arm_MMIO m, uint32_t cmd)
+static int
+parse_ranges(char *s, int prt_dflt, range **r_p, unsigned *n_p)
+{
+char    *tok, *sp;
+range   *r = 0, *n;
+unsigned nr = 0;
+range    x;
+int      got;
+
+	for ( tok = strtok_r( s, ",", &sp ); tok; tok = strtok_r( 0, ",", &sp ) ) {
+		if ( strchr( tok, '/' ) ) {
+			got = sscanf( tok, "%i/%i:%i-%i", &x.prt, &x.dev, &x.first, &x.last ) - 1;
+		} else {
+			x.prt = prt_dflt;
+			got   = sscanf( tok, "%i:%i-%i", &x.dev, &x.first, &x.last );
+		}
+		if ( 2 == got ) {
+			x.last = x.first;
+		} else if ( 3 != got ) {
+			fprintf(stderr,"Invalid range '%s'\n", tok);
+			goto bail;
+		}
+		if (    x.prt < 0 || x.prt > 31 || x.dev < 0 || x.dev > 31
+		     || x.first < 0 || x.last > 0xffff || x.first > x.last ) {
+			fprintf(stderr,"Invalid range '%s'\n", tok);
+			goto bail;
+		}
+		if ( ! (n = realloc( r, (nr + 1) * sizeof(*r) )) ) {
+			fprintf(stderr,"No memory\n");
+			goto bail;
+		}
+		r       = n;
+		r[nr++] = x;
+	}
+	*r_p = r;
+	*n_p = nr;
+	return 0;
+bail:
+	free( r );
+	return -1;
+}
+
+static int
+put_u16(FILE *f, unsigned v)
+{
+	return EOF == fputc( v & 0xff, f ) || EOF == fputc( (v >> 8) & 0xff, f ) ? -1 : 0;
+}
+
+static int
+dump(mdio_bus b, const range *r, unsigned nr, int fmt, const char *binf)
+{
+mdio_op *ops;
+unsigned n = 0, i, k;
+int      done, rval = -1;
+FILE    *f = stdout;
+
+	for ( i = 0; i < nr; i++ )
+		n += r[i].last - r[i].first + 1;
+	if ( ! (ops = malloc( n * sizeof(*ops) )) ) {
+		fprintf(stderr,"No memory\n");
+		return -1;
+	}
+	for ( i = 0, k = 0; i < nr; i++ ) {
+		for ( n = r[i].first; n <= r[i].last; n++, k++ ) {
+			ops[k].op  = MDIO_READ_INC;
+			ops[k].phy = r[i].prt;
+			ops[k].dev = r[i].dev;
+			ops[k].reg = n;
+		}
+	}
+	n = k;
+	if ( (done = mdio_xfer( b, ops, n )) < n ) {
+		fprintf(stderr,"MDIO read of %d.%d.0x%04x failed: %s\n", ops[done].phy, ops[done].dev, ops[done].reg, strerror(errno));
+		goto bail;
+	}
+	if ( FMT_BIN == fmt && strcmp( binf, "-" ) && ! (f = fopen( binf, "wb" )) ) {
+		fprintf(stderr,"Unable to create '%s': %s\n", binf, strerror(errno));
+		goto bail;
+	}
+	if ( FMT_BIN == fmt )
+		fputs( BIN_MAGIC, f );
+	else if ( FMT_JSON == fmt )
+		fprintf(f, "[");
+	for ( i = 0, k = 0; i < nr; i++ ) {
+		if ( FMT_BIN == fmt ) {
+			fputc( r[i].prt, f );
+			fputc( r[i].dev, f );
+			put_u16( f, r[i].first );
+			put_u16( f, r[i].last - r[i].first + 1 );
+		}
+		for ( n = r[i].first; n <= r[i].last; n++, k++ ) {
+			switch ( fmt ) {
+				case FMT_BIN:
+					put_u16( f, ops[k].val );
+					break;
+				case FMT_JSON:
+					fprintf(f, "%s\n  {\"port\": %d, \"dev\": %d, \"reg\": %u, \"val\": %u}",
+						k ? "," : "", r[i].prt, r[i].dev, n, ops[k].val);
+					break;
+				default:
+					fprintf(f, "%d.%d.0x%04x: 0x%04x\n", r[i].prt, r[i].dev, n, ops[k].val);
+					break;
+			}
+		}
+	}
+	if ( FMT_JSON == fmt )
+		fprintf(f, "\n]\n");
+	if ( fflush( f ) || ferror( f ) ) {
+		fprintf(stderr,"Error writing dump\n");
+		goto bail;
+	}
+	rval = 0;
+bail:
+	if ( f != stdout )
+		fclose( f );
+	free( ops );
+	return rval;
+}
+
+static int
+read_id(mdio_bus b, int prt, uint32_t *id_p)
+{
+int hi, lo;
+	if ( (hi = mdio_read45( b, prt, DEV_PMA, REG_ID1 )) < 0 || (lo = mdio_read45( b, prt, DEV_PMA, REG_ID2 )) < 0 )
+		return -1;
+	*id_p = ((uint32_t)hi << 16) | lo;
+	return 0;
+}
+
+/* open with 'div'; check that the PHY ID reads the same as with the
+ * current setting
+ */
+static mdio_bus
+open_div(const char *spec, int div, int prt)
+{
+mdio_bus b;
+char     buf[300];
+uint32_t id, id_div;
+
+	if ( ! (b = mdio_open( spec, 0, 0 )) )
+		return 0;
+	if ( read_id( b, prt, &id ) ) {
+		fprintf(stderr,"Unable to read PHY ID (port %d)\n", prt);
+		goto bail;
+	}
+	mdio_close( b );
+	snprintf( buf, sizeof(buf), "%s,div=%d", spec, div );
+	if ( ! (b = mdio_open( buf, 0, 0 )) )
+		return 0;
+	if ( read_id( b, prt, &id_div ) || id != id_div ) {
+		fprintf(stderr,"PHY ID mismatch with divider %d (0x%08"PRIx32" vs 0x%08"PRIx32"); reverting to %d\n",
+			div, id_div, id, DIV);
+		mdio_close( b );
+		snprintf( buf, sizeof(buf), "%s,div=%d", spec, DIV );
+		mdio_close( mdio_open( buf, 0, 0 ) );
+		return 0;
+	}
+	return b;
+bail:
+	mdio_close( b );
+	return 0;
+}
+
+static inline uint64_t
+now_ns(void)
 {
 struct timespec t;
-uint32_t st;
-	iowrite32(m, REG_C1, cmd  );
-	do {
-		t.tv_sec  = 0;
-		t.tv_nsec = 1000000;
-		nanosleep(&t, 0);
-		st = ioread32(m, REG_C1);
-	} while ( ! (st & ST_DONE) );
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
 }
 
 int
@@ -50,30 +230,52 @@ main(int argc, char **argv)
 int ch;
 int rval = 1;
 const char *devn = 0;
+char *spec = 0;
 long long ll;
 int p_prt = 0;
 int p_dev = 1;
 int *i_p;
 int reg;
-uint32_t v,x,cmd;
+int x;
+uint32_t v = 0;
 int have_v = 0;
-Arm_MMIO m = 0;
-	while ( (ch = getopt(argc, argv, "hd:P:D:")) > 0 ) {
+int div = -1;
+int use_irq = 0;
+int timing = 0;
+int fmt = FMT_TXT;
+char *ranges = 0;
+const char *binf = 0;
+range *rng = 0;
+unsigned nrng = 0;
+uint64_t t0 = 0;
+mdio_bus b = 0;
+const char *cache = 0;
+const char *rules = 0;
+unsigned long hits, misses;
+	while ( (ch = getopt(argc, argv, "hd:P:D:c:itx:jo:C:K:")) > 0 ) {
 		i_p = 0;
 		switch ( ch ) {
 			case 'h': rval = 0; /* fall thru */
-			default: 
+			default:
 				usage(argv[0]);
 				return rval;
 
 			case 'd': devn = optarg; break;
 			case 'P': i_p = &p_prt;  break;
 			case 'D': i_p = &p_dev;  break;
+			case 'c': i_p = &div;    break;
+			case 'i': use_irq = 1;   break;
+			case 't': timing  = 1;   break;
+			case 'x': ranges  = optarg; break;
+			case 'j': fmt     = FMT_JSON; break;
+			case 'o': fmt     = FMT_BIN; binf = optarg; break;
+			case 'C': cache   = optarg; break;
+			case 'K': rules   = optarg; break;
 		}
 
 		if ( i_p ) {
 			if ( 1 != sscanf(optarg,"%lli",&ll) ) {
-				fprintf(stderr,"Unable to parse (integer) arg to -%c: %s\n", optarg, ch);
+				fprintf(stderr,"Unable to parse (integer) arg to -%c: %s\n", ch, optarg);
 				return rval;
 			}
 			*i_p = (int) ll;
@@ -84,12 +286,15 @@ Arm_MMIO m = 0;
 		return rval;
 	}
 
-	if ( argc <= optind || 1 != sscanf(argv[optind],"%i",&reg) ) {
+	if ( ranges ) {
+		if ( parse_ranges( ranges, p_prt, &rng, &nrng ) )
+			return rval;
+	} else if ( argc <= optind || 1 != sscanf(argv[optind],"%i",&reg) ) {
 		fprintf(stderr, "Need register arg\n");
 		return rval;
 	}
 
-	if ( argc > optind+1 ) {
+	if ( ! ranges && argc > optind+1 ) {
 		if ( 1 != sscanf(argv[optind+1],"%lli",&ll) ) {
 			fprintf(stderr,"Unable to parse 'value'\n");
 			return rval;
@@ -98,36 +303,70 @@ Arm_MMIO m = 0;
 		have_v = 1;
 	}
 
-	m = arm_mmio_init(devn);
-	if ( ! m ) {
-		fprintf(stderr,"Unable to open device\n");
+	if ( div > 63 ) {
+		fprintf(stderr,"Invalid divider %d (0..63)\n", div);
 		return rval;
 	}
 
-	/* Make sure divider is initialized */
-	x = ioread32(m, REG_C0);
-	if ( x == 0 ) {
-		fprintf(stderr,"Info: Setting divider to %i and enabling MDIO interface\n", DIV);
-		iowrite32(m, REG_C0, (1<<6) | DIV);
+	/* a plain device name is the MAC's UIO device */
+	if ( strchr(devn, ':') ) {
+		spec = strdup( devn );
+	} else if ( (spec = malloc( strlen(devn) + sizeof("xgmac:,irq") )) ) {
+		sprintf( spec, "xgmac:%s%s", devn, use_irq ? ",irq" : "" );
 	}
+	if ( ! spec ) {
+		fprintf(stderr,"No memory\n");
+		return rval;
+	}
+
+	if ( timing )
+		t0 = now_ns();
 
-	cmd = CMD(p_prt, p_dev, 0);
+	if ( div >= 0 )
+		b = open_div( spec, div, p_prt );
+	else
+		b = mdio_open( spec, 0, 0 );
+	if ( ! b ) {
+		fprintf(stderr,"Unable to open device\n");
+		goto bail;
+	}
 
-	/* Address */
-	iowrite32(m, REG_TD, reg);
-	exec_cmd(m, cmd | OP_ADDR);
+	/* after open_div(): its ID check must see the PHY */
+	if ( cache || rules ) {
+		if (    mdio_cache_enable( b, ( ! cache || ! strcmp( cache, "-" ) ) ? 0 : cache )
+		     || ( rules && mdio_cache_rules( b, rules ) ) ) {
+			fprintf(stderr,"Unable to set up the register cache\n");
+			goto bail;
+		}
+	}
 
-	if ( have_v ) {
-		iowrite32(m, REG_TD, v);
-		exec_cmd(m, cmd | OP_WRTE);
+	if ( ranges ) {
+		if ( dump( b, rng, nrng, fmt, binf ) )
+			goto bail;
+	} else if ( have_v ) {
+		if ( mdio_write45( b, p_prt, p_dev, reg, v ) ) {
+			fprintf(stderr,"MDIO write failed: %s\n", strerror(errno));
+			goto bail;
+		}
 	} else {
-		exec_cmd(m, cmd | OP_READ);
-		printf("%d.%d: %08"PRIx32"\n", p_dev, reg, ioread32(m, REG_RD));
+		if ( (x = mdio_read45( b, p_prt, p_dev, reg )) < 0 ) {
+			fprintf(stderr,"MDIO read failed: %s\n", strerror(errno));
+			goto bail;
+		}
+		printf("%d.%d: %08"PRIx32"\n", p_dev, reg, (uint32_t)x);
+	}
+
+	if ( timing ) {
+		fprintf(stderr,"%.3f ms\n", (double)(now_ns() - t0) / 1.0E6);
+		if ( 0 == mdio_cache_stats( b, &hits, &misses ) )
+			fprintf(stderr,"cache: %lu hits, %lu misses\n", hits, misses);
 	}
 
 	rval = 0;
 
 bail:
-	arm_mmio_exit( m );
+	mdio_close( b );
+	free( spec );
+	free( rng );
 	return rval;
 }
@@ -1,195 +1,197 @@
-#include <arm-mmio.h>
 #include <stdio.h>
 #include <getopt.h>
 #include <time.h>
 #include <stdlib.h>
-#include <gpiolib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <mdiolib.h>
 
-#define REG_CMD 1
-#define REG_STA 5
-#define  CMD_VAL (1<<5)
-#define  CMD_CLK (1<<4)
-#define  STA_VAL 0x80000000
+#define MDC_KHZ_DFLT 2500
 
-#define GPIO_PIN_CLK 4
-#define GPIO_PIN_OUT 5
-#define GPIO_PIN_INP 11
+typedef struct op_list_ {
+	mdio_op  *ops;
+	uint8_t  *dump;   /* part of a -d dump (print as row) */
+	unsigned  n, cap;
+} op_list;
 
-#define GPIO_PIN_TYPE EMIO_PIN
-
-typedef struct gpio_io_ {
-	gpio_handle clk, out, inp;
-} *gpio_io;
-
-typedef struct io_ops_ {
-	int (*send_bit) (void *ioc, int val);
-	void (*clk_lo)  (void *ioc);
-	void *ioc;
-} *io_ops;
-
-static void
-clk_lo_gpio(void *arg)
-{
-gpio_io iop = (gpio_io)arg;
-	gpio_clr(iop->clk);
-}
-
-static void
-clk_lo_mmio(void *arg)
-{
-Arm_MMIO iop = (Arm_MMIO)arg;
-uint32_t v = ioread32(iop, REG_CMD);
-	v &= ~CMD_CLK;
-	iowrite32(iop, REG_CMD, v);
-}
-
-static void
-clk_lo(io_ops ops)
-{
-	ops->clk_lo(ops->ioc);
-}
-
-static int
-send_bit(io_ops ops, int val)
-{
-	return ops->send_bit(ops->ioc, val);
-}
-
-static void nsdly(unsigned ns)
+static inline uint64_t
+now_ns(void)
 {
-struct timespec dly;
-	dly.tv_sec  = 0;
-	dly.tv_nsec = ns;
-	nanosleep( &dly, 0 );
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
 }
 
 static int
-send_bit_gpio(void * arg, int bitval)
+add_op(op_list *l, int phy, int reg, int val, int dump)
 {
-gpio_io iop = (gpio_io)arg;
-struct timespec dly;
-int    rv;
+mdio_op *n;
+uint8_t *d;
 
-	
-	if ( bitval )
-		gpio_set(iop->out);
-	else
-		gpio_clr(iop->out);
-
-	nsdly( 1000 );
-
-	rv = gpio_get(iop->inp);
-
-	if ( rv < 0 ) {
-		perror("INTERNAL ERROR: Unable to read GPIO");
-		exit(1);
+	if ( phy < 0 || (phy == 0 && val < 0 ) || phy > 31 ) {
+		fprintf(stderr,"Invalid phy #%i\n", phy);
+		return -1;
 	}
-	
-	gpio_set(iop->clk);	
-	nsdly( 1000 );
-	
-	gpio_clr(iop->clk);
-
-	return rv;
+	if ( reg < 0 || reg > 31 ) {
+		fprintf(stderr,"Invalid reg #%i\n", reg);
+		return -1;
+	}
+	if ( val > 0xffff ) {
+		fprintf(stderr,"Value out of range\n");
+		return -1;
+	}
+	if ( l->n >= l->cap ) {
+		l->cap = l->cap ? 2*l->cap : 64;
+		if ( ! (n = realloc( l->ops, l->cap * sizeof(*n) )) ) {
+			fprintf(stderr,"No memory\n");
+			return -1;
+		}
+		l->ops = n;
+		if ( ! (d = realloc( l->dump, l->cap * sizeof(*d) )) ) {
+			fprintf(stderr,"No memory\n");
+			return -1;
+		}
+		l->dump = d;
+	}
+	l->ops[l->n].op  = val < 0 ? MDIO_READ : MDIO_WRITE;
+	l->ops[l->n].phy = phy;
+	l->ops[l->n].dev = MDIO_C22;
+	l->ops[l->n].reg = reg;
+	l->ops[l->n].val = val < 0 ? 0 : val;
+	l->dump[l->n]    = dump;
+	l->n++;
+	return 0;
 }
 
+/* lines of 'phy reg [val]'; '#' starts a comment */
 static int
-send_bit_mmio(void *arg, int bitval)
+load_batch(op_list *l, const char *fnam)
 {
-Arm_MMIO iop = (Arm_MMIO)arg;
-struct timespec dly;
-
-uint32_t v = ioread32(iop, REG_CMD);
-uint32_t rv;
-
-	if ( bitval )
-		v |= CMD_VAL;
-	else
-		v &= ~CMD_VAL;
-	iowrite32(iop, REG_CMD, v);
-	nsdly( 1000 );
-
-	v |= CMD_CLK;
-	rv = ioread32(iop, REG_STA);
-	iowrite32(iop, REG_CMD, v);
-	nsdly( 1000 );
-	v &= ~CMD_CLK;
-	iowrite32(iop, REG_CMD, v);
-
-	return !!(rv & STA_VAL);
-}
-
-static struct io_ops_ mmio_ops = {
-	send_bit: send_bit_mmio,
-	clk_lo:   clk_lo_mmio,
-};
-
-static struct gpio_io_ gpio_ctxt = {
-	0
-};
-
-static struct io_ops_ gpio_ops = {
-	send_bit: send_bit_gpio,
-	clk_lo:   clk_lo_gpio,
-	ioc:      &gpio_ctxt
-};
-
-static uint16_t
-send_word(io_ops iop, uint32_t tx)
-{
-int i;
-uint32_t rx = 0;
-printf("send word 0x%08"PRIx32"\n", tx);
-	for ( i=0; i<32; i++) {
-		rx = (rx<<1) | send_bit(iop, !! (tx & (1<<31)));
-		tx <<= 1;
-	}
-	return (rx & 0xffff);
+FILE *f;
+char  line[256];
+char *c;
+int   phy, reg, val, got;
+int   lno  = 0;
+int   rval = -1;
+
+	if ( 0 == strcmp(fnam, "-") ) {
+		f = stdin;
+	} else if ( ! (f = fopen(fnam, "r")) ) {
+		fprintf(stderr,"Unable to open '%s': %s\n", fnam, strerror(errno));
+		return -1;
+	}
+	while ( fgets( line, sizeof(line), f ) ) {
+		lno++;
+		if ( (c = strchr(line, '#')) )
+			*c = 0;
+		val = -1;
+		if ( (got = sscanf(line, "%i %i %i", &phy, &reg, &val)) <= 0 )
+			continue;
+		if ( got < 2 ) {
+			fprintf(stderr,"%s:%d: expected 'phy reg [val]'\n", fnam, lno);
+			goto bail;
+		}
+		if ( add_op( l, phy, reg, val, 0 ) ) {
+			fprintf(stderr,"(%s:%d)\n", fnam, lno);
+			goto bail;
+		}
+	}
+	rval = 0;
+bail:
+	if ( f != stdin )
+		fclose( f );
+	return rval;
 }
 
-static uint16_t
-mmio_xact(io_ops iop, int phy, int reg, int val)
+/* reads as 'phy reg value', dumps as 'phy: reg0 .. reg31' */
+static void
+print_ops(const op_list *l)
 {
-uint32_t v = 0x40000000;
-
-	v |= ( (phy << 7) | (reg << 2) ) << 16;
-
-	if ( val < 0 ) {
-		/* read */
-		v |= 0x20000000;
-	} else {
-		v |= 0x10020000 | (val & 0xffff);
+unsigned       i;
+const mdio_op *op;
+
+	for ( i = 0; i < l->n; i++ ) {
+		op = &l->ops[i];
+		if ( l->dump[i] ) {
+			if ( 0 == op->reg )
+				printf("%2d:", op->phy);
+			printf(" %04"PRIx16, op->val);
+			if ( 31 == op->reg )
+				printf("\n");
+		} else if ( MDIO_READ == op->op ) {
+			printf("%2d %2d 0x%04"PRIx16"\n", op->phy, op->reg, op->val);
+		}
 	}
-	send_word(iop, 0xffffffff); /* preamble */
-	return send_word(iop, v);
 }
 
-static void 
+static void
 usage(const char *nm)
 {
-	fprintf(stderr,"Usage: %s [-p phy] [-r reg] [-v val] [-hm]\n", nm);
+	fprintf(stderr,"Usage: %s [-p phy] [-r reg] [-v val] [-f khz] [-hmstB] [-I bus] [-C cache] [-K rules] [-b batch-file] [-d phy[,phy...]]\n", nm);
+	fprintf(stderr,"          -m      : bit-bang via the MMIO core (default: GPIO)\n");
+	fprintf(stderr,"          -I bus  : use any mdiolib bus, e.g., 'if:eth0' (kernel driver),\n");
+	fprintf(stderr,"                    'gpio:emio4,emio5,emio11' (see mdiolib.h)\n");
+	fprintf(stderr,"          -f khz  : MDC rate (default %d kHz; busy-waits)\n", MDC_KHZ_DFLT);
+	fprintf(stderr,"          -b file : execute 'phy reg [val]' lines from 'file' ('-': stdin);\n");
+	fprintf(stderr,"                    reads are printed as 'phy reg value'\n");
+	fprintf(stderr,"          -d phys : dump registers 0..31 of the listed PHYs, one line per PHY\n");
+	fprintf(stderr,"          -C file : cache static/write-through registers in 'file' across runs\n");
+	fprintf(stderr,"                    (use a tmpfs, e.g., /run/mdio.cache; '-': this run only)\n");
+	fprintf(stderr,"          -K rules: classify registers for the cache, e.g., 'c22.0=w,c22.4=w'\n");
+	fprintf(stderr,"                    (default: IDs static, rest volatile; see mdiolib.h)\n");
+	fprintf(stderr,"          -s      : suppress the preamble for PHYs which support it (BMSR bit 6)\n");
+	fprintf(stderr,"          -t      : print elapsed time (stderr)\n");
+	fprintf(stderr,"          -B      : benchmark the bit engines (ns/bit); NOTE: toggles MDC at full speed\n");
 }
 
 int
 main(int argc, char **argv)
 {
-io_ops   iop = &gpio_ops;
-int      phy =  4;
-int      reg =  0;
-int      val = -1;
-int      opt;
-int     *i_p;
-int      rval = 1;
-uint16_t got;
-int      use_mmio = 0;
-	
-	while ( ( opt = getopt(argc, argv, "p:r:v:hm")) > 0 ) {
+const char *bus_spec = "gpio";
+mdio_bus    bus;
+int         phy =  4;
+int         reg =  0;
+int         val = -1;
+int         opt;
+int        *i_p;
+int         rval = 1;
+int         khz = MDC_KHZ_DFLT;
+unsigned    flags = 0;
+int         timing = 0;
+int         batch = 0;
+int         do_bench = 0;
+int         done;
+char       *dumps = 0;
+const char *cache = 0;
+const char *rules = 0;
+unsigned long hits, misses;
+char       *tok, *sp;
+uint64_t    t0 = 0;
+op_list     ops = { 0 };
+double      ns_gen, ns_spc;
+const char *kind;
+
+	while ( ( opt = getopt(argc, argv, "p:r:v:f:b:d:I:C:K:hmstB")) > 0 ) {
 		i_p = 0;
 		switch (opt) {
 			case 'p': i_p = &phy; break;
 			case 'r': i_p = &reg; break;
 			case 'v': i_p = &val; break;
-			case 'm': use_mmio = 1; break;
+			case 'f': i_p = &khz; break;
+			case 'm': bus_spec = "mmio"; break;
+			case 'I': bus_spec = optarg; break;
+			case 's': flags   |= MDIO_F_SUPPRESS_PREAMBLE; break;
+			case 't': timing   = 1; break;
+			case 'B': do_bench = 1; break;
+			case 'd': dumps    = optarg; break;
+			case 'C': cache    = optarg; break;
+			case 'K': rules    = optarg; break;
+			case 'b':
+				if ( load_batch( &ops, optarg ) )
+					return 1;
+				batch = 1;
+				break;
 			case 'h':
 				rval = 0;
 			default:
@@ -201,55 +203,80 @@ int      use_mmio = 0;
 		}
 	}
 
-	if ( use_mmio ) {
-		iop = &mmio_ops;
-		if ( ! (iop->ioc = arm_mmio_init("/dev/uio2") ) ) {
-			fprintf(stderr,"Unable to open MMIO/UIO device\n");
-			return 1;
-		}
-	} else {
-		if ( ! (gpio_ctxt.clk = gpio_open( GPIO_PIN_CLK, GPIO_PIN_TYPE )) || gpio_out(gpio_ctxt.clk) ) {
-			fprintf(stderr,"Unable to open GPIO CLK pin\n");
-			return 1;
-		}
-		if ( ! (gpio_ctxt.out = gpio_open( GPIO_PIN_OUT, GPIO_PIN_TYPE )) || gpio_out(gpio_ctxt.out) ) {
-			fprintf(stderr,"Unable to open GPIO OUT pin\n");
-			gpio_close(gpio_ctxt.clk);
-			return 1;
-		}
-		if ( ! (gpio_ctxt.inp = gpio_open( GPIO_PIN_INP, GPIO_PIN_TYPE )) || gpio_inp(gpio_ctxt.inp) ) {
-			fprintf(stderr,"Unable to open GPIO INP pin\n");
-			gpio_close(gpio_ctxt.clk);
-			gpio_close(gpio_ctxt.out);
-			return 1;
+	if ( dumps ) {
+		for ( tok = strtok_r( dumps, ",", &sp ); tok; tok = strtok_r( 0, ",", &sp ) ) {
+			if ( 1 != sscanf(tok, "%i", &phy) ) {
+				fprintf(stderr,"Invalid PHY list\n");
+				return 1;
+			}
+			for ( reg = 0; reg < 32; reg++ ) {
+				if ( add_op( &ops, phy, reg, -1, 1 ) )
+					return 1;
+			}
 		}
+		batch = 1;
 	}
-	
+	if ( ! batch && add_op( &ops, phy, reg, val, 0 ) )
+		return 1;
 
-	if ( phy < 0 || (phy == 0 && val < 0 ) || phy > 31 ) {
-		fprintf(stderr,"Invalid phy #%i\n", reg);
+	if ( khz <= 0 || khz > 2500 ) {
+		fprintf(stderr,"Invalid MDC rate (1..2500 kHz)\n");
 		return 1;
 	}
-	if ( reg < 0 || reg > 31 ) {
-		fprintf(stderr,"Invalid reg #%i\n", reg);
+
+	if ( ! (bus = mdio_open( bus_spec, khz, flags )) ) {
+		fprintf(stderr,"Unable to open MDIO bus '%s'\n", bus_spec);
 		return 1;
 	}
 
-	if ( val > 0xffff ) {
-		fprintf(stderr,"Value out of range\n");
-		return 1;
+	if ( cache || rules ) {
+		if (    mdio_cache_enable( bus, ( ! cache || ! strcmp( cache, "-" ) ) ? 0 : cache )
+		     || ( rules && mdio_cache_rules( bus, rules ) ) ) {
+			fprintf(stderr,"Unable to set up the register cache\n");
+			goto bail;
+		}
+	}
+
+	if ( do_bench ) {
+		if ( mdio_bb_bench( bus, &ns_gen, &ns_spc, &kind ) ) {
+			fprintf(stderr,"Benchmark only supported by the bit-bang backends\n");
+		} else {
+			printf("ns/bit: generic %.1f, specialized (%s) %.1f\n", ns_gen, kind, ns_spc);
+			rval = 0;
+		}
+		goto bail;
 	}
 
-	clk_lo( iop );
-	
-	got = mmio_xact(iop, phy, reg, val);
-	if ( val < 0 ) {
+	if ( timing )
+		t0 = now_ns();
+
+	done = mdio_xfer( bus, ops.ops, ops.n );
+
+	if ( timing ) {
+		fprintf(stderr,"%u operations in %.3f ms\n", ops.n, (double)(now_ns() - t0) / 1.0E6);
+		if ( 0 == mdio_cache_stats( bus, &hits, &misses ) )
+			fprintf(stderr,"cache: %lu hits, %lu misses\n", hits, misses);
+	}
+
+	if ( done < (int)ops.n ) {
+		fprintf(stderr,"MDIO operation #%d (phy %d, reg %d) failed: %s\n",
+				done, ops.ops[done].phy, ops.ops[done].reg, strerror(errno));
+		goto bail;
+	}
+
+	if ( batch ) {
+		print_ops( &ops );
+	} else if ( val < 0 ) {
 		printf("MMIO (phy %d) @reg %d: 0x%04"PRIx16"\n",
-				phy,
-				reg,
-				got);
+				ops.ops[0].phy,
+				ops.ops[0].reg,
+				ops.ops[0].val);
 	}
+	rval = 0;
 
-	clk_lo( iop );
-	return 0;
+bail:
+	mdio_close( bus );
+	free( ops.ops );
+	free( ops.dump );
+	return rval;
 }
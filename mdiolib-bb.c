@@ -0,0 +1,641 @@
+/* mdiolib bit-bang backends ("gpio", "mmio")
+ *
+ * A frame is compiled into a waveform (sequence of MDC/MDIO output
+ * states) which is replayed with calibrated busy-waits.
+ */
+
+#include <mdiolib-impl.h>
+#include <arm-mmio.h>
+#include <gpiolib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+/* MDIO register of the fabric core ("mmio") */
+#define REG_CMD 1
+#define REG_STA 5
+#define  CMD_VAL (1<<5)
+#define  CMD_CLK (1<<4)
+#define  STA_VAL 0x80000000
+
+#define MMIO_DEV_DFLT "/dev/uio2"
+
+/* default pins of the "gpio" backend */
+#define GPIO_PIN_CLK GPIO_EMIO( 4)
+#define GPIO_PIN_OUT GPIO_EMIO( 5)
+#define GPIO_PIN_INP GPIO_EMIO(11)
+
+/* bits in the GPIO group */
+#define GRP_CLK (1<<0)
+#define GRP_OUT (1<<1)
+#define GRP_INP (1<<2)
+
+/* waveform step: output state (WV_CLK | WV_OUT) and whether the input
+ * is sampled at the end of the step (i.e., just before MDC rises)
+ */
+#define WV_CLK  GRP_CLK
+#define WV_OUT  GRP_OUT
+#define WV_SMPL (1<<7)
+
+/* preamble + frame (2 steps per bit) + final MDC low */
+#define WV_MAX  (2*64 + 1)
+
+#define CALIB_RUNS   10
+#define BENCH_RUNS   1000
+
+#define BMCR          0
+#define  BMCR_RESET   (1<<15)
+#define BMSR          1
+#define  BMSR_MF_PRE  (1<<6)  /* accepts frames w/o preamble */
+
+/* one idle bit between frames when the preamble is suppressed */
+#define PRE_SUPPRESSED 1
+
+/* frame fields */
+#define ST_C22   1
+#define ST_C45   0
+#define OP_ADDR  0  /* clause 45 */
+#define OP_WRITE 1
+#define OP_READ  2  /* clause 22 */
+#define OP_RD45  3  /* clause 45 */
+#define OP_RINC  2  /* clause 45, post-read-increment-address */
+
+#define ADDR_UNKNOWN (-1)
+#define REG_CTRL   0  /* clause 45 */
+#define  CTRL_RST  (1<<15)
+
+typedef struct wave_ {
+	uint8_t  st[WV_MAX];
+	unsigned n;
+} wave;
+
+/* busy-wait counts after a plain step and after a sampling step (which
+ * also pays for reading the input)
+ */
+typedef struct wv_tim_ {
+	unsigned dly[2];
+} wv_tim;
+
+typedef struct gpio_io_ {
+	gpio_group         grp;
+	/* direct register access (zynq backend) */
+	volatile uint32_t *md_reg;
+	uint32_t           md_val[4];  /* MASK_DATA for WV_CLK | WV_OUT */
+	volatile uint32_t *ro_reg;
+	uint32_t           ro_bit;
+	int                err;        /* sticky during an operation (errno) */
+} *gpio_io;
+
+typedef struct mmio_io_ {
+	Arm_MMIO   mio;
+	uint32_t   cmd;    /* REG_CMD shadow (CMD_CLK, CMD_VAL cleared) */
+} *mmio_io;
+
+/* 'play' is the engine specialized for the backend; 'put'/'get' are
+ * used by the generic engine
+ */
+typedef struct io_ops_ {
+	void     (*put) (void *ioc, unsigned st);
+	int      (*get) (void *ioc);
+	uint32_t (*play)(void *ioc, const wave *w, const wv_tim *tim);
+	void     *ioc;
+} *io_ops;
+
+#define IO_GPIO 0  /* gpiolib group calls           */
+#define IO_ZYNQ 1  /* zynq registers, inlined       */
+#define IO_MMIO 2  /* MMIO/UIO registers, inlined   */
+
+typedef struct bb_bus_ {
+	struct mdio_bus_ hdr;
+	struct io_ops_   io;
+	struct gpio_io_  gio;
+	struct mmio_io_  mio;
+	wv_tim           tim;
+	unsigned         flags;
+	/* per-PHY preamble suppression: -1 unknown, 0 no, 1 yes */
+	signed char      pre_sup[32];
+	/* clause 45 address register of [prt][dev]; ADDR_UNKNOWN if unknown */
+	int32_t          addr[32][32];
+} *bb_bus;
+
+static void
+gpio_fail(gpio_io iop, const char *what)
+{
+	if ( ! iop->err ) {
+		iop->err = errno ? errno : EIO;
+		fprintf(stderr,"mdiolib: %s: %s\n", what, strerror(iop->err));
+	}
+}
+
+static void
+put_gpio(void *arg, unsigned st)
+{
+gpio_io iop = (gpio_io)arg;
+	if ( gpio_group_write(iop->grp, GRP_CLK | GRP_OUT, st) )
+		gpio_fail( iop, "writing MDC/MDIO" );
+}
+
+/* reads as idle (1) on error */
+static int
+get_gpio(void *arg)
+{
+gpio_io  iop = (gpio_io)arg;
+uint32_t rv;
+	if ( gpio_group_read(iop->grp, GRP_INP, &rv) ) {
+		gpio_fail( iop, "reading MDIO" );
+		return 1;
+	}
+	return !!(rv & GRP_INP);
+}
+
+static void
+put_mmio(void *arg, unsigned st)
+{
+mmio_io  iop = (mmio_io)arg;
+uint32_t v   = iop->cmd;
+	if ( (st & WV_CLK) )
+		v |= CMD_CLK;
+	if ( (st & WV_OUT) )
+		v |= CMD_VAL;
+	iowrite32(iop->mio, REG_CMD, v);
+}
+
+static int
+get_mmio(void *arg)
+{
+mmio_io iop = (mmio_io)arg;
+	return !!(ioread32(iop->mio, REG_STA) & STA_VAL);
+}
+
+static void
+put_zynq(void *arg, unsigned st)
+{
+gpio_io iop = (gpio_io)arg;
+	*iop->md_reg = iop->md_val[st];
+}
+
+static int
+get_zynq(void *arg)
+{
+gpio_io iop = (gpio_io)arg;
+	return !!(*iop->ro_reg & iop->ro_bit);
+}
+
+/* calibrated busy-wait */
+static inline __attribute__((always_inline)) void
+spin(unsigned loops)
+{
+volatile unsigned i;
+	for ( i = loops; i; i-- )
+		/* nothing */;
+}
+
+/* Replay engine; 'kind' is a constant in each instantiation below so
+ * the compiler generates a specialized loop with inlined I/O.
+ * Returns the samples (the last 32 in the LSBs).
+ */
+static inline __attribute__((always_inline)) uint32_t
+wv_play_tmpl(void *ioc, const wave *w, const wv_tim *tim, const int kind)
+{
+unsigned i, smpl;
+uint32_t rx = 0;
+	for ( i = 0; i < w->n; i++ ) {
+		smpl = !!(w->st[i] & WV_SMPL);
+		switch ( kind ) {
+			case IO_ZYNQ: put_zynq( ioc, w->st[i] & (WV_CLK | WV_OUT) ); break;
+			case IO_MMIO: put_mmio( ioc, w->st[i] & (WV_CLK | WV_OUT) ); break;
+			default:      put_gpio( ioc, w->st[i] & (WV_CLK | WV_OUT) ); break;
+		}
+		spin( tim->dly[smpl] );
+		if ( smpl ) {
+			switch ( kind ) {
+				case IO_ZYNQ: rx = (rx << 1) | get_zynq( ioc ); break;
+				case IO_MMIO: rx = (rx << 1) | get_mmio( ioc ); break;
+				default:      rx = (rx << 1) | get_gpio( ioc ); break;
+			}
+		}
+	}
+	return rx;
+}
+
+static uint32_t
+wv_play_gpio(void *ioc, const wave *w, const wv_tim *tim)
+{
+	return wv_play_tmpl( ioc, w, tim, IO_GPIO );
+}
+
+static uint32_t
+wv_play_zynq(void *ioc, const wave *w, const wv_tim *tim)
+{
+	return wv_play_tmpl( ioc, w, tim, IO_ZYNQ );
+}
+
+static uint32_t
+wv_play_mmio(void *ioc, const wave *w, const wv_tim *tim)
+{
+	return wv_play_tmpl( ioc, w, tim, IO_MMIO );
+}
+
+/* append 'nbits' (MSB first); CLK is low at the start of each bit:
+ * present data with CLK low, sample, raise CLK (the PHY latches data).
+ */
+static void
+wv_bits(wave *w, uint32_t bits, unsigned nbits)
+{
+unsigned d;
+	while ( nbits-- > 0 ) {
+		d = (bits & (1u << nbits)) ? WV_OUT : 0;
+		w->st[w->n++] = d | WV_SMPL;
+		w->st[w->n++] = d | WV_CLK;
+	}
+}
+
+static void
+wv_frame(wave *w, uint32_t frame, unsigned npre)
+{
+unsigned i;
+	w->n = 0;
+	wv_bits( w, 0xffffffff, npre );
+	wv_bits( w, frame, 32 );
+	/* only the data field (of reads) is used; every sample costs a
+	 * syscall on the sysfs backend
+	 */
+	for ( i = 0; i < w->n - 2*16; i++ )
+		w->st[i] &= ~WV_SMPL;
+	/* leave MDC low */
+	w->st[w->n] = w->st[w->n - 1] & WV_OUT;
+	w->n++;
+}
+
+static uint32_t
+wv_play(io_ops iop, const wave *w, const wv_tim *tim)
+{
+	return iop->play(iop->ioc, w, tim);
+}
+
+/* unspecialized engine (I/O via function pointers); for comparison */
+static uint32_t
+wv_play_generic(io_ops iop, const wave *w, const wv_tim *tim)
+{
+unsigned i, smpl;
+uint32_t rx = 0;
+	for ( i = 0; i < w->n; i++ ) {
+		smpl = !!(w->st[i] & WV_SMPL);
+		iop->put(iop->ioc, w->st[i] & (WV_CLK | WV_OUT));
+		spin( tim->dly[smpl] );
+		if ( smpl )
+			rx = (rx << 1) | iop->get(iop->ioc);
+	}
+	return rx;
+}
+
+/* Determine the busy-wait counts for the requested MDC rate: time the
+ * spin loop, then measure the cost of output and input operations by
+ * replaying idle bits (harmless to the PHYs) with a full half-period of
+ * spinning, i.e., without ever exceeding the requested rate.
+ */
+static int
+calibrate(io_ops iop, unsigned khz, wv_tim *tim)
+{
+wave     w, wp;
+wv_tim   full;
+unsigned i;
+uint64_t t0, t_put, t_get, loop_ns, half_ns = 500000 / khz;
+
+	/* ns per 1M iterations (fastest of a few runs; the first ones
+	 * may still see a low CPU clock)
+	 */
+	loop_ns = (uint64_t)-1;
+	for ( i = 0; i < 5; i++ ) {
+		t0 = mdio_ts_now();
+		spin( 1000000 );
+		if ( (t0 = mdio_ts_now() - t0) < loop_ns )
+			loop_ns = t0;
+	}
+	if ( ! loop_ns )
+		loop_ns = 1;
+	full.dly[0] = full.dly[1] = half_ns * 1000000 / loop_ns;
+
+	w.n = 0;
+	wv_bits( &w, 0xffffffff, 32 );
+	/* same without sampling */
+	wp = w;
+	for ( i = 0; i < wp.n; i++ )
+		wp.st[i] &= ~WV_SMPL;
+
+	t0 = mdio_ts_now();
+	for ( i = 0; i < CALIB_RUNS; i++ )
+		wv_play( iop, &wp, &full );
+	t_put = (mdio_ts_now() - t0) / (CALIB_RUNS * wp.n);
+	t_put = t_put > half_ns ? t_put - half_ns : 0;
+
+	t0 = mdio_ts_now();
+	for ( i = 0; i < CALIB_RUNS; i++ )
+		wv_play( iop, &w, &full );
+	/* half of the steps sample */
+	t_get = (mdio_ts_now() - t0) / (CALIB_RUNS * w.n / 2);
+	t_get = t_get > 2*(half_ns + t_put) ? t_get - 2*(half_ns + t_put) : 0;
+
+	if ( t_put + t_get >= half_ns ) {
+		fprintf(stderr,"mdiolib: WARNING: MDC limited to ~%"PRIu64" kHz by I/O cost (%"PRIu64" ns/edge)\n",
+			(uint64_t)500000 / (t_put + t_get), t_put + t_get);
+	}
+	tim->dly[0] = t_put         < half_ns ? (half_ns - t_put)         * 1000000 / loop_ns : 0;
+	tim->dly[1] = t_put + t_get < half_ns ? (half_ns - t_put - t_get) * 1000000 / loop_ns : 0;
+	return 0;
+}
+
+/* 32-bit frame (without preamble); the data field of reads is left 0 */
+static uint32_t
+frame(unsigned st, unsigned op, unsigned pa, unsigned ra, int wr, uint16_t data)
+{
+uint32_t v = (st << 30) | (op << 28) | (pa << 23) | (ra << 18);
+	if ( wr )
+		v |= (2 << 16) | data;
+	return v;
+}
+
+static uint16_t
+xact(bb_bus b, uint32_t v, unsigned npre)
+{
+wave w;
+	wv_frame( &w, v, npre );
+	return wv_play( &b->io, &w, &b->tim ) & 0xffff;
+}
+
+/* preamble length for (clause 22) 'phy'; the first frame to a PHY reads
+ * BMSR to find out
+ */
+static unsigned
+preamble(bb_bus b, unsigned phy)
+{
+uint16_t v;
+	if ( ! (b->flags & MDIO_F_SUPPRESS_PREAMBLE) || 0 == phy )
+		return 32;
+	if ( b->pre_sup[phy] < 0 ) {
+		v = xact( b, frame( ST_C22, OP_READ, phy, BMSR, 0, 0 ), 32 );
+		if ( b->gio.err )
+			return 32;
+		b->pre_sup[phy] = !! ( v & BMSR_MF_PRE );
+	}
+	return b->pre_sup[phy] ? PRE_SUPPRESSED : 32;
+}
+
+static void
+forget_port(bb_bus b, unsigned prt)
+{
+unsigned d;
+	for ( d = 0; d < 32; d++ )
+		b->addr[prt][d] = ADDR_UNKNOWN;
+}
+
+static int
+bb_xfer(mdio_bus p, mdio_op ops[], unsigned n)
+{
+bb_bus   b = (bb_bus)p;
+mdio_op *op;
+unsigned i;
+uint16_t v;
+int      wr, c45op;
+
+	for ( i = 0; i < n; i++ ) {
+		op = &ops[i];
+		wr = ( MDIO_WRITE == op->op );
+		b->gio.err = 0;
+		if ( MDIO_C22 == op->dev ) {
+			v = xact( b, frame( ST_C22, wr ? OP_WRITE : OP_READ, op->phy, op->reg, wr, op->val ), preamble( b, op->phy ) );
+			/* use a full preamble again after a reset */
+			if ( wr && BMCR == op->reg && (op->val & BMCR_RESET) ) {
+				if ( op->phy )
+					b->pre_sup[op->phy] = -1;
+				else
+					memset( b->pre_sup, -1, sizeof(b->pre_sup) );
+			}
+		} else {
+			if ( b->addr[op->phy][op->dev] != op->reg ) {
+				xact( b, frame( ST_C45, OP_ADDR, op->phy, op->dev, 1, op->reg ), 32 );
+				b->addr[op->phy][op->dev] = op->reg;
+			}
+			c45op = wr ? OP_WRITE : ( MDIO_READ_INC == op->op ? OP_RINC : OP_RD45 );
+			v = xact( b, frame( ST_C45, c45op, op->phy, op->dev, wr, op->val ), 32 );
+			if ( OP_RINC == c45op )
+				b->addr[op->phy][op->dev] = (uint16_t)(op->reg + 1);
+			else if ( wr && REG_CTRL == op->reg && (op->val & CTRL_RST) )
+				forget_port( b, op->phy );
+		}
+		if ( b->gio.err ) {
+			/* the PHY may have seen part of a frame */
+			forget_port( b, op->phy );
+			errno = b->gio.err;
+			return i;
+		}
+		if ( ! wr )
+			op->val = v;
+	}
+	return n;
+}
+
+static bb_bus
+bb_alloc(unsigned flags)
+{
+bb_bus   b;
+unsigned i;
+	if ( ! (b = calloc( 1, sizeof(*b) )) ) {
+		fprintf(stderr,"mdiolib: no memory\n");
+		return 0;
+	}
+	b->flags = flags;
+	memset( b->pre_sup, -1, sizeof(b->pre_sup) );
+	for ( i = 0; i < 32; i++ )
+		forget_port( b, i );
+	return b;
+}
+
+/* MDC low, MDIO idle; then calibrate */
+static mdio_bus
+bb_start(bb_bus b, unsigned khz)
+{
+	if ( khz > MDC_KHZ_DFLT ) {
+		fprintf(stderr,"mdiolib: invalid MDC rate (1..%d kHz)\n", MDC_KHZ_DFLT);
+		b->hdr.be->close( &b->hdr );
+		errno = EINVAL;
+		return 0;
+	}
+	b->gio.err = 0;
+	b->io.put( b->io.ioc, WV_OUT );
+	calibrate( &b->io, khz, &b->tim );
+	if ( b->gio.err ) {
+		fprintf(stderr,"mdiolib: unable to calibrate the bit-bang engine\n");
+		errno = b->gio.err;
+		b->hdr.be->close( &b->hdr );
+		return 0;
+	}
+	return &b->hdr;
+}
+
+static int
+parse_pin(const char *s, unsigned *pin_p)
+{
+unsigned p;
+	if ( 1 == sscanf(s, "emio%u", &p) ) {
+		*pin_p = GPIO_EMIO( p );
+	} else if ( 1 == sscanf(s, "mio%u", &p) ) {
+		*pin_p = p;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+/* Use direct register access if the backend supports it (zynq); the
+ * outputs must be in the same bank so that a single MASK_DATA write
+ * updates both of them.
+ */
+static void
+sel_zynq(bb_bus b)
+{
+gpio_zynq_pin r[3];
+unsigned      st;
+
+	if ( gpio_group_zynq_regs( b->gio.grp, r ) || r[0].md_reg != r[1].md_reg )
+		return;
+	b->gio.md_reg = r[0].md_reg;
+	for ( st = 0; st < 4; st++ ) {
+		b->gio.md_val[st] = GPIO_ZYNQ_MASK_DATA( r[0].md_bit | r[1].md_bit,
+		                                         ((st & WV_CLK) ? r[0].md_bit : 0) | ((st & WV_OUT) ? r[1].md_bit : 0) );
+	}
+	b->gio.ro_reg = r[2].ro_reg;
+	b->gio.ro_bit = r[2].bit;
+	b->io.play    = wv_play_zynq;
+}
+
+static mdio_bus
+gpio_bus_open(const char *arg, unsigned khz, unsigned flags)
+{
+bb_bus   b;
+unsigned pins[3];
+char     buf[3][32];
+
+	/* order must match GRP_xxx */
+	pins[0] = GPIO_PIN_CLK;
+	pins[1] = GPIO_PIN_OUT;
+	pins[2] = GPIO_PIN_INP;
+	if ( arg ) {
+		if (    3 != sscanf( arg, "%31[^,],%31[^,],%31s", buf[0], buf[1], buf[2] )
+		     || parse_pin( buf[0], &pins[0] )
+		     || parse_pin( buf[1], &pins[1] )
+		     || parse_pin( buf[2], &pins[2] ) ) {
+			fprintf(stderr,"mdiolib: invalid pins '%s' (need [e]mio<X>,[e]mio<Y>,[e]mio<Z>)\n", arg);
+			errno = EINVAL;
+			return 0;
+		}
+	}
+	if ( ! (b = bb_alloc( flags )) )
+		return 0;
+	b->hdr.be  = &mdio_backend_gpio;
+	b->io.put  = put_gpio;
+	b->io.get  = get_gpio;
+	b->io.play = wv_play_gpio;
+	b->io.ioc  = &b->gio;
+	if ( ! (b->gio.grp = gpio_group_open( pins, 3 )) ) {
+		fprintf(stderr,"mdiolib: unable to open GPIO pins\n");
+		free( b );
+		return 0;
+	}
+	if ( gpio_group_dir( b->gio.grp, GRP_CLK | GRP_OUT | GRP_INP, GRP_CLK | GRP_OUT ) ) {
+		fprintf(stderr,"mdiolib: unable to set GPIO direction\n");
+		gpio_group_close( b->gio.grp );
+		free( b );
+		return 0;
+	}
+	sel_zynq( b );
+	return bb_start( b, khz );
+}
+
+static void
+gpio_bus_close(mdio_bus p)
+{
+bb_bus b = (bb_bus)p;
+	gpio_group_close( b->gio.grp );
+	free( b );
+}
+
+static mdio_bus
+mmio_bus_open(const char *arg, unsigned khz, unsigned flags)
+{
+bb_bus b;
+
+	if ( ! (b = bb_alloc( flags )) )
+		return 0;
+	b->hdr.be  = &mdio_backend_mmio;
+	b->io.put  = put_mmio;
+	b->io.get  = get_mmio;
+	b->io.play = wv_play_mmio;
+	b->io.ioc  = &b->mio;
+	if ( ! (b->mio.mio = arm_mmio_init( arg ? arg : MMIO_DEV_DFLT )) ) {
+		fprintf(stderr,"mdiolib: unable to open MMIO/UIO device\n");
+		free( b );
+		return 0;
+	}
+	b->mio.cmd = ioread32(b->mio.mio, REG_CMD) & ~(CMD_CLK | CMD_VAL);
+	return bb_start( b, khz );
+}
+
+static void
+mmio_bus_close(mdio_bus p)
+{
+bb_bus b = (bb_bus)p;
+	arm_mmio_exit( b->mio.mio );
+	free( b );
+}
+
+int
+mdio_bb_bench(mdio_bus p, double *ns_generic, double *ns_special, const char **kind)
+{
+bb_bus   b    = (bb_bus)p;
+wv_tim   none = { { 0, 0 } };
+wave     w;
+unsigned i;
+uint64_t t0, t_gen, t_spc;
+
+	if ( p->be != &mdio_backend_gpio && p->be != &mdio_backend_mmio ) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	b->gio.err = 0;
+	w.n = 0;
+	wv_bits( &w, 0xffffffff, 32 );
+	t0 = mdio_ts_now();
+	for ( i = 0; i < BENCH_RUNS; i++ )
+		wv_play_generic( &b->io, &w, &none );
+	t_gen = mdio_ts_now() - t0;
+	t0 = mdio_ts_now();
+	for ( i = 0; i < BENCH_RUNS; i++ )
+		wv_play( &b->io, &w, &none );
+	t_spc = mdio_ts_now() - t0;
+	if ( b->gio.err ) {
+		errno = b->gio.err;
+		return -1;
+	}
+
+	*ns_generic = (double)t_gen / (32.0 * BENCH_RUNS);
+	*ns_special = (double)t_spc / (32.0 * BENCH_RUNS);
+	*kind       = b->io.play == wv_play_zynq ? "zynq" : (b->io.play == wv_play_mmio ? "mmio" : "gpio");
+	return 0;
+}
+
+const mdio_backend mdio_backend_gpio = {
+	name:  "gpio",
+	open:  gpio_bus_open,
+	close: gpio_bus_close,
+	xfer:  bb_xfer,
+};
+
+const mdio_backend mdio_backend_mmio = {
+	name:  "mmio",
+	open:  mmio_bus_open,
+	close: mmio_bus_close,
+	xfer:  bb_xfer,
+};
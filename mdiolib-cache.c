@@ -0,0 +1,450 @@
+/* Read-through register cache (see mdiolib.h).
+ *
+ * Values live in an open-addressing hash table keyed by port, device
+ * and register; entries are never removed, only marked invalid (the
+ * number of distinct registers a tool touches is small). Classes are a
+ * list of range rules, the last matching rule wins (so rules added by
+ * the application override the defaults).
+ */
+
+#include <mdiolib-impl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define TBL_INIT 256  /* power of two */
+
+#define MDIO_CTRL      0
+#define  MDIO_CTRL_RST (1<<15)
+
+/* port (5 bits) | dev + 1 (6 bits; 0 is clause 22) | reg (16 bits) */
+#define KEY(phy, dev, reg) ( ((uint32_t)(phy) << 22) | ((uint32_t)((dev) + 1) << 16) | (reg) )
+#define KEY_PHY(k)         ( (k) >> 22 )
+#define KEY_DEV(k)         ( (int)(((k) >> 16) & 0x3f) - 1 )
+#define KEY_REG(k)         ( (k) & 0xffff )
+
+typedef struct entry_ {
+	uint32_t key;
+	uint16_t val;
+	uint8_t  used;
+	uint8_t  valid;
+	uint16_t run;    /* produced by backend run # 'run' */
+} entry;
+
+typedef struct rule_ {
+	int      prt, dev;     /* MDIO_ANY: wildcard (dev: any clause 45 MMD) */
+	unsigned first, last;
+	int      cls;
+} rule;
+
+struct mdio_cache_ {
+	entry        *tbl;
+	unsigned      sz, used;
+	rule         *rules;
+	unsigned      nrules;
+	char         *path;
+	unsigned long hits, misses;
+	uint16_t      run;
+};
+
+/* IEEE identifier registers */
+static const char *dflt_rules = "c22.2-3=s,*.2-3=s,*.5-6=s,*.14-15=s";
+
+static entry *
+lkup(mdio_cache c, uint32_t key)
+{
+unsigned i = (key * 2654435761U) & (c->sz - 1);
+	while ( c->tbl[i].used && c->tbl[i].key != key )
+		i = (i + 1) & (c->sz - 1);
+	return &c->tbl[i];
+}
+
+static int
+grow(mdio_cache c)
+{
+entry   *o  = c->tbl;
+unsigned sz = c->sz;
+unsigned i;
+entry   *e;
+
+	if ( ! (c->tbl = calloc( 2*sz, sizeof(*c->tbl) )) ) {
+		c->tbl = o;
+		return -1;
+	}
+	c->sz = 2*sz;
+	for ( i = 0; i < sz; i++ ) {
+		if ( o[i].used ) {
+			e  = lkup( c, o[i].key );
+			*e = o[i];
+		}
+	}
+	free( o );
+	return 0;
+}
+
+/* find or create (invalid) */
+static entry *
+slot(mdio_cache c, uint32_t key)
+{
+entry *e;
+	/* keep the load below 3/4; without memory we just don't cache */
+	if ( 4*(c->used + 1) > 3*c->sz && grow( c ) )
+		return 0;
+	e = lkup( c, key );
+	if ( ! e->used ) {
+		e->used  = 1;
+		e->key   = key;
+		e->valid = 0;
+		e->run   = c->run - 1;
+		c->used++;
+	}
+	return e;
+}
+
+static void
+store(mdio_cache c, uint32_t key, uint16_t val)
+{
+entry *e;
+	if ( (e = slot( c, key )) ) {
+		e->val   = val;
+		e->valid = 1;
+	}
+}
+
+static void
+drop(mdio_cache c, uint32_t key)
+{
+entry *e = lkup( c, key );
+	if ( e->used )
+		e->valid = 0;
+}
+
+static int
+cls_of(mdio_cache c, unsigned phy, int dev, unsigned reg)
+{
+unsigned i = c->nrules;
+rule    *r;
+	while ( i-- > 0 ) {
+		r = &c->rules[i];
+		if (    ( MDIO_ANY == r->prt || r->prt == (int)phy )
+		     && ( r->dev == dev || (MDIO_ANY == r->dev && MDIO_C22 != dev) )
+		     && reg >= r->first && reg <= r->last )
+			return r->cls;
+	}
+	return MDIO_REG_VOLATILE;
+}
+
+static int
+hit(mdio_cache c, const mdio_op *op, uint16_t *val)
+{
+entry *e;
+	if ( MDIO_WRITE == op->op || MDIO_REG_VOLATILE == cls_of( c, op->phy, op->dev, op->reg ) )
+		return 0;
+	e = lkup( c, KEY( op->phy, op->dev, op->reg ) );
+	if ( ! e->used || ! e->valid )
+		return 0;
+	*val = e->val;
+	return 1;
+}
+
+void
+mdio_cache_invalidate(mdio_bus b, int prt, int dev)
+{
+mdio_cache c = b->cache;
+unsigned   i;
+uint32_t   k;
+
+	if ( ! c )
+		return;
+	for ( i = 0; i < c->sz; i++ ) {
+		k = c->tbl[i].key;
+		if (    c->tbl[i].used
+		     && ( MDIO_ANY == prt || (int)KEY_PHY( k ) == prt )
+		     && ( MDIO_ANY == dev || KEY_DEV( k ) == dev ) )
+			c->tbl[i].valid = 0;
+	}
+}
+
+/* account for operations executed by the backend */
+static void
+update(mdio_bus b, const mdio_op ops[], unsigned n)
+{
+mdio_cache     c = b->cache;
+const mdio_op *op;
+unsigned       i;
+int            cls;
+
+	for ( i = 0; i < n; i++ ) {
+		op  = &ops[i];
+		cls = cls_of( c, op->phy, op->dev, op->reg );
+		if ( MDIO_WRITE != op->op ) {
+			if ( MDIO_REG_VOLATILE != cls )
+				store( c, KEY( op->phy, op->dev, op->reg ), op->val );
+		} else if ( MDIO_CTRL == op->reg && (op->val & MDIO_CTRL_RST) ) {
+			/* as the backends: a reset may affect all MMDs of the port */
+			mdio_cache_invalidate( b, op->phy, MDIO_C22 == op->dev ? MDIO_C22 : MDIO_ANY );
+		} else if ( MDIO_REG_WRITE_THROUGH == cls ) {
+			store( c, KEY( op->phy, op->dev, op->reg ), op->val );
+		} else if ( MDIO_REG_STATIC == cls ) {
+			drop( c, KEY( op->phy, op->dev, op->reg ) );
+		}
+	}
+}
+
+/* Does the run being collected make 'op' a hit? Marks the entries the
+ * run produces.
+ */
+static int
+in_run(mdio_cache c, const mdio_op *op)
+{
+entry *e;
+int    cls = cls_of( c, op->phy, op->dev, op->reg );
+
+	if ( MDIO_REG_VOLATILE == cls || (MDIO_WRITE == op->op && MDIO_REG_WRITE_THROUGH != cls) )
+		return 0;
+	if ( ! (e = slot( c, KEY( op->phy, op->dev, op->reg ) )) )
+		return 0;
+	if ( MDIO_WRITE != op->op && e->run == c->run )
+		return 1;
+	e->run = c->run;
+	return 0;
+}
+
+/* Hits are served from the cache; runs of misses go to the backend as
+ * one batch. A run ends before an operation which is a hit or will be
+ * one once the run is executed (a read after a write-through or a
+ * second read); this is decided again afterwards (the run may also
+ * have reset the PHY).
+ */
+int
+mdio_cache_xfer(mdio_bus b, mdio_op ops[], unsigned n)
+{
+mdio_cache c = b->cache;
+unsigned   i = 0, j;
+int        done;
+uint16_t   v;
+
+	while ( i < n ) {
+		if ( hit( c, &ops[i], &ops[i].val ) ) {
+			c->hits++;
+			i++;
+			continue;
+		}
+		c->run++;
+		in_run( c, &ops[i] );
+		for ( j = i + 1; j < n && ! hit( c, &ops[j], &v ) && ! in_run( c, &ops[j] ); j++ )
+			;
+		done = b->be->xfer( b, ops + i, j - i );
+		if ( done > 0 )
+			update( b, ops + i, done );
+		c->misses += j - i;
+		if ( done < (int)(j - i) )
+			return i + (done > 0 ? done : 0);
+		i = j;
+	}
+	return n;
+}
+
+int
+mdio_cache_class(mdio_bus b, int prt, int dev, unsigned first, unsigned last, int cls)
+{
+mdio_cache c = b->cache;
+rule      *r;
+
+	if (    ! c
+	     || ( MDIO_ANY != prt && (prt < 0 || prt > 31) )
+	     || ( MDIO_ANY != dev && MDIO_C22 != dev && (dev < 0 || dev > 31) )
+	     || first > last || last > (MDIO_C22 == dev ? 31 : 0xffff)
+	     || cls < MDIO_REG_VOLATILE || cls > MDIO_REG_WRITE_THROUGH ) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ( ! (r = realloc( c->rules, (c->nrules + 1) * sizeof(*r) )) )
+		return -1;
+	c->rules = r;
+	r += c->nrules++;
+	r->prt   = prt;
+	r->dev   = dev;
+	r->first = first;
+	r->last  = last;
+	r->cls   = cls;
+	return 0;
+}
+
+static int
+parse_sel(const char *s, int *v, int max)
+{
+char *e;
+	if ( ! strcmp( s, "*" ) ) {
+		*v = MDIO_ANY;
+		return 0;
+	}
+	*v = strtol( s, &e, 0 );
+	return ( e == s || *e || *v < 0 || *v > max ) ? -1 : 0;
+}
+
+int
+mdio_cache_rules(mdio_bus b, const char *rules)
+{
+char    *buf, *tok, *sp, *reg, *cls, *sl, *e;
+int      prt, dev, c;
+unsigned first, last;
+int      rval = -1;
+
+	if ( ! (buf = strdup( rules )) )
+		return -1;
+	for ( tok = strtok_r( buf, ",", &sp ); tok; tok = strtok_r( 0, ",", &sp ) ) {
+		prt = MDIO_ANY;
+		if ( ! (cls = strchr( tok, '=' )) || ! (reg = strchr( tok, '.' )) || reg > cls )
+			goto bad;
+		*cls++ = 0;
+		*reg++ = 0;
+		if ( (sl = strchr( tok, '/' )) ) {
+			*sl++ = 0;
+			if ( parse_sel( tok, &prt, 31 ) )
+				goto bad;
+			tok = sl;
+		}
+		if ( ! strcmp( tok, "c22" ) )
+			dev = MDIO_C22;
+		else if ( parse_sel( tok, &dev, 31 ) )
+			goto bad;
+		first = last = strtoul( reg, &e, 0 );
+		if ( e == reg )
+			goto bad;
+		if ( '-' == *e ) {
+			reg  = e + 1;
+			last = strtoul( reg, &e, 0 );
+			if ( e == reg )
+				goto bad;
+		}
+		if ( *e )
+			goto bad;
+		switch ( cls[0] ) {
+			case 'v': c = MDIO_REG_VOLATILE;      break;
+			case 's': c = MDIO_REG_STATIC;        break;
+			case 'w': c = MDIO_REG_WRITE_THROUGH; break;
+			default : goto bad;
+		}
+		if ( cls[1] || mdio_cache_class( b, prt, dev, first, last, c ) )
+			goto bad;
+	}
+	rval = 0;
+bail:
+	free( buf );
+	return rval;
+bad:
+	fprintf(stderr,"mdiolib: invalid cache rule '%s' ([<prt>/]<dev>|c22.<first>[-<last>]=v|s|w)\n", tok);
+	errno = EINVAL;
+	goto bail;
+}
+
+/* text: one '<prt> <dev> <reg> <val>' per line */
+static void
+load(mdio_cache c)
+{
+FILE    *f;
+unsigned phy, reg, val;
+int      dev;
+
+	if ( ! (f = fopen( c->path, "r" )) )
+		return;
+	while ( 4 == fscanf( f, "%u %d %u %x", &phy, &dev, &reg, &val ) ) {
+		if ( phy <= 31 && dev >= MDIO_C22 && dev <= 31 && reg <= 0xffff )
+			store( c, KEY( phy, dev, reg ), val );
+	}
+	fclose( f );
+}
+
+/* write a new file and rename it, i.e., readers never see a partial one */
+static void
+save(mdio_cache c)
+{
+FILE    *f;
+char    *tmp;
+unsigned i;
+uint32_t k;
+
+	if ( ! (tmp = malloc( strlen( c->path ) + sizeof(".tmp") )) )
+		return;
+	sprintf( tmp, "%s.tmp", c->path );
+	if ( ! (f = fopen( tmp, "w" )) ) {
+		fprintf(stderr,"mdiolib: unable to save cache to '%s': %s\n", tmp, strerror(errno));
+		free( tmp );
+		return;
+	}
+	for ( i = 0; i < c->sz; i++ ) {
+		k = c->tbl[i].key;
+		if (    c->tbl[i].used && c->tbl[i].valid
+		     && MDIO_REG_VOLATILE != cls_of( c, KEY_PHY( k ), KEY_DEV( k ), KEY_REG( k ) ) )
+			fprintf( f, "%u %d %u 0x%04x\n", KEY_PHY( k ), KEY_DEV( k ), KEY_REG( k ), c->tbl[i].val );
+	}
+	if ( fclose( f ) || rename( tmp, c->path ) ) {
+		fprintf(stderr,"mdiolib: unable to save cache to '%s': %s\n", c->path, strerror(errno));
+		unlink( tmp );
+	}
+	free( tmp );
+}
+
+void
+mdio_cache_destroy(mdio_bus b)
+{
+mdio_cache c = b->cache;
+	if ( ! c )
+		return;
+	if ( c->path )
+		save( c );
+	free( c->path );
+	free( c->rules );
+	free( c->tbl );
+	free( c );
+	b->cache = 0;
+}
+
+int
+mdio_cache_enable(mdio_bus b, const char *path)
+{
+mdio_cache c;
+
+	if ( b->cache ) {
+		errno = EBUSY;
+		return -1;
+	}
+	if (    ! (c = calloc( 1, sizeof(*c) ))
+	     || ! (c->tbl = calloc( TBL_INIT, sizeof(*c->tbl) ))
+	     || ( path && ! (c->path = strdup( path )) ) ) {
+		fprintf(stderr,"mdiolib: no memory\n");
+		goto bail;
+	}
+	c->sz    = TBL_INIT;
+	b->cache = c;
+	if ( mdio_cache_rules( b, dflt_rules ) )
+		goto bail;
+	if ( c->path )
+		load( c );
+	return 0;
+
+bail:
+	if ( c ) {
+		free( c->path );
+		free( c->rules );
+		free( c->tbl );
+		free( c );
+	}
+	b->cache = 0;
+	return -1;
+}
+
+int
+mdio_cache_stats(mdio_bus b, unsigned long *hits, unsigned long *misses)
+{
+	if ( ! b->cache ) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	*hits   = b->cache->hits;
+	*misses = b->cache->misses;
+	return 0;
+}
@@ -0,0 +1,99 @@
+/* mdiolib backend using the PHY access of a network driver ("if"):
+ * SIOCGMIIREG/SIOCSMIIREG on the interface. Clause 45 addresses are
+ * encoded as MDIO_PHY_ID_C45 (the driver does the address cycle); not
+ * all drivers support that (EINVAL).
+ */
+
+#include <mdiolib-impl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/mii.h>
+#include <linux/mdio.h>
+#include <linux/sockios.h>
+
+typedef struct if_bus_ {
+	struct mdio_bus_ hdr;
+	int              sd;
+	struct ifreq     ifr;
+} *if_bus;
+
+static mdio_bus
+if_open(const char *arg, unsigned khz, unsigned flags)
+{
+if_bus b;
+
+	if ( ! arg || strlen( arg ) >= IFNAMSIZ ) {
+		fprintf(stderr,"mdiolib: need a valid interface name (if:<name>)\n");
+		errno = EINVAL;
+		return 0;
+	}
+	if ( ! (b = calloc( 1, sizeof(*b) )) ) {
+		fprintf(stderr,"mdiolib: no memory\n");
+		return 0;
+	}
+	b->hdr.be = &mdio_backend_if;
+	strcpy( b->ifr.ifr_name, arg );
+	if ( (b->sd = socket( AF_INET, SOCK_DGRAM, 0 )) < 0 ) {
+		fprintf(stderr,"mdiolib: unable to create socket: %s\n", strerror(errno));
+		free( b );
+		return 0;
+	}
+	/* probe: also fails if the driver has no MII ioctls */
+	if ( ioctl( b->sd, SIOCGMIIPHY, &b->ifr ) ) {
+		fprintf(stderr,"mdiolib: no PHY access via '%s': %s\n", arg, strerror(errno));
+		close( b->sd );
+		free( b );
+		return 0;
+	}
+	return &b->hdr;
+}
+
+static void
+if_close(mdio_bus p)
+{
+if_bus b = (if_bus)p;
+	close( b->sd );
+	free( b );
+}
+
+static int
+if_xfer(mdio_bus p, mdio_op ops[], unsigned n)
+{
+if_bus                 b   = (if_bus)p;
+struct mii_ioctl_data *mii = (struct mii_ioctl_data*)&b->ifr.ifr_data;
+mdio_op               *op;
+unsigned               i;
+
+	for ( i = 0; i < n; i++ ) {
+		op = &ops[i];
+		if ( MDIO_C22 == op->dev )
+			mii->phy_id = op->phy;
+		else
+			mii->phy_id = mdio_phy_id_c45( op->phy, op->dev );
+		mii->reg_num = op->reg;
+		/* MDIO_READ_INC is a plain read (the driver does the address cycle) */
+		if ( MDIO_WRITE == op->op ) {
+			mii->val_in = op->val;
+			if ( ioctl( b->sd, SIOCSMIIREG, &b->ifr ) )
+				return i;
+		} else {
+			if ( ioctl( b->sd, SIOCGMIIREG, &b->ifr ) )
+				return i;
+			op->val = mii->val_out;
+		}
+	}
+	return n;
+}
+
+const mdio_backend mdio_backend_if = {
+	name:  "if",
+	open:  if_open,
+	close: if_close,
+	xfer:  if_xfer,
+};
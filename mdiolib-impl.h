@@ -0,0 +1,50 @@
+#ifndef MDIOLIB_IMPL_H
+#define MDIOLIB_IMPL_H
+
+/* mdiolib internals; shared by the backends -- not for applications */
+
+#include <mdiolib.h>
+#include <stdint.h>
+
+#define MDC_KHZ_DFLT 2500
+
+/* 'arg' is the part of the spec after the ':' (NULL if there is none).
+ * 'xfer' returns the number of operations completed (see mdio_xfer()).
+ */
+typedef struct mdio_backend_ {
+	const char *name;
+	mdio_bus  (*open) (const char *arg, unsigned khz, unsigned flags);
+	void      (*close)(mdio_bus b);
+	int       (*xfer) (mdio_bus b, mdio_op ops[], unsigned n);
+} mdio_backend;
+
+typedef struct mdio_cache_ *mdio_cache;
+
+/* every backend's bus starts with this header (allocate zeroed) */
+struct mdio_bus_ {
+	const mdio_backend *be;
+	mdio_cache          cache;  /* NULL unless mdio_cache_enable()d */
+};
+
+extern const mdio_backend mdio_backend_gpio;
+extern const mdio_backend mdio_backend_mmio;
+extern const mdio_backend mdio_backend_xgmac;
+extern const mdio_backend mdio_backend_if;
+
+/* 0 if the operation is valid; prints a message otherwise */
+int
+mdio_check_op(const mdio_op *op);
+
+/* mdio_xfer() of a bus with a cache (ops already checked) */
+int
+mdio_cache_xfer(mdio_bus b, mdio_op ops[], unsigned n);
+
+/* save (if persistent) and free the cache */
+void
+mdio_cache_destroy(mdio_bus b);
+
+/* CLOCK_MONOTONIC in ns */
+uint64_t
+mdio_ts_now(void);
+
+#endif
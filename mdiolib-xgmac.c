@@ -0,0 +1,261 @@
+/* mdiolib backend for the MDIO controller of the Xilinx 10G Ethernet
+ * MAC ("xgmac"); clause 45 only.
+ *
+ * Spec: "xgmac:<uio-device>[,irq][,div=<n>]"
+ *   irq  : block for the MAC's MDIO-done interrupt (UIO) rather than
+ *          busy-polling the ready bit
+ *   div  : MDC divider (0..63; MDC = s_axi_aclk / (2*(div+1))); written
+ *          and read back. Default: leave a configured divider alone,
+ *          otherwise use DIV.
+ *
+ * The last address written to each MMD is remembered and address
+ * cycles are skipped when it is unchanged (we assume nobody else
+ * talks to the PHYs while the bus is open).
+ */
+
+#include <mdiolib-impl.h>
+#include <arm-mmio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define REG_C0 0x140 /* register, not byte-offset (0x500) */
+#define REG_C1 0x141 /* register, not byte-offset (0x504) */
+#define REG_TD 0x142 /* register, not byte-offset (0x508) */
+#define REG_RD 0x143 /* register, not byte-offset (0x50c) */
+
+/* interrupt registers; bit 0 signals MDIO completion */
+#define REG_IS 0x180 /* status  (0x600) */
+#define REG_IE 0x188 /* enable  (0x620) */
+#define REG_IC 0x18c /* clear   (0x630) */
+#define  IRQ_MDIO 1
+
+#define DIV    62    /* 156.25MHz / 2.5MHz                */
+#define DIV_MAX 63
+#define C0_ENA  (1<<6)
+
+#define OP_ADDR (0<<14)
+#define OP_WRTE (1<<14)
+#define OP_READ (3<<14)
+#define OP_RINC (2<<14)  /* post-read-increment-address */
+
+#define CM_GO   0x800
+#define ST_DONE 0x080
+
+#define CMD(p,d,o) (((p)<<24) | ((d)<<16) | (o) | CM_GO)
+
+/* a frame takes ~26us at 2.5MHz; allow for the slowest MDC */
+#define TMO_NS      20000000ULL
+#define POLL_CHUNK  64          /* register reads between clock checks */
+
+#define ADDR_UNKNOWN (-1)
+
+#define REG_CTRL   0
+#define  CTRL_RST  (1<<15)
+
+typedef struct xgmac_bus_ {
+	struct mdio_bus_ hdr;
+	Arm_MMIO         m;
+	int              irq;
+	int32_t          addr[32][32];  /* [prt][dev]; ADDR_UNKNOWN if unknown */
+} *xgmac_bus;
+
+static void
+forget_addr(xgmac_bus b)
+{
+unsigned p, d;
+	for ( p = 0; p < 32; p++ )
+		for ( d = 0; d < 32; d++ )
+			b->addr[p][d] = ADDR_UNKNOWN;
+}
+
+static void
+forget_port(xgmac_bus b, unsigned prt)
+{
+unsigned d;
+	for ( d = 0; d < 32; d++ )
+		b->addr[prt][d] = ADDR_UNKNOWN;
+}
+
+static int
+wait_irq(xgmac_bus b)
+{
+uint32_t cnt;
+	if ( sizeof(cnt) != read( b->m->fd, &cnt, sizeof(cnt) ) ) {
+		fprintf(stderr,"mdiolib: blocking for IRQ -- read error: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Returns 0 when the operation completed, -1 (errno ETIMEDOUT or from
+ * the UIO read) otherwise; the address cache is invalidated on error
+ * since we do not know what the PHY saw.
+ */
+static int
+exec_cmd(xgmac_bus b, uint32_t cmd)
+{
+uint32_t ena = 1;
+uint64_t end = 0;
+unsigned i;
+
+	if ( b->irq ) {
+		iowrite32(b->m, REG_IC, IRQ_MDIO);
+		if ( sizeof(ena) != write( b->m->fd, &ena, sizeof(ena) ) ) {
+			fprintf(stderr,"mdiolib: enabling IRQ failed: %s\n", strerror(errno));
+			goto bail;
+		}
+	}
+	iowrite32(b->m, REG_C1, cmd  );
+	if ( b->irq && wait_irq( b ) )
+		goto bail;
+	/* with IRQ this is just the final check */
+	while ( 1 ) {
+		for ( i = 0; i < POLL_CHUNK; i++ ) {
+			if ( (ioread32(b->m, REG_C1) & ST_DONE) )
+				return 0;
+		}
+		if ( ! end ) {
+			end = mdio_ts_now() + TMO_NS;
+		} else if ( mdio_ts_now() > end ) {
+			fprintf(stderr,"mdiolib: xgmac MDIO operation timed out\n");
+			errno = ETIMEDOUT;
+			goto bail;
+		}
+	}
+bail:
+	forget_addr( b );
+	return -1;
+}
+
+/* set divider and enable; returns 0 if the readback matches */
+static int
+set_div(xgmac_bus b, unsigned div)
+{
+uint32_t x;
+	iowrite32(b->m, REG_C0, C0_ENA | div);
+	x = ioread32(b->m, REG_C0);
+	if ( (x & (C0_ENA | DIV_MAX)) != (C0_ENA | div) ) {
+		fprintf(stderr,"mdiolib: xgmac MDIO config readback mismatch (wrote 0x%"PRIx32", got 0x%"PRIx32")\n",
+			(uint32_t)(C0_ENA | div), x);
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+static mdio_bus
+xgmac_open(const char *arg, unsigned khz, unsigned flags)
+{
+xgmac_bus b;
+char      dev[256];
+char     *opt, *sp;
+int       div = -1;
+
+	if ( ! arg || strlen( arg ) >= sizeof(dev) ) {
+		fprintf(stderr,"mdiolib: xgmac needs a device (xgmac:<uio-device>[,irq][,div=<n>])\n");
+		errno = EINVAL;
+		return 0;
+	}
+	if ( ! (b = calloc( 1, sizeof(*b) )) ) {
+		fprintf(stderr,"mdiolib: no memory\n");
+		return 0;
+	}
+	b->hdr.be = &mdio_backend_xgmac;
+	forget_addr( b );
+	strcpy( dev, arg );
+	strtok_r( dev, ",", &sp );
+	while ( (opt = strtok_r( 0, ",", &sp )) ) {
+		if ( 0 == strcmp( opt, "irq" ) ) {
+			b->irq = 1;
+		} else if ( 1 != sscanf( opt, "div=%i", &div ) || div < 0 || div > DIV_MAX ) {
+			fprintf(stderr,"mdiolib: invalid xgmac option '%s'\n", opt);
+			errno = EINVAL;
+			free( b );
+			return 0;
+		}
+	}
+	if ( ! (b->m = arm_mmio_init( dev )) ) {
+		fprintf(stderr,"mdiolib: unable to open device '%s'\n", dev);
+		free( b );
+		return 0;
+	}
+	if ( div >= 0 ) {
+		if ( set_div( b, div ) )
+			goto bail;
+	} else if ( 0 == ioread32(b->m, REG_C0) ) {
+		/* Make sure divider is initialized */
+		fprintf(stderr,"Info: Setting divider to %i and enabling MDIO interface\n", DIV);
+		if ( set_div( b, DIV ) )
+			goto bail;
+	}
+	if ( b->irq )
+		iowrite32(b->m, REG_IE, ioread32(b->m, REG_IE) | IRQ_MDIO);
+	return &b->hdr;
+
+bail:
+	arm_mmio_exit( b->m );
+	free( b );
+	return 0;
+}
+
+static void
+xgmac_close(mdio_bus p)
+{
+xgmac_bus b = (xgmac_bus)p;
+	if ( b->irq )
+		iowrite32(b->m, REG_IE, ioread32(b->m, REG_IE) & ~IRQ_MDIO);
+	arm_mmio_exit( b->m );
+	free( b );
+}
+
+static int
+xgmac_xfer(mdio_bus p, mdio_op ops[], unsigned n)
+{
+xgmac_bus b = (xgmac_bus)p;
+mdio_op  *op;
+unsigned  i;
+uint32_t  cmd;
+
+	for ( i = 0; i < n; i++ ) {
+		op = &ops[i];
+		if ( MDIO_C22 == op->dev ) {
+			errno = ENOTSUP;
+			return i;
+		}
+		cmd = CMD(op->phy, op->dev, 0);
+		/* Address */
+		if ( b->addr[op->phy][op->dev] != op->reg ) {
+			iowrite32(b->m, REG_TD, op->reg);
+			if ( exec_cmd(b, cmd | OP_ADDR) )
+				return i;
+			b->addr[op->phy][op->dev] = op->reg;
+		}
+		if ( MDIO_WRITE == op->op ) {
+			iowrite32(b->m, REG_TD, op->val);
+			if ( exec_cmd(b, cmd | OP_WRTE) )
+				return i;
+			if ( REG_CTRL == op->reg && (op->val & CTRL_RST) )
+				forget_port( b, op->phy );
+		} else if ( MDIO_READ_INC == op->op ) {
+			if ( exec_cmd(b, cmd | OP_RINC) )
+				return i;
+			op->val = ioread32(b->m, REG_RD);
+			b->addr[op->phy][op->dev] = (uint16_t)(op->reg + 1);
+		} else {
+			if ( exec_cmd(b, cmd | OP_READ) )
+				return i;
+			op->val = ioread32(b->m, REG_RD);
+		}
+	}
+	return n;
+}
+
+const mdio_backend mdio_backend_xgmac = {
+	name:  "xgmac",
+	open:  xgmac_open,
+	close: xgmac_close,
+	xfer:  xgmac_xfer,
+};
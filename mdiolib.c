@@ -0,0 +1,147 @@
+#include <mdiolib-impl.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+static const mdio_backend *backends[] = {
+	&mdio_backend_gpio,
+	&mdio_backend_mmio,
+	&mdio_backend_xgmac,
+	&mdio_backend_if,
+	0
+};
+
+uint64_t
+mdio_ts_now(void)
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+mdio_bus
+mdio_open(const char *spec, unsigned khz, unsigned flags)
+{
+const mdio_backend **be;
+const char          *arg;
+size_t               l;
+
+	if ( ! spec ) {
+		errno = EINVAL;
+		return 0;
+	}
+	arg = strchr( spec, ':' );
+	l   = arg ? (size_t)(arg - spec) : strlen( spec );
+	if ( arg && ! *++arg )
+		arg = 0;
+	for ( be = backends; *be; be++ ) {
+		if ( l == strlen( (*be)->name ) && 0 == strncmp( spec, (*be)->name, l ) )
+			return (*be)->open( arg, khz ? khz : MDC_KHZ_DFLT, flags );
+	}
+	fprintf(stderr,"mdiolib: unknown bus '%s' (gpio, mmio, xgmac:<dev> or if:<name>)\n", spec);
+	errno = EINVAL;
+	return 0;
+}
+
+void
+mdio_close(mdio_bus b)
+{
+	if ( b ) {
+		mdio_cache_destroy( b );
+		b->be->close( b );
+	}
+}
+
+int
+mdio_check_op(const mdio_op *op)
+{
+	if ( op->op != MDIO_READ && op->op != MDIO_WRITE && op->op != MDIO_READ_INC ) {
+		fprintf(stderr,"mdiolib: invalid operation %d\n", op->op);
+		return -1;
+	}
+	if ( op->phy > 31 ) {
+		fprintf(stderr,"mdiolib: invalid phy/port address %d\n", op->phy);
+		return -1;
+	}
+	if ( MDIO_C22 == op->dev ) {
+		if ( MDIO_READ_INC == op->op ) {
+			fprintf(stderr,"mdiolib: post-read-increment is clause 45 only\n");
+			return -1;
+		}
+		if ( op->reg > 31 ) {
+			fprintf(stderr,"mdiolib: invalid (clause 22) register %d\n", op->reg);
+			return -1;
+		}
+	} else if ( op->dev < 0 || op->dev > 31 ) {
+		fprintf(stderr,"mdiolib: invalid device address %d\n", op->dev);
+		return -1;
+	}
+	return 0;
+}
+
+int
+mdio_xfer(mdio_bus b, mdio_op ops[], unsigned n)
+{
+unsigned i;
+	for ( i = 0; i < n; i++ ) {
+		if ( mdio_check_op( &ops[i] ) ) {
+			errno = EINVAL;
+			/* nothing executed */
+			return 0;
+		}
+	}
+	if ( b->cache )
+		return mdio_cache_xfer( b, ops, n );
+	return b->be->xfer( b, ops, n );
+}
+
+static int
+xfer1(mdio_bus b, int op, unsigned phy, int dev, unsigned reg, uint16_t val)
+{
+mdio_op o;
+	if ( phy > 255 || reg > 0xffff ) {
+		errno = EINVAL;
+		return -1;
+	}
+	o.op  = op;
+	o.phy = phy;
+	o.dev = dev;
+	o.reg = reg;
+	o.val = val;
+	if ( 1 != mdio_xfer( b, &o, 1 ) )
+		return -1;
+	return MDIO_READ == op ? o.val : 0;
+}
+
+int
+mdio_read(mdio_bus b, unsigned phy, unsigned reg)
+{
+	return xfer1( b, MDIO_READ, phy, MDIO_C22, reg, 0 );
+}
+
+int
+mdio_write(mdio_bus b, unsigned phy, unsigned reg, uint16_t val)
+{
+	return xfer1( b, MDIO_WRITE, phy, MDIO_C22, reg, val );
+}
+
+int
+mdio_read45(mdio_bus b, unsigned prt, unsigned dev, unsigned reg)
+{
+	if ( dev > 31 ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return xfer1( b, MDIO_READ, prt, dev, reg, 0 );
+}
+
+int
+mdio_write45(mdio_bus b, unsigned prt, unsigned dev, unsigned reg, uint16_t val)
+{
+	if ( dev > 31 ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return xfer1( b, MDIO_WRITE, prt, dev, reg, val );
+}
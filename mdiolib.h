@@ -0,0 +1,135 @@
+#ifndef MDIOLIB_H
+#define MDIOLIB_H
+
+#include <stdint.h>
+
+/* MDIO (clause 22/45) access with pluggable backends */
+
+typedef struct mdio_bus_ *mdio_bus;
+
+/* Open a bus; 'spec' selects the backend:
+ *
+ *   "gpio[:mdc,mdio-out,mdio-in]"
+ *             : bit-bang via gpiolib (any gpiolib backend; direct
+ *               register access with "zynq"). Pins are mio<X> or
+ *               emio<X>, default emio4,emio5,emio11.
+ *   "mmio[:dev]"
+ *             : bit-bang via the MDIO register of our fabric core
+ *               (default /dev/uio2)
+ *   "xgmac:dev"
+ *             : MDIO controller of the Xilinx 10G Ethernet MAC
+ *               (UIO device); clause 45 only
+ *   "if:name" : PHY access of the kernel driver of network interface
+ *               'name' (SIOCGMIIREG/SIOCSMIIREG; clause 45 is passed
+ *               on as MDIO_PHY_ID_C45, if the driver supports it)
+ *
+ * 'khz' is the MDC rate for the bit-bang backends (0: 2500 kHz; they
+ * busy-wait) and ignored by the others.
+ * 'flags':
+ *   MDIO_F_SUPPRESS_PREAMBLE: bit-bang backends omit the preamble of
+ *     clause 22 frames to PHYs which support it (BMSR bit 6; read with
+ *     the first frame to a PHY and again after a BMCR reset is written).
+ *
+ * Returns NULL on error.
+ */
+#define MDIO_F_SUPPRESS_PREAMBLE (1<<0)
+
+mdio_bus mdio_open(const char *spec, unsigned khz, unsigned flags);
+
+void     mdio_close(mdio_bus);
+
+/* Operations; 'dev' is the MMD for clause 45 and MDIO_C22 for a
+ * clause 22 frame (to PHY 'phy').
+ * A clause 45 operation is preceded by an address cycle unless the
+ * backend knows that the MMD's address register already holds 'reg'
+ * (e.g., after a MDIO_READ_INC of 'reg - 1'); writing a reset (bit 15
+ * of register 0) forgets the addresses of the port.
+ * MDIO_READ_INC (clause 45 only) uses the post-read-increment-address
+ * opcode, i.e., a run of MDIO_READ_INC over consecutive registers costs
+ * one frame per register (backends without this opcode do plain reads).
+ * Reads store the result in 'val'.
+ */
+#define MDIO_C22      (-1)
+
+#define MDIO_READ     0
+#define MDIO_WRITE    1
+#define MDIO_READ_INC 2
+
+typedef struct mdio_op_ {
+	uint8_t  op;
+	uint8_t  phy;
+	int8_t   dev;
+	uint16_t reg;
+	uint16_t val;
+} mdio_op;
+
+/* Execute 'n' operations in order (the bit-bang backends calibrate
+ * and set up once, the others avoid per-call overhead).
+ * Returns the number of operations completed; less than 'n' means
+ * ops[<return value>] failed (errno set).
+ */
+int mdio_xfer(mdio_bus, mdio_op ops[], unsigned n);
+
+/* Single operations; reads return the value (0..0xffff), all return
+ * -1 (with errno set) on error.
+ */
+int mdio_read   (mdio_bus, unsigned phy, unsigned reg);
+int mdio_write  (mdio_bus, unsigned phy, unsigned reg, uint16_t val);
+int mdio_read45 (mdio_bus, unsigned prt, unsigned dev, unsigned reg);
+int mdio_write45(mdio_bus, unsigned prt, unsigned dev, unsigned reg, uint16_t val);
+
+/* Register cache (any backend): reads of registers classified
+ *   MDIO_REG_STATIC        : never change (IDs); cached on first read
+ *   MDIO_REG_WRITE_THROUGH : only change when written (by us); writes
+ *                            go to the PHY and update the cache
+ *   MDIO_REG_VOLATILE      : status, counters, self-clearing bits; never
+ *                            cached (the default)
+ * are served from the cache once known; runs of other operations still
+ * go to the backend as one batch. Writing a reset (bit 15 of register
+ * 0) invalidates the port (clause 22: the PHY's clause 22 registers,
+ * clause 45: all MMDs).
+ *
+ * mdio_cache_enable() also classifies the IEEE identifier registers
+ * (c22.2-3, *.2-3, *.5-6, *.14-15) static. With a 'path' (put it on a
+ * tmpfs, e.g., /run, so it doesn't survive a power-cycle) the cache is
+ * loaded from there and saved by mdio_close(), i.e., it persists across
+ * invocations; it must only be shared by programs using the same rules
+ * on the same bus (remove the file to start over).
+ * Returns 0 on success, -1 on error.
+ */
+#define MDIO_REG_VOLATILE      0
+#define MDIO_REG_STATIC        1
+#define MDIO_REG_WRITE_THROUGH 2
+
+/* wildcard port/device; a wildcard device matches clause 45 MMDs only */
+#define MDIO_ANY      (-2)
+
+int  mdio_cache_enable(mdio_bus, const char *path);
+
+/* Classify registers 'first'..'last' of 'dev' (or MDIO_C22) on 'prt';
+ * later rules take precedence over earlier ones.
+ */
+int  mdio_cache_class(mdio_bus, int prt, int dev, unsigned first, unsigned last, int cls);
+
+/* Add rules from a string:
+ *   [<prt>/]<dev>.<first>[-<last>]=<cls>[,...]
+ * where 'prt' is a number or '*' (default), 'dev' a number, 'c22' or
+ * '*' and 'cls' one of 'v', 's', 'w'; e.g., "c22.0=w,c22.4=w,1.0=w".
+ */
+int  mdio_cache_rules(mdio_bus, const char *rules);
+
+/* Forget cached values of 'prt' / 'dev' (MDIO_ANY, MDIO_C22 allowed) */
+void mdio_cache_invalidate(mdio_bus, int prt, int dev);
+
+/* Operations served from the cache / passed to the backend */
+int  mdio_cache_stats(mdio_bus, unsigned long *hits, unsigned long *misses);
+
+/* Bit-bang backends only: per-bit cost of the engine specialized for
+ * the pin access method ('kind' is "gpio", "zynq" or "mmio") and of a
+ * generic one (I/O via function pointers). NOTE: MDC runs unthrottled.
+ * Returns 0 on success, -1 (errno ENOTSUP) for other backends or
+ * errno of a GPIO failure.
+ */
+int mdio_bb_bench(mdio_bus, double *ns_generic, double *ns_special, const char **kind);
+
+#endif
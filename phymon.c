@@ -0,0 +1,435 @@
+/* PHY link monitor
+ *
+ * Keeps an MDIO bus open and polls the link status of one or more
+ * PHYs:
+ *   clause 22: BMSR (1) bit 2
+ *   clause 45: PCS status 1 (<dev>.1) bit 2 (use dev 3, the PCS)
+ * Both bits latch low, i.e., a read reports a link loss since the
+ * previous read. If a read says 'down' we read again at once: a link
+ * that is up again was lost briefly (counted as 'glitch', reported as
+ * down/up).
+ *
+ * Polling is adaptive: after a change a link is polled every 'fast' ms
+ * for 'hold' ms, then the interval doubles with every poll up to 'slow'
+ * ms. Links due at the same time are polled with one mdio_xfer().
+ * 'slow' bounds the time a link loss goes unnoticed; its default (20 ms)
+ * costs one or two register reads per link and interval, i.e., a few
+ * percent of a bit-banged bus (a 64-bit frame takes ~26 us at 2.5 MHz).
+ *
+ * Changes are passed to a callback which prints a line to stdout and
+ * to all clients connected to the (optional) unix socket:
+ *   <seconds> link=<name> state=up|down
+ * SIGUSR1 prints per-link statistics (also at exit):
+ *   <seconds> link=<name> state=.. polls=.. ups=.. downs=.. glitches=.. errors=..
+ *             up_s=.. down_s=..   (one line)
+ */
+
+#include <mdiolib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_LINKS    32
+#define MAX_CLIENTS  8
+
+#define FAST_MS_DFLT 2
+#define SLOW_MS_DFLT 20
+#define HOLD_MS_DFLT 5000
+
+#define REG_STAT     1
+#define  STAT_LINK   (1<<2)
+
+#define ST_UNKNOWN   (-1)
+#define ST_DOWN      0
+#define ST_UP        1
+
+typedef struct phylink_ {
+	char     name[16];
+	mdio_op  op;            /* status read                                */
+	int      state;
+	uint64_t next;          /* next poll due (ns)                         */
+	uint64_t ival;          /* current poll interval (ns)                 */
+	uint64_t changed;       /* time of the last change (ns)               */
+	/* statistics */
+	uint64_t polls, ups, downs, glitches, errors;
+	uint64_t t_up, t_down;  /* accumulated ns in state (until 'changed')  */
+} phylink;
+
+typedef void (*link_cb)(const phylink *l, uint64_t now, void *arg);
+
+typedef struct monitor_ {
+	mdio_bus  bus;
+	phylink   links[MAX_LINKS];
+	unsigned  nlinks;
+	uint64_t  fast, slow, hold;
+	link_cb   cb;
+	void     *cb_arg;
+} monitor;
+
+typedef struct publisher_ {
+	int       lsd;                  /* listening socket or -1 */
+	int       csd[MAX_CLIENTS];     /* clients, -1 if unused  */
+} publisher;
+
+static volatile sig_atomic_t stop  = 0;
+static volatile sig_atomic_t stats = 0;
+
+static uint64_t t_start;
+
+static inline uint64_t
+now_ns(void)
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void
+on_sig(int sig)
+{
+	if ( SIGUSR1 == sig )
+		stats = 1;
+	else
+		stop  = 1;
+}
+
+static double
+secs(uint64_t ns)
+{
+	return (double)ns / 1.0E9;
+}
+
+/* '<phy>' (clause 22) or '<prt>/<dev>' (clause 45) */
+static int
+add_link(monitor *m, const char *s)
+{
+phylink *l;
+int   a, b;
+
+	if ( m->nlinks >= MAX_LINKS ) {
+		fprintf(stderr,"Too many links (max %d)\n", MAX_LINKS);
+		return -1;
+	}
+	l = &m->links[m->nlinks];
+	memset( l, 0, sizeof(*l) );
+	if ( 2 == sscanf( s, "%i/%i", &a, &b ) ) {
+		l->op.phy = a;
+		l->op.dev = b;
+	} else if ( 1 == sscanf( s, "%i", &a ) ) {
+		l->op.phy = a;
+		l->op.dev = MDIO_C22;
+	} else {
+		fprintf(stderr,"Invalid link '%s' (<phy> or <prt>/<dev>)\n", s);
+		return -1;
+	}
+	if ( a < 0 || a > 31 || (MDIO_C22 != l->op.dev && (b < 0 || b > 31)) ) {
+		fprintf(stderr,"Invalid link '%s'\n", s);
+		return -1;
+	}
+	l->op.op  = MDIO_READ;
+	l->op.reg = REG_STAT;
+	l->state  = ST_UNKNOWN;
+	snprintf( l->name, sizeof(l->name), "%s", s );
+	m->nlinks++;
+	return 0;
+}
+
+static void
+set_state(monitor *m, phylink *l, int st, uint64_t now)
+{
+	if ( ST_UP == l->state )
+		l->t_up   += now - l->changed;
+	else if ( ST_DOWN == l->state )
+		l->t_down += now - l->changed;
+	l->state   = st;
+	l->changed = now;
+	if ( ST_UP == st )
+		l->ups++;
+	else
+		l->downs++;
+	m->cb( l, now, m->cb_arg );
+}
+
+/* schedule the next poll of 'l' */
+static void
+resched(monitor *m, phylink *l, uint64_t now)
+{
+	if ( now - l->changed < m->hold ) {
+		l->ival = m->fast;
+	} else {
+		l->ival *= 2;
+		if ( l->ival > m->slow )
+			l->ival = m->slow;
+	}
+	l->next = now + l->ival;
+}
+
+/* poll all links which are due */
+static void
+poll_due(monitor *m, uint64_t now)
+{
+mdio_op  ops[2*MAX_LINKS];
+phylink *due[MAX_LINKS];
+unsigned i, n = 0;
+int      st;
+
+	for ( i = 0; i < m->nlinks; i++ ) {
+		if ( m->links[i].next <= now ) {
+			due[n] = &m->links[i];
+			/* latched and current value */
+			ops[2*n]   = m->links[i].op;
+			ops[2*n+1] = m->links[i].op;
+			n++;
+		}
+	}
+	if ( ! n )
+		return;
+	/* the second read is only needed if the first one says 'down'; one
+	 * batch for all links is cheaper than a second round trip
+	 */
+	if ( mdio_xfer( m->bus, ops, 2*n ) < 2*n ) {
+		/* keep going (e.g., a controller timeout); retry when due again */
+		fprintf(stderr,"MDIO error: %s\n", strerror(errno));
+		now = now_ns();
+		for ( i = 0; i < n; i++ ) {
+			due[i]->errors++;
+			due[i]->next = now + due[i]->ival;
+		}
+		return;
+	}
+	now = now_ns();
+	for ( i = 0; i < n; i++ ) {
+		due[i]->polls++;
+		st = !! (ops[2*i+1].val & STAT_LINK);
+		if ( ! (ops[2*i].val & STAT_LINK) && ST_UP == due[i]->state && ST_UP == st ) {
+			/* lost and regained since the last poll */
+			due[i]->glitches++;
+			set_state( m, due[i], ST_DOWN, now );
+		}
+		if ( st != due[i]->state )
+			set_state( m, due[i], st, now );
+		resched( m, due[i], now );
+	}
+}
+
+static void
+print_stats(monitor *m, FILE *f, uint64_t now)
+{
+unsigned i;
+phylink *l;
+uint64_t up, down;
+
+	for ( i = 0; i < m->nlinks; i++ ) {
+		l    = &m->links[i];
+		up   = l->t_up   + (ST_UP   == l->state ? now - l->changed : 0);
+		down = l->t_down + (ST_DOWN == l->state ? now - l->changed : 0);
+		fprintf(f, "%.3f link=%s state=%s polls=%"PRIu64" ups=%"PRIu64" downs=%"PRIu64" glitches=%"PRIu64" errors=%"PRIu64" up_s=%.3f down_s=%.3f\n",
+			secs( now - t_start ), l->name, ST_UP == l->state ? "up" : (ST_DOWN == l->state ? "down" : "unknown"),
+			l->polls, l->ups, l->downs, l->glitches, l->errors, secs( up ), secs( down ));
+	}
+	fflush( f );
+}
+
+static int
+pub_open(publisher *p, const char *path)
+{
+struct sockaddr_un a;
+unsigned           i;
+
+	for ( i = 0; i < MAX_CLIENTS; i++ )
+		p->csd[i] = -1;
+	p->lsd = -1;
+	if ( ! path )
+		return 0;
+	if ( strlen( path ) >= sizeof(a.sun_path) ) {
+		fprintf(stderr,"Socket path too long\n");
+		return -1;
+	}
+	memset( &a, 0, sizeof(a) );
+	a.sun_family = AF_UNIX;
+	strcpy( a.sun_path, path );
+	unlink( path );
+	if (    (p->lsd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0 )) < 0
+	     || bind( p->lsd, (struct sockaddr*)&a, sizeof(a) )
+	     || listen( p->lsd, MAX_CLIENTS ) ) {
+		fprintf(stderr,"Unable to create socket '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void
+pub_accept(publisher *p)
+{
+unsigned i;
+int      sd;
+	while ( (sd = accept( p->lsd, 0, 0 )) >= 0 ) {
+		for ( i = 0; i < MAX_CLIENTS && p->csd[i] >= 0; i++ )
+			;
+		if ( i == MAX_CLIENTS ) {
+			close( sd );
+			continue;
+		}
+		fcntl( sd, F_SETFL, O_NONBLOCK );
+		p->csd[i] = sd;
+	}
+}
+
+/* clients which cannot keep up are dropped */
+static void
+pub_send(publisher *p, const char *buf, size_t len)
+{
+unsigned i;
+	for ( i = 0; i < MAX_CLIENTS; i++ ) {
+		if ( p->csd[i] >= 0 && len != send( p->csd[i], buf, len, MSG_NOSIGNAL ) ) {
+			close( p->csd[i] );
+			p->csd[i] = -1;
+		}
+	}
+}
+
+static void
+publish(const phylink *l, uint64_t now, void *arg)
+{
+publisher *p = (publisher*)arg;
+char       buf[128];
+int        len;
+
+	len = snprintf( buf, sizeof(buf), "%.3f link=%s state=%s\n",
+		secs( now - t_start ), l->name, ST_UP == l->state ? "up" : "down" );
+	fputs( buf, stdout );
+	fflush( stdout );
+	pub_send( p, buf, len );
+}
+
+static void
+usage(const char *nm)
+{
+	fprintf(stderr,"Usage: %s [-h] [-I bus] [-f fast_ms] [-S slow_ms] [-H hold_ms] [-s socket] link [link...]\n", nm);
+	fprintf(stderr,"          monitor PHY link status\n");
+	fprintf(stderr,"          link     : <phy> (clause 22, BMSR) or <prt>/<dev> (clause 45, <dev>.1; dev 3: PCS)\n");
+	fprintf(stderr,"          -I bus   : mdiolib bus (default 'gpio'; e.g., 'xgmac:/dev/uio3', 'if:eth0')\n");
+	fprintf(stderr,"          -f ms    : poll interval after a change (default %d)\n", FAST_MS_DFLT);
+	fprintf(stderr,"          -S ms    : max. poll interval of a stable link, i.e., link-down latency (default %d)\n", SLOW_MS_DFLT);
+	fprintf(stderr,"          -H ms    : time after a change during which we poll fast (default %d)\n", HOLD_MS_DFLT);
+	fprintf(stderr,"          -s path  : also send changes to clients of unix (stream) socket 'path'\n");
+	fprintf(stderr,"          SIGUSR1 prints statistics (so does exiting on SIGINT/SIGTERM)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+const char      *bus_spec = "gpio";
+const char      *sock     = 0;
+int              opt, i;
+int              rval     = 1;
+int              fast     = FAST_MS_DFLT;
+int              slow     = SLOW_MS_DFLT;
+int              hold     = HOLD_MS_DFLT;
+int             *i_p;
+monitor          m;
+publisher        pub;
+struct pollfd    pfd;
+struct sigaction sa;
+uint64_t         now, next;
+
+	memset( &m, 0, sizeof(m) );
+	while ( (opt = getopt(argc, argv, "hI:f:S:H:s:")) > 0 ) {
+		i_p = 0;
+		switch ( opt ) {
+			case 'h': rval = 0;
+			default:
+				usage(argv[0]);
+				return rval;
+
+			case 'I': bus_spec = optarg; break;
+			case 's': sock     = optarg; break;
+			case 'f': i_p      = &fast;  break;
+			case 'S': i_p      = &slow;  break;
+			case 'H': i_p      = &hold;  break;
+		}
+		if ( i_p && ( 1 != sscanf(optarg, "%i", i_p) || *i_p <= 0 ) ) {
+			fprintf(stderr,"Invalid argument to -%c\n", opt);
+			return 1;
+		}
+	}
+	if ( optind >= argc ) {
+		usage(argv[0]);
+		return 1;
+	}
+	for ( i = optind; i < argc; i++ ) {
+		if ( add_link( &m, argv[i] ) )
+			return 1;
+	}
+	if ( slow < fast )
+		slow = fast;
+	m.fast = (uint64_t)fast * 1000000ULL;
+	m.slow = (uint64_t)slow * 1000000ULL;
+	m.hold = (uint64_t)hold * 1000000ULL;
+
+	if ( pub_open( &pub, sock ) )
+		return 1;
+	m.cb     = publish;
+	m.cb_arg = &pub;
+
+	if ( ! (m.bus = mdio_open( bus_spec, 0, MDIO_F_SUPPRESS_PREAMBLE )) ) {
+		fprintf(stderr,"Unable to open MDIO bus '%s'\n", bus_spec);
+		goto bail;
+	}
+
+	memset( &sa, 0, sizeof(sa) );
+	sa.sa_handler = on_sig;
+	sigaction( SIGINT,  &sa, 0 );
+	sigaction( SIGTERM, &sa, 0 );
+	sigaction( SIGUSR1, &sa, 0 );
+
+	t_start = now_ns();
+	for ( i = 0; i < m.nlinks; i++ ) {
+		m.links[i].next    = t_start;
+		m.links[i].changed = t_start;
+		m.links[i].ival    = m.fast;
+	}
+
+	pfd.fd     = pub.lsd;
+	pfd.events = POLLIN;
+	while ( ! stop ) {
+		now = now_ns();
+		poll_due( &m, now );
+		if ( stats ) {
+			stats = 0;
+			print_stats( &m, stdout, now_ns() );
+		}
+		/* sleep until the next link is due (or a client connects) */
+		next = m.links[0].next;
+		for ( i = 1; i < m.nlinks; i++ ) {
+			if ( m.links[i].next < next )
+				next = m.links[i].next;
+		}
+		now = now_ns();
+		if ( next > now ) {
+			/* round up to ms */
+			if ( poll( &pfd, pub.lsd >= 0 ? 1 : 0, (next - now + 999999) / 1000000 ) > 0 )
+				pub_accept( &pub );
+		}
+	}
+	print_stats( &m, stdout, now_ns() );
+	rval = 0;
+
+bail:
+	mdio_close( m.bus );
+	if ( pub.lsd >= 0 ) {
+		close( pub.lsd );
+		unlink( sock );
+	}
+	return rval;
+}
@@ -1,22 +1,36 @@
 #!/bin/sh
-SND=/nfs/host/snd.sh
-$SND 0xf 0  # RESET
-sleep 1
-$SND 6 0x72 # power-on essential parts (except OUT)
+# WM8731 bring-up in a single i2cm run using the register map: the
+# shadow (on a tmpfs, i.e., gone after a power-cycle) lets only
+# registers whose value changes be written. The codec is reset if
+# there is no shadow or with '-r'.
+# (I2CDEV: i2cm -d device)
+I2CM=/nfs/host/i2cm
+SHADOW=${SHADOW:-/run/wm8731.regs}
+: ${I2CDEV:?"set I2CDEV to the i2c device (see i2cm -d)"}
+if [ "$1" = "-r" ] || [ ! -f $SHADOW ] ; then
+	RESET="s reset 0
+d 1000
+s pwr 0x72"
+	SETTLE="d 1000"
+fi
+$I2CM -d $I2CDEV -m wm8731 -S $SHADOW -s - > /dev/null <<EOF
+# RESET; power-on essential parts (except OUT)
+$RESET
 
 # ADC
-$SND 0 0x17 # unmute + vol left
-$SND 1 0x17 # unmute + vol right
+s linvol 0x17 # unmute + vol left
+s rinvol 0x17 # unmute + vol right
 
 
 # DAC
-$SND 5 0x00 # disable DAC mute
-$SND 4 0x12 # enable DAC to mixer
+s apdigi 0x00 # disable DAC mute
+s apana  0x12 # enable DAC to mixer
 
 # SAMPLING
-#$SND 8 0x01 # enable USB mode 48khz
-$SND 8 0x23 # USB, BOSR, 41kHz
-$SND 7 0x02 # 16-bit samples
-sleep 1
-$SND 9 0x01 # activate
-$SND 6 0x62 # power-on OUT
+#s srate 0x01 # enable USB mode 48khz
+s srate  0x23 # USB, BOSR, 41kHz
+s iface  0x02 # 16-bit samples
+$SETTLE
+s active 0x01 # activate
+s pwr    0x62 # power-on OUT
+EOF
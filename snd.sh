@@ -1,12 +1,13 @@
 #!/bin/sh
-ADDR=0x1a
+# WM8731 register (name or number) access via the i2cm register map;
+# the registers are write-only, i.e., reading returns the shadow
 I2CM=/nfs/host/i2cm
+SHADOW=${SHADOW:-/run/wm8731.regs}
+: ${I2CDEV:?"set I2CDEV to the i2c device (see i2cm -d)"}
 if [ $# -eq 1 ] ; then
-	$I2CM -a $ADDR -o $(( $1 << 1 )) -l 2 | awk '/:/{printf("0x%s%s\n",$3,$2);}'
+	$I2CM -d $I2CDEV -m wm8731 -S $SHADOW $1 2>/dev/null | awk '{print $2}'
 elif [ $# -eq 2 ] ; then
-	OFF=$(( ( $1 << 1 ) | (( $2 >> 8 ) & 1) ))
-	VAL=$(( $2 & 0xff ))
-	$I2CM -a $ADDR -o $OFF $VAL
+	$I2CM -d $I2CDEV -m wm8731 -S $SHADOW $1=$2 2>/dev/null
 else
   echo "Usage: $0 offset [val]"
   exit 1